@@ -28,6 +28,8 @@ Auto find the bash of the current env as the capture target.`,
 func init() {
 	bashCmd.PersistentFlags().StringVar(&bc.Bashpath, "bash", "", "$SHELL file path, eg: /bin/bash , will automatically find it from $ENV default.")
 	bashCmd.PersistentFlags().StringVar(&bc.Readline, "readlineso", "", "readline.so file path, will automatically find it from $BASH_PATH default.")
+	bashCmd.PersistentFlags().Uint32Var(&bc.LineMaxLen, "max-line-len", user.MAX_DATA_SIZE_BASH, "capture at most this many bytes of each line, up to 4096")
+	bashCmd.PersistentFlags().BoolVar(&bc.Session, "session", false, "group commands by login session (sid, tty, loginuid), print a session when it ends")
 	bashCmd.Flags().IntVarP(&bc.ErrNo, "errnumber", "e", user.BASH_ERRNO_DEFAULT, "only show the command which exec reulst equals err number.")
 	rootCmd.AddCommand(bashCmd)
 
@@ -61,6 +63,13 @@ func bashCommandFunc(command *cobra.Command, args []string) {
 		os.Exit(1)
 	}
 	bc.Pid = gConf.Pid
+	bc.PidTree = gConf.PidTree
+	bc.PerfReaders = gConf.PerfReaders
+	bc.PinReaders = gConf.PinReaders
+	bc.PerfBufferSize = gConf.PerfBufferSize * 1024
+	bc.PerfWatermark = gConf.PerfWatermark
+	bc.CaptureFile = gConf.CaptureFile
+	bc.Format = gConf.Format
 	bc.Debug = gConf.Debug
 	bc.IsHex = gConf.IsHex
 
@@ -87,5 +96,7 @@ func bashCommandFunc(command *cobra.Command, args []string) {
 	}(mod)
 	<-stopper
 	cancelFun()
+	// 写出缓冲中的事件
+	mod.Flush()
 	os.Exit(0)
 }
@@ -5,15 +5,28 @@ Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
 package cmd
 
 import (
+	"ecapture/user"
+	"fmt"
+
 	"github.com/spf13/cobra"
 )
 
 // GlobalFlags are flags that defined globally
 // and are inherited to all sub-commands.
 type GlobalFlags struct {
-	IsHex bool
-	Debug bool
-	Pid   uint64 // PID
+	IsHex   bool
+	Debug   bool
+	Pid     uint64 // PID
+	PidTree bool   // PID and its descendants
+
+	PerfReaders int  // perf buffer reader shards
+	PinReaders  bool // pin the shards to their CPUs
+
+	PerfBufferSize int // per-CPU perf buffer size, KB
+	PerfWatermark  int // wakeup watermark, bytes
+
+	CaptureFile string // write raw events to a capture file
+	Format      string // text or json
 }
 
 func getGlobalConf(command *cobra.Command) (conf GlobalFlags, err error) {
@@ -22,6 +35,11 @@ func getGlobalConf(command *cobra.Command) (conf GlobalFlags, err error) {
 		return
 	}
 
+	conf.PidTree, err = command.Flags().GetBool("tree")
+	if err != nil {
+		return
+	}
+
 	conf.Debug, err = command.Flags().GetBool("debug")
 	if err != nil {
 		return
@@ -31,5 +49,39 @@ func getGlobalConf(command *cobra.Command) (conf GlobalFlags, err error) {
 	if err != nil {
 		return
 	}
+
+	conf.PerfReaders, err = command.Flags().GetInt("readers")
+	if err != nil {
+		return
+	}
+
+	conf.PinReaders, err = command.Flags().GetBool("pin-readers")
+	if err != nil {
+		return
+	}
+
+	conf.PerfBufferSize, err = command.Flags().GetInt("perf-buffer")
+	if err != nil {
+		return
+	}
+
+	conf.PerfWatermark, err = command.Flags().GetInt("wakeup")
+	if err != nil {
+		return
+	}
+
+	conf.CaptureFile, err = command.Flags().GetString("write")
+	if err != nil {
+		return
+	}
+
+	conf.Format, err = command.Flags().GetString("format")
+	if err != nil {
+		return
+	}
+	if conf.Format != user.OUTPUT_FORMAT_TEXT && conf.Format != user.OUTPUT_FORMAT_JSON {
+		err = fmt.Errorf("unsupported format:%s, want %s or %s", conf.Format, user.OUTPUT_FORMAT_TEXT, user.OUTPUT_FORMAT_JSON)
+		return
+	}
 	return
 }
@@ -30,6 +30,11 @@ other version coming soon`,
 func init() {
 	mysqldCmd.PersistentFlags().StringVarP(&mysqldConfig.Mysqldpath, "mysqld", "m", "/usr/sbin/mariadbd", "mysqld binary file path, use to hook")
 	mysqldCmd.PersistentFlags().Uint64VarP(&mysqldConfig.Offset, "offset", "", 0, "0x710410")
+	mysqldCmd.PersistentFlags().Uint64VarP(&mysqldConfig.ThdIdOffset, "thd-id-offset", "", 0, "offset of the connection id in THD (THD::m_thread_id), 0 for unknown. From the mysqld debuginfo: pahole -C THD mysqld.debug")
+	mysqldCmd.PersistentFlags().Uint64VarP(&mysqldConfig.ThdStmtIdOffset, "thd-stmt-id-offset", "", 0, "offset of THD::statement_id_counter, to match MySQL 8.0 prepared statements with their executes. 0 for unknown. From the mysqld debuginfo: pahole -C THD mysqld.debug")
+	mysqldCmd.PersistentFlags().Uint32Var(&mysqldConfig.QueryMaxLen, "max-query-len", user.MYSQLD_MAX_DATA_SIZE, "capture at most this many bytes of each query, up to 32704")
+	mysqldCmd.PersistentFlags().BoolVar(&mysqldConfig.Latency, "latency", false, "print query latency histograms by statement type instead of queries")
+	mysqldCmd.PersistentFlags().Uint64Var(&mysqldConfig.Interval, "interval", 5, "seconds between two latency reports, with --latency")
 	mysqldCmd.PersistentFlags().StringVarP(&mysqldConfig.FuncName, "funcname", "f", "", "function name to hook")
 	rootCmd.AddCommand(mysqldCmd)
 }
@@ -53,6 +58,13 @@ func mysqldCommandFunc(command *cobra.Command, args []string) {
 		os.Exit(1)
 	}
 	mysqldConfig.Pid = gConf.Pid
+	mysqldConfig.PidTree = gConf.PidTree
+	mysqldConfig.PerfReaders = gConf.PerfReaders
+	mysqldConfig.PinReaders = gConf.PinReaders
+	mysqldConfig.PerfBufferSize = gConf.PerfBufferSize * 1024
+	mysqldConfig.PerfWatermark = gConf.PerfWatermark
+	mysqldConfig.CaptureFile = gConf.CaptureFile
+	mysqldConfig.Format = gConf.Format
 	mysqldConfig.Debug = gConf.Debug
 	mysqldConfig.IsHex = gConf.IsHex
 
@@ -79,5 +91,7 @@ func mysqldCommandFunc(command *cobra.Command, args []string) {
 	}(mod)
 	<-stopper
 	cancelFun()
+	// 写出缓冲中的事件
+	mod.Flush()
 	os.Exit(0)
 }
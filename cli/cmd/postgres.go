@@ -27,6 +27,8 @@ var postgresCmd = &cobra.Command{
 func init() {
 	postgresCmd.PersistentFlags().StringVarP(&postgresConfig.PostgresPath, "postgres", "m", "/usr/bin/postgres", "postgres binary file path, use to hook")
 	postgresCmd.PersistentFlags().StringVarP(&postgresConfig.FuncName, "funcname", "f", "", "function name to hook")
+	postgresCmd.PersistentFlags().Uint32Var(&postgresConfig.QueryMaxLen, "max-query-len", user.POSTGRES_MAX_DATA_SIZE, "capture at most this many bytes of each query, up to 4096")
+	postgresCmd.PersistentFlags().Uint64Var(&postgresConfig.Threshold, "threshold", 0, "only capture queries running for at least this many milliseconds, 0 for all")
 	rootCmd.AddCommand(postgresCmd)
 }
 
@@ -49,6 +51,13 @@ func postgresCommandFunc(command *cobra.Command, args []string) {
 		os.Exit(1)
 	}
 	postgresConfig.Pid = gConf.Pid
+	postgresConfig.PidTree = gConf.PidTree
+	postgresConfig.PerfReaders = gConf.PerfReaders
+	postgresConfig.PinReaders = gConf.PinReaders
+	postgresConfig.PerfBufferSize = gConf.PerfBufferSize * 1024
+	postgresConfig.PerfWatermark = gConf.PerfWatermark
+	postgresConfig.CaptureFile = gConf.CaptureFile
+	postgresConfig.Format = gConf.Format
 	postgresConfig.Debug = gConf.Debug
 	postgresConfig.IsHex = gConf.IsHex
 
@@ -74,5 +83,7 @@ func postgresCommandFunc(command *cobra.Command, args []string) {
 	}(mod)
 	<-stopper
 	cancelFun()
+	// 写出缓冲中的事件
+	mod.Flush()
 	os.Exit(0)
 }
@@ -0,0 +1,48 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package cmd
+
+import (
+	"context"
+	"ecapture/user"
+	"log"
+	"os"
+
+	"github.com/spf13/cobra"
+)
+
+// readCmd represents the read command
+var readCmd = &cobra.Command{
+	Use:   "read <file>",
+	Short: "print the events of a capture file written with --write.",
+	Long: ` decode and print the events of a capture file offline, with the module
+that captured them. No eBPF program is loaded.
+
+ecapture read /tmp/tls.ecap
+ecapture read --hex /tmp/tls.ecap
+ecapture read --format json /tmp/tls.ecap`,
+	Args: cobra.ExactArgs(1),
+	Run:  readCommandFunc,
+}
+
+func init() {
+	rootCmd.AddCommand(readCmd)
+}
+
+// readCommandFunc executes the "read" command.
+func readCommandFunc(command *cobra.Command, args []string) {
+	logger := log.Default()
+
+	gConf, e := getGlobalConf(command)
+	if e != nil {
+		logger.Fatal(e)
+		os.Exit(1)
+	}
+
+	if e := user.ReadCapture(context.TODO(), logger, args[0], gConf.IsHex, gConf.Format); e != nil {
+		logger.Fatal(e)
+		os.Exit(1)
+	}
+}
@@ -6,6 +6,7 @@ package cmd
 
 import (
 	"ecapture/cli/cobrautl"
+	"ecapture/user"
 	"os"
 
 	"github.com/spf13/cobra"
@@ -74,4 +75,11 @@ func init() {
 	rootCmd.PersistentFlags().BoolVarP(&globalFlags.Debug, "debug", "d", false, "enable debug logging")
 	rootCmd.PersistentFlags().BoolVar(&globalFlags.IsHex, "hex", false, "print byte strings as hex encoded strings")
 	rootCmd.PersistentFlags().Uint64VarP(&globalFlags.Pid, "pid", "p", defaultPid, "if pid is 0 then we target all pids")
+	rootCmd.PersistentFlags().BoolVar(&globalFlags.PidTree, "tree", false, "target the descendants of --pid too, including the ones forked later")
+	rootCmd.PersistentFlags().IntVar(&globalFlags.PerfReaders, "readers", 0, "read the per-CPU perf buffers with this many threads, each owning a subset of the CPUs. 0: one reader per map")
+	rootCmd.PersistentFlags().BoolVar(&globalFlags.PinReaders, "pin-readers", false, "pin each --readers thread to the CPUs it reads")
+	rootCmd.PersistentFlags().IntVar(&globalFlags.PerfBufferSize, "perf-buffer", 0, "per-CPU perf buffer size of each map in KB, rounded up to a power of two pages. 0: sized from the CPU count within a 64 MB budget per module")
+	rootCmd.PersistentFlags().IntVar(&globalFlags.PerfWatermark, "wakeup", 0, "wake the reader up once this many bytes are buffered, instead of on every sample. Buffers are still read every 200ms")
+	rootCmd.PersistentFlags().StringVarP(&globalFlags.CaptureFile, "write", "w", "", "write raw events to this capture file instead of printing them, print it with the read command")
+	rootCmd.PersistentFlags().StringVar(&globalFlags.Format, "format", user.OUTPUT_FORMAT_TEXT, "output format of the events: text, or json for one JSON object per line on stdout")
 }
@@ -15,9 +15,7 @@ import (
 	"github.com/spf13/cobra"
 )
 
-var oc = user.NewOpensslConfig()
-var gc = user.NewGnutlsConfig()
-var nc = user.NewNsprConfig()
+var tc = user.NewTlsConfig()
 
 // opensslCmd represents the openssl command
 var opensslCmd = &cobra.Command{
@@ -31,13 +29,14 @@ Can used to trace, debug, database audit, security event aduit etc.
 }
 
 func init() {
-	opensslCmd.PersistentFlags().StringVar(&oc.Curlpath, "curl", "", "curl or wget file path, use to dectet openssl.so path, default:/usr/bin/curl")
-	opensslCmd.PersistentFlags().StringVar(&oc.Openssl, "libssl", "", "libssl.so file path, will automatically find it from curl default.")
-	opensslCmd.PersistentFlags().StringVar(&gc.Gnutls, "gnutls", "", "libgnutls.so file path, will automatically find it from curl default.")
-	opensslCmd.PersistentFlags().StringVar(&gc.Curlpath, "wget", "", "wget file path, default: /usr/bin/wget.")
-	opensslCmd.PersistentFlags().StringVar(&nc.Firefoxpath, "firefox", "", "firefox file path, default: /usr/lib/firefox/firefox.")
-	opensslCmd.PersistentFlags().StringVar(&nc.Nsprpath, "nspr", "", "libnspr44.so file path, will automatically find it from curl default.")
-	opensslCmd.PersistentFlags().StringVar(&oc.Pthread, "pthread", "", "libpthread.so file path, use to hook connect to capture socket FD.will automatically find it from curl.")
+	opensslCmd.PersistentFlags().StringVar(&tc.Openssl.Curlpath, "curl", "", "curl or wget file path, use to dectet openssl.so path, default:/usr/bin/curl")
+	opensslCmd.PersistentFlags().StringVar(&tc.Openssl.Openssl, "libssl", "", "libssl.so file path, will automatically find it from curl default.")
+	opensslCmd.PersistentFlags().StringVar(&tc.Gnutls.Gnutls, "gnutls", "", "libgnutls.so file path, will automatically find it from curl default.")
+	opensslCmd.PersistentFlags().StringVar(&tc.Gnutls.Curlpath, "wget", "", "wget file path, default: /usr/bin/wget.")
+	opensslCmd.PersistentFlags().StringVar(&tc.Nspr.Firefoxpath, "firefox", "", "firefox file path, default: /usr/lib/firefox/firefox.")
+	opensslCmd.PersistentFlags().StringVar(&tc.Nspr.Nsprpath, "nspr", "", "libnspr44.so file path, will automatically find it from curl default.")
+	opensslCmd.PersistentFlags().StringVar(&tc.Openssl.Pthread, "pthread", "", "libpthread.so file path, use to hook connect to capture socket FD.will automatically find it from curl.")
+	opensslCmd.PersistentFlags().StringVar(&tc.PcapFile, "pcapfile", "", "write the plaintext to this pcapng file, as TCP streams Wireshark can dissect, instead of printing it")
 
 	rootCmd.AddCommand(opensslCmd)
 }
@@ -57,64 +56,46 @@ func openSSLCommandFunc(command *cobra.Command, args []string) {
 	}
 	log.Printf("pid info :%d", os.Getpid())
 
-	modNames := []string{user.MODULE_NAME_OPENSSL, user.MODULE_NAME_GNUTLS, user.MODULE_NAME_NSPR}
-
-	var runMods uint8
-	for _, modName := range modNames {
-		mod := user.GetModuleByName(modName)
-		if mod == nil {
-			logger.Printf("cant found module: %s", modName)
-			break
-		}
-		logger.Printf("start to run %s module", mod.Name())
-
-		var conf user.IConfig
-		switch mod.Name() {
-		case user.MODULE_NAME_OPENSSL:
-			conf = oc
-		case user.MODULE_NAME_GNUTLS:
-			conf = gc
-		case user.MODULE_NAME_NSPR:
-			conf = nc
-		default:
-		}
-
-		if conf == nil {
-			logger.Printf("cant found module %s config info.", mod.Name())
-			break
-		}
-
-		conf.SetPid(gConf.Pid)
-		conf.SetDebug(gConf.Debug)
-		conf.SetHex(gConf.IsHex)
+	// openssl, gnutls and nspr share one module, it probes the libraries it found.
+	mod := user.GetModuleByName(user.MODULE_NAME_OPENSSL)
+	if mod == nil {
+		logger.Fatalf("cant found module: %s", user.MODULE_NAME_OPENSSL)
+	}
+	logger.Printf("start to run %s module", mod.Name())
+
+	var conf user.IConfig = tc
+	conf.SetPid(gConf.Pid)
+	conf.SetPidTree(gConf.PidTree)
+	conf.SetPerfReaders(gConf.PerfReaders)
+	conf.SetPinReaders(gConf.PinReaders)
+	conf.SetPerfBufferSize(gConf.PerfBufferSize * 1024)
+	conf.SetPerfWatermark(gConf.PerfWatermark)
+	conf.SetCaptureFile(gConf.CaptureFile)
+	conf.SetFormat(gConf.Format)
+	conf.SetDebug(gConf.Debug)
+	conf.SetHex(gConf.IsHex)
+
+	if e := conf.Check(); e != nil {
+		logger.Fatal(e)
+	}
 
-		if e := conf.Check(); e != nil {
-			logger.Printf("%v", e)
-			continue
-		}
+	//初始化
+	err := mod.Init(ctx, logger, conf)
+	if err != nil {
+		logger.Fatal(err)
+	}
 
-		//初始化
-		err := mod.Init(ctx, logger, conf)
+	// 加载ebpf，挂载到hook点上，开始监听
+	go func(module user.IModule) {
+		err := module.Run()
 		if err != nil {
-			logger.Printf("%v", err)
-			continue
+			logger.Fatalf("%v", err)
 		}
+	}(mod)
 
-		// 加载ebpf，挂载到hook点上，开始监听
-		go func(module user.IModule) {
-			err := module.Run()
-			if err != nil {
-				logger.Printf("%v", err)
-				return
-			}
-		}(mod)
-		runMods++
-	}
-
-	// needs runmods > 0
-	if runMods > 0 {
-		<-stopper
-	}
+	<-stopper
 	cancelFun()
+	// 写出缓冲中的事件
+	mod.Flush()
 	os.Exit(0)
 }
@@ -1,74 +1,203 @@
 #include "ecapture.h"
+#include "process.h"
 
+// header.len carries the length of retval and line, line is the last field
+// and only its captured bytes, NUL included, are sent.
+// Lines are sent when readline returns, EVENT_TYPE_BASH_RETVAL events only
+// carry the retval of the outermost execute_command that follows, user space
+// pairs them. A line that is never executed is sent all the same.
+// sid, loginuid and tty tie the line to its session, only line events carry
+// them.
 struct event {
-    u32 pid;
+    struct event_header_t header;
+    u32 retval;
+    u32 sid;       // session id
+    u32 loginuid;  // audit login uid, (u32)-1 if unset
+    char tty[TTY_NAME_LEN];
     u8 line[MAX_DATA_SIZE_BASH];
+};
+
+#define BASH_BODY_FIXED_SIZE \
+    (__builtin_offsetof(struct event, line) - EVENT_HEADER_SIZE)
+
+// the retval of struct event, for EVENT_TYPE_BASH_RETVAL.
+struct retval_event {
+    struct event_header_t header;
     u32 retval;
-    char comm[TASK_COMM_LEN];
 };
 
 struct {
     __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
 } events SEC(".maps");
 
+// Shells with a line waiting for its retval, keyed by pid, and the depth of
+// execute_command: it recurses for connections and compound commands, the
+// retval of the line is the one of the outermost call. LRU, so shells that
+// exit before execute_command returns do not leak.
 struct {
-    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
     __type(key, u32);
-    __type(value, struct event);
-    __uint(max_entries, 1024);
-} events_t SEC(".maps");
+    __type(value, u32);
+    __uint(max_entries, 65536);
+} pending_lines SEC(".maps");
 // Force emitting struct event into the ELF.
 const struct event *unused __attribute__((unused));
 
+// struct event is too large for the 512-byte stack.
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __type(key, u32);
+    __type(value, struct event);
+    __uint(max_entries, 1);
+} event_heap SEC(".maps");
+
+// Counters, keep in sync with user/probe_bash.go.
+enum bash_stat {
+    BASH_STAT_LINES = 0,
+    BASH_STAT_RETVALS,
+    BASH_STAT_OUTPUT_LOST,   // perf buffer full
+    BASH_STAT_PENDING_LOST,  // pending_lines update failed
+    BASH_STAT_MAX,
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __type(key, u32);
+    __type(value, u64);
+    __uint(max_entries, BASH_STAT_MAX);
+} bash_stats SEC(".maps");
+
+#ifndef KERNEL_LESS_5_2
+// at most line_max_len bytes of a line are captured, NUL included.
+const volatile u32 line_max_len = MAX_DATA_SIZE_BASH;
+#endif
+
+// fill_session reads the session of the current task.
+static __inline void fill_session(struct event *event) {
+    event->sid = 0;
+    event->loginuid = (u32)-1;
+    event->tty[0] = 0;
+#ifndef NOCORE
+    struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+    event->loginuid = BPF_CORE_READ(task, loginuid.val);
+    event->sid =
+        BPF_CORE_READ(task, signal, pids[PIDTYPE_SID], numbers[0].nr);
+    struct tty_struct *tty = BPF_CORE_READ(task, signal, tty);
+    if (tty) {
+        bpf_core_read_str(&event->tty, sizeof(event->tty), &tty->name);
+    }
+#endif
+}
+
+static __inline void bash_stat_inc(u32 stat) {
+    u64 *count = bpf_map_lookup_elem(&bash_stats, &stat);
+    if (count) {
+        *count += 1;
+    }
+}
+
 SEC("uretprobe/bash_readline")
 int uretprobe_bash_readline(struct pt_regs *ctx) {
     s64 pid_tgid = bpf_get_current_pid_tgid();
     int pid = pid_tgid >> 32;
 
-#ifndef KERNEL_LESS_5_2
-    // if target_ppid is 0 then we target all pids
-    if (target_pid != 0 && target_pid != pid) {
+    if (!is_target(pid)) {
         return 0;
     }
-#endif
 
-    struct event event = {};
-    event.pid = pid;
+    u32 kZero = 0;
+    struct event *event = bpf_map_lookup_elem(&event_heap, &kZero);
+    if (event == NULL) {
+        return 0;
+    }
+    fill_event_header(&event->header, EVENT_TYPE_BASH, pid_tgid);
+    event->retval = 0;
+    fill_session(event);
+
+    u64 max_len = MAX_DATA_SIZE_BASH;
+#ifndef KERNEL_LESS_5_2
+    max_len = line_max_len;
+#endif
+    max_len = (max_len < MAX_DATA_SIZE_BASH
+                   ? (max_len & (MAX_DATA_SIZE_BASH - 1))
+                   : MAX_DATA_SIZE_BASH);
     // bpf_printk("!! uretprobe_bash_readline pid:%d",target_pid );
-    bpf_probe_read(&event.line, sizeof(event.line), (void *)PT_REGS_RC(ctx));
-    bpf_get_current_comm(&event.comm, sizeof(event.comm));
-    bpf_map_update_elem(&events_t, &pid, &event, BPF_ANY);
+    long len = bpf_probe_read_user_str(&event->line, max_len,
+                                       (void *)PT_REGS_RC(ctx));
+    // EOF, or an empty line that will not be executed.
+    if (len <= 1) {
+        return 0;
+    }
+    len = (len < MAX_DATA_SIZE_BASH ? (len & (MAX_DATA_SIZE_BASH - 1))
+                                    : MAX_DATA_SIZE_BASH);
+    event->header.len = BASH_BODY_FIXED_SIZE + len;
+
+    bash_stat_inc(BASH_STAT_LINES);
+    u32 depth = 0;
+    if (bpf_map_update_elem(&pending_lines, &pid, &depth, BPF_ANY) != 0) {
+        bash_stat_inc(BASH_STAT_PENDING_LOST);
+    }
+    if (bpf_perf_event_output(ctx, &events, BPF_F_CURRENT_CPU, event,
+                              __builtin_offsetof(struct event, line) + len) !=
+        0) {
+        bash_stat_inc(BASH_STAT_OUTPUT_LOST);
+    }
+    return 0;
+}
+
+SEC("uprobe/bash_execute")
+int uprobe_bash_execute(struct pt_regs *ctx) {
+    s64 pid_tgid = bpf_get_current_pid_tgid();
+    int pid = pid_tgid >> 32;
 
+    if (!is_target(pid)) {
+        return 0;
+    }
+
+    u32 *depth = bpf_map_lookup_elem(&pending_lines, &pid);
+    if (depth != NULL) {
+        *depth += 1;
+    }
     return 0;
 }
+
 SEC("uretprobe/bash_retval")
 int uretprobe_bash_retval(struct pt_regs *ctx) {
     s64 pid_tgid = bpf_get_current_pid_tgid();
     int pid = pid_tgid >> 32;
     int retval = (int)PT_REGS_RC(ctx);
 
-#ifndef KERNEL_LESS_5_2
-    // if target_ppid is 0 then we target all pids
-    if (target_pid != 0 && target_pid != pid) {
+    if (!is_target(pid)) {
         return 0;
     }
-#endif
 
-    struct event *event_p = bpf_map_lookup_elem(&events_t, &pid);
+    // only the return of the outermost execute_command after a line is
+    // sent, `false; true` returns 0.
+    u32 *depth = bpf_map_lookup_elem(&pending_lines, &pid);
+    if (depth == NULL) {
+        return 0;
+    }
+    if (*depth > 1) {
+        *depth -= 1;
+        return 0;
+    }
+    bpf_map_delete_elem(&pending_lines, &pid);
 
 #ifndef KERNEL_LESS_5_2
     // if target_errno is 128 then we target all
     if (target_errno != BASH_ERRNO_DEFAULT && target_errno != retval) {
-        if (event_p) bpf_map_delete_elem(&events_t, &pid);
         return 0;
     }
 #endif
 
-    if (event_p) {
-        event_p->retval = retval;
-        bpf_map_update_elem(&events_t, &pid, event_p, BPF_ANY);
-        bpf_perf_event_output(ctx, &events, BPF_F_CURRENT_CPU, event_p,
-                              sizeof(struct event));
+    struct retval_event event = {};
+    fill_event_header(&event.header, EVENT_TYPE_BASH_RETVAL, pid_tgid);
+    event.header.len = sizeof(event.retval);
+    event.retval = retval;
+    bash_stat_inc(BASH_STAT_RETVALS);
+    if (bpf_perf_event_output(ctx, &events, BPF_F_CURRENT_CPU, &event,
+                              sizeof(event)) != 0) {
+        bash_stat_inc(BASH_STAT_OUTPUT_LOST);
     }
     return 0;
 }
@@ -13,28 +13,82 @@
 
 #define TASK_COMM_LEN 16
 #define MAX_DATA_SIZE_OPENSSL 1024 * 4
-#define MAX_DATA_SIZE_MYSQL 256
-#define MAX_DATA_SIZE_POSTGRES 256
-#define MAX_DATA_SIZE_BASH 256
+// struct data_t of mysqld_kern.c must fit in PCPU_MIN_UNIT_SIZE (32 KB) for
+// its per-CPU heap, less the fields before its query, rounded up to 64.
+#define MAX_DATA_SIZE_MYSQL (1024 * 32 - 64)
+#define MAX_DATA_SIZE_POSTGRES 1024 * 4
+#define MAX_DATA_SIZE_BASH 1024 * 4
+#define MAX_PATH_SIZE 256
+#define MAX_CMDLINE_SIZE 256
+#define TTY_NAME_LEN 16
 
 // enum_server_command, via
 // https://dev.mysql.com/doc/internals/en/com-query.html COM_QUERT command 03
 #define COM_QUERY 3
+#define COM_STMT_PREPARE 22
+#define COM_STMT_EXECUTE 23
+#define COM_STMT_CLOSE 25
 
 #define AF_INET 2
 #define AF_INET6 10
 #define SA_DATA_LEN 14
 #define BASH_ERRNO_DEFAULT 128
 
+// Unified event header, shared by every kernel program.
+// Each event sent to userspace is a struct event_header_t followed by a
+// variable-length body of header.len bytes. Keep this in sync with
+// user/event_header.go.
+#define EVENT_HEADER_VERSION 1
+
+enum event_type {
+    EVENT_TYPE_TLS_READ = 1,
+    EVENT_TYPE_TLS_WRITE,
+    EVENT_TYPE_CONNECT,
+    EVENT_TYPE_BASH,
+    EVENT_TYPE_MYSQLD,
+    EVENT_TYPE_POSTGRES,
+    EVENT_TYPE_PROCESS_EXEC,
+    EVENT_TYPE_PROCESS_FORK,
+    EVENT_TYPE_PROCESS_EXIT,
+    EVENT_TYPE_BASH_RETVAL,
+};
+
+struct event_header_t {
+    u8 type;       // enum event_type
+    u8 version;    // EVENT_HEADER_VERSION
+    u16 len;       // body length, in bytes
+    u32 conn_key;  // socket fd for connection bound events, 0 otherwise
+    u64 timestamp_ns;
+    u32 pid;
+    u32 tid;
+    u64 cgroup_id;
+} __attribute__((packed));
+
+#define EVENT_HEADER_SIZE sizeof(struct event_header_t)
+
 // Optional Target PID
 // .rodata section bug via : https://github.com/ehids/ecapture/issues/39
 #ifndef KERNEL_LESS_5_2
 const volatile u64 target_pid = 0;
+// if target_tree is set, the descendants of target_pid are targeted too.
+const volatile u32 target_tree = 0;
 const volatile int target_errno = BASH_ERRNO_DEFAULT;
 #else
 // u64 target_pid = 0;
 #endif
 
+static __inline void fill_event_header(struct event_header_t *header,
+                                      u8 type, u64 current_pid_tgid) {
+    header->type = type;
+    header->version = EVENT_HEADER_VERSION;
+    header->len = 0;
+    header->conn_key = 0;
+    header->timestamp_ns = bpf_ktime_get_ns();
+    header->pid = current_pid_tgid >> 32;
+    header->tid = current_pid_tgid & 0xffffffff;
+    header->cgroup_id = bpf_get_current_cgroup_id();
+}
+
 char __license[] SEC("license") = "Dual MIT/GPL";
 __u32 _version SEC("version") = 0xFFFFFFFE;
 
@@ -1,28 +1,346 @@
 #include "ecapture.h"
+#include "process.h"
 
 #define DISPATCH_COMMAND_V57_FAILED -2
 
+// header.len carries the length of the body, query is the last field and only
+// the captured bytes of it are valid.
+// For COM_STMT_EXECUTE, alllen is the parameter count and query holds an
+// array of struct stmt_param_t instead of the SQL.
 struct data_t {
-    u64 pid;
-    u64 timestamp;
+    struct event_header_t header;
+    u64 alllen;   // origin query sql length
+    u32 stmt_id;  // COM_STMT_EXECUTE and COM_STMT_CLOSE only
+    u8 command;   // enum_server_command
+    s8 retval;    // dispatch_command return value
     char query[MAX_DATA_SIZE_MYSQL];
-    u64 alllen;
-    u64 len;
-    char comm[TASK_COMM_LEN];
-    s8 retval;  // dispatch_command return value
 };
 
+// per-CPU map values are limited to PCPU_MIN_UNIT_SIZE, see sql_heap.
+_Static_assert(sizeof(struct data_t) <= 32768, "struct data_t too large");
+
+// At most MYSQL80_MAX_PARAMS parameters of an execute are captured, and
+// MYSQL80_PARAM_VALUE_SIZE bytes of each value.
+#define MYSQL80_MAX_PARAMS 8
+#define MYSQL80_PARAM_VALUE_SIZE 32
+
+struct stmt_param_t {
+    u8 null_bit;
+    u8 type;  // enum enum_field_types
+    u8 unsigned_type;
+    u8 reserved;
+    u32 length;  // origin value length
+    char value[MYSQL80_PARAM_VALUE_SIZE];
+};
+
+#define MYSQLD_BODY_FIXED_SIZE \
+    (__builtin_offsetof(struct data_t, query) - EVENT_HEADER_SIZE)
+
+// In-flight queries, keyed by pid_tgid. mysqld runs one thread per
+// connection, a pid key would mix up concurrent queries. LRU, so entries of
+// killed connections and missed returns do not leak. An LRU map is
+// preallocated and struct data_t is 32 KB, so it holds as many queries as
+// mysqld runs at once rather than its connections: 512 of them, 16 MB.
 struct {
-    __uint(type, BPF_MAP_TYPE_HASH);
-    __type(key, u32);
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __type(key, u64);
     __type(value, struct data_t);
-    __uint(max_entries, 1024);
+    __uint(max_entries, 512);
 } sql_hash SEC(".maps");
 
+// In-flight queries of --latency, which only need their start and type.
+struct query_start_t {
+    u64 timestamp_ns;
+    u32 stmt_type;  // enum stmt_type
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __type(key, u64);
+    __type(value, struct query_start_t);
+    __uint(max_entries, 10240);
+} query_starts SEC(".maps");
+
+// struct data_t is too large for the 512-byte stack.
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __type(key, u32);
+    __type(value, struct data_t);
+    __uint(max_entries, 1);
+} sql_heap SEC(".maps");
+
 struct {
     __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
 } events SEC(".maps");
 
+// Query latency histograms, in log2 slots of microseconds, per statement type.
+// index: stmt_type * MYSQLD_LATENCY_SLOTS + slot. Keep in sync with
+// user/mysqld_latency.go.
+enum stmt_type {
+    STMT_SELECT = 0,
+    STMT_INSERT,
+    STMT_UPDATE,
+    STMT_DELETE,
+    STMT_DDL,
+    STMT_OTHER,
+    STMT_TYPE_MAX,
+};
+
+#define MYSQLD_LATENCY_SLOTS 32
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __type(key, u32);
+    __type(value, u64);
+    __uint(max_entries, STMT_TYPE_MAX * MYSQLD_LATENCY_SLOTS);
+} latency_hist SEC(".maps");
+
+#ifndef KERNEL_LESS_5_2
+// if latency_only is set, queries are only accounted in latency_hist, and
+// not sent to user space.
+const volatile u32 latency_only = 0;
+
+// at most query_max_len bytes of a query are captured.
+const volatile u32 query_max_len = MAX_DATA_SIZE_MYSQL;
+
+// sizeof(PS_PARAM), 8.0.23 added name and name_length to it.
+const volatile u64 ps_param_size = 48;
+
+// Offset of the connection id in THD (THD::m_thread_id, THD::thread_id for
+// MariaDB). It depends on the mysqld build, 0 means unknown.
+const volatile u64 thd_thread_id_offset = 0;
+
+// Offset of THD::statement_id_counter, the id of the last statement prepared
+// by the connection. 0 means unknown, prepares are then sent without id.
+const volatile u64 thd_stmt_id_offset = 0;
+#endif
+
+// THD of in-flight prepares, the return probe reads the id mysqld gave to
+// the statement from it.
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __type(key, u64);
+    __type(value, u64);
+    __uint(max_entries, 1024);
+} prepare_thds SEC(".maps");
+
+// read_thd_thread_id returns the connection id of thd, 0 if unknown.
+// my_thread_id is u32 on MySQL and u64 on MariaDB, the low 32 bits are enough.
+static __inline u32 read_thd_thread_id(void *thd) {
+    u32 thread_id = 0;
+#ifndef KERNEL_LESS_5_2
+    if (thd_thread_id_offset == 0 || thd == NULL) {
+        return 0;
+    }
+    bpf_probe_read_user(&thread_id, sizeof(thread_id),
+                        thd + thd_thread_id_offset);
+#endif
+    return thread_id;
+}
+
+// read_thd_stmt_id returns the id of the last statement prepared on thd, 0 if
+// unknown. ulong on MySQL, the low 32 bits are the id of the protocol.
+static __inline u32 read_thd_stmt_id(void *thd) {
+    u32 stmt_id = 0;
+#ifndef KERNEL_LESS_5_2
+    if (thd_stmt_id_offset == 0 || thd == NULL) {
+        return 0;
+    }
+    bpf_probe_read_user(&stmt_id, sizeof(stmt_id), thd + thd_stmt_id_offset);
+#endif
+    return stmt_id;
+}
+
+// log2 without loops, for kernels without bounded loop support.
+static __inline u32 log2_u32(u32 v) {
+    u32 r, shift;
+    r = (v > 0xFFFF) << 4;
+    v >>= r;
+    shift = (v > 0xFF) << 3;
+    v >>= shift;
+    r |= shift;
+    shift = (v > 0xF) << 2;
+    v >>= shift;
+    r |= shift;
+    shift = (v > 0x3) << 1;
+    v >>= shift;
+    r |= shift;
+    r |= (v >> 1);
+    return r;
+}
+
+static __inline u32 log2_u64(u64 v) {
+    u32 hi = v >> 32;
+    if (hi) {
+        return log2_u32(hi) + 32;
+    }
+    return log2_u32(v);
+}
+
+// classify_query maps the first keyword of query to a stmt_type. Only the
+// first letters are compared, a few leading blanks or '(' are skipped.
+static __inline u32 classify_query(const char *query) {
+    u32 off = 0;
+#pragma unroll
+    for (int i = 0; i < 4; i++) {
+        char c = query[off & 7];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '(') {
+            off++;
+        }
+    }
+    off &= 7;
+    // | 0x20 turns ASCII letters into lower case.
+    char c0 = query[off] | 0x20;
+    char c1 = query[off + 1] | 0x20;
+    char c2 = query[off + 2] | 0x20;
+
+    if (c0 == 's' && c1 == 'e' && c2 == 'l') {
+        return STMT_SELECT;
+    }
+    if (c0 == 'i' && c1 == 'n' && c2 == 's') {
+        return STMT_INSERT;
+    }
+    if (c0 == 'u' && c1 == 'p' && c2 == 'd') {
+        return STMT_UPDATE;
+    }
+    if (c0 == 'd' && c1 == 'e' && c2 == 'l') {
+        return STMT_DELETE;
+    }
+    if ((c0 == 'c' && c1 == 'r' && c2 == 'e') ||
+        (c0 == 'a' && c1 == 'l' && c2 == 't') ||
+        (c0 == 'd' && c1 == 'r' && c2 == 'o') ||
+        (c0 == 't' && c1 == 'r' && c2 == 'u') ||
+        (c0 == 'r' && c1 == 'e' && c2 == 'n')) {
+        return STMT_DDL;
+    }
+    return STMT_OTHER;
+}
+
+// account_latency adds the duration of a query started at timestamp_ns to
+// latency_hist.
+static __inline void account_latency(u64 timestamp_ns, u32 stmt_type) {
+    u64 delta_us = (bpf_ktime_get_ns() - timestamp_ns) / 1000;
+    u32 slot = log2_u64(delta_us);
+    if (slot >= MYSQLD_LATENCY_SLOTS) {
+        slot = MYSQLD_LATENCY_SLOTS - 1;
+    }
+    u32 index = stmt_type * MYSQLD_LATENCY_SLOTS + slot;
+    u64 *count = bpf_map_lookup_elem(&latency_hist, &index);
+    if (count) {
+        __sync_fetch_and_add(count, 1);
+    }
+}
+
+// is_latency_only returns 1 if queries are only accounted, see latency_only.
+static __inline int is_latency_only(void) {
+#ifndef KERNEL_LESS_5_2
+    return latency_only;
+#else
+    return 0;
+#endif
+}
+
+// start_latency saves the start and the type of a query in query_starts.
+// Prepared statements are accounted by neither their prepare nor their
+// execute, the SQL is not at hand.
+static __inline void start_latency(u64 current_pid_tgid, u8 command,
+                                   const char *query) {
+    if (command != COM_QUERY) {
+        return;
+    }
+    char head[16] = {};
+    bpf_probe_read_user(&head, sizeof(head), query);
+    struct query_start_t start = {
+        .timestamp_ns = bpf_ktime_get_ns(),
+        .stmt_type = classify_query(head),
+    };
+    bpf_map_update_elem(&query_starts, &current_pid_tgid, &start, BPF_ANY);
+}
+
+// start_query saves the len bytes query of the current thread in sql_hash,
+// until the return probe sends it. With latency_only, only its start is
+// saved.
+static __inline void start_query(u64 current_pid_tgid, void *thd, u8 command,
+                                 const char *query, u64 len) {
+    if (is_latency_only()) {
+        start_latency(current_pid_tgid, command, query);
+        return;
+    }
+    u32 kZero = 0;
+    struct data_t *data = bpf_map_lookup_elem(&sql_heap, &kZero);
+    if (data == NULL) {
+        return;
+    }
+    fill_event_header(&data->header, EVENT_TYPE_MYSQLD, current_pid_tgid);
+    data->header.conn_key = read_thd_thread_id(thd);
+    data->alllen = len;  // origin query sql length
+    data->stmt_id = 0;
+    data->command = command;
+    data->retval = -1;
+
+#ifndef KERNEL_LESS_5_2
+    if (len > query_max_len) {
+        len = query_max_len;
+    }
+#endif
+    // not a power of two, so bounded for the verifier by a compare.
+    if (len > MAX_DATA_SIZE_MYSQL) {
+        len = MAX_DATA_SIZE_MYSQL;
+    }
+    data->header.len = MYSQLD_BODY_FIXED_SIZE + len;
+
+    // the heap is reused, clear what classify_query may read past a short
+    // query.
+    __builtin_memset(&data->query, 0, 16);
+    bpf_probe_read_user(&data->query, len, query);
+    bpf_map_update_elem(&sql_hash, &current_pid_tgid, data, BPF_ANY);
+}
+
+// finish_query accounts the query of the current thread and sends it to
+// user space with its return value, only the captured bytes of the query are
+// sent.
+static __inline void finish_query(struct pt_regs *ctx, u64 current_pid_tgid,
+                                  s8 retval) {
+    if (is_latency_only()) {
+        struct query_start_t *start =
+            bpf_map_lookup_elem(&query_starts, &current_pid_tgid);
+        if (start == NULL) {
+            return;  // missed start
+        }
+        account_latency(start->timestamp_ns, start->stmt_type);
+        bpf_map_delete_elem(&query_starts, &current_pid_tgid);
+        return;
+    }
+
+    struct data_t *data = bpf_map_lookup_elem(&sql_hash, &current_pid_tgid);
+    if (data == NULL) {
+        return;  // missed start
+    }
+    debug_bpf_printk("mysql query:%s\n", data->query);
+    debug_bpf_printk("mysql query return :%d\n", retval);
+    data->retval = retval;
+    if (data->command == COM_STMT_PREPARE) {
+        // Prepared_statement takes ++THD::statement_id_counter, even if the
+        // prepare fails.
+        u64 *thd = bpf_map_lookup_elem(&prepare_thds, &current_pid_tgid);
+        if (thd) {
+            data->stmt_id = read_thd_stmt_id((void *)*thd);
+            bpf_map_delete_elem(&prepare_thds, &current_pid_tgid);
+        }
+    }
+    if (data->command == COM_QUERY) {
+        account_latency(data->header.timestamp_ns,
+                        classify_query(data->query));
+    }
+    u64 len = data->header.len - MYSQLD_BODY_FIXED_SIZE;
+    if (len > MAX_DATA_SIZE_MYSQL) {
+        len = MAX_DATA_SIZE_MYSQL;
+    }
+    bpf_perf_event_output(ctx, &events, BPF_F_CURRENT_CPU, data,
+                          __builtin_offsetof(struct data_t, query) + len);
+    bpf_map_delete_elem(&sql_hash, &current_pid_tgid);
+}
+
 SEC("uprobe/dispatch_command")
 int mysql56_query(struct pt_regs *ctx) {
     /*
@@ -47,33 +365,14 @@ int mysql56_query(struct pt_regs *ctx) {
     u64 current_pid_tgid = bpf_get_current_pid_tgid();
     u32 pid = current_pid_tgid >> 32;
 
-#ifndef KERNEL_LESS_5_2
-    // if target_ppid is 0 then we target all pids
-    if (target_pid != 0 && target_pid != pid) {
-        return 0;
-    }
-#endif
-
-    u64 len = (u64)PT_REGS_PARM4(ctx);
-    if (len < 0) {
+    if (!is_target(pid)) {
         return 0;
     }
 
-    struct data_t data = {};
-    data.pid = pid;     // only process id
-    data.alllen = len;  // origin query sql length
-    data.timestamp = bpf_ktime_get_ns();
-    data.retval = -1;
-    len = (len < MAX_DATA_SIZE_MYSQL ? (len & (MAX_DATA_SIZE_MYSQL - 1))
-                                     : MAX_DATA_SIZE_MYSQL);
-    data.len = len;  // only process id
-    bpf_get_current_comm(&data.comm, sizeof(data.comm));
-
-    bpf_probe_read_user(&data.query, len, (void *)PT_REGS_PARM3(ctx));
-
-    bpf_map_update_elem(&sql_hash, &pid, &data, BPF_ANY);
-    //    bpf_perf_event_output(ctx, &events, BPF_F_CURRENT_CPU,
-    //    &data,sizeof(data));
+    // packet_length is a uint.
+    u64 len = (u32)PT_REGS_PARM4(ctx);
+    start_query(current_pid_tgid, (void *)PT_REGS_PARM2(ctx), COM_QUERY,
+                (const char *)PT_REGS_PARM3(ctx), len);
     return 0;
 }
 
@@ -95,23 +394,12 @@ int mysql56_query_return(struct pt_regs *ctx) {
     u64 current_pid_tgid = bpf_get_current_pid_tgid();
     u32 pid = current_pid_tgid >> 32;
 
-#ifndef KERNEL_LESS_5_2
-    // if target_ppid is 0 then we target all pids
-    if (target_pid != 0 && target_pid != pid) {
+    if (!is_target(pid)) {
         return 0;
     }
-#endif
 
     s8 command_return = (u64)PT_REGS_RC(ctx);
-    struct data_t *data = bpf_map_lookup_elem(&sql_hash, &pid);
-    if (!data) {
-        return 0;  // missed start
-    }
-    debug_bpf_printk("mysql query:%s\n", data->query);
-    data->retval = command_return;
-    debug_bpf_printk("mysql query return :%d\n", command_return);
-    bpf_perf_event_output(ctx, &events, BPF_F_CURRENT_CPU, data,
-                          sizeof(struct data_t));
+    finish_query(ctx, current_pid_tgid, command_return);
     return 0;
 }
 
@@ -168,32 +456,15 @@ int mysql57_query(struct pt_regs *ctx) {
     u64 current_pid_tgid = bpf_get_current_pid_tgid();
     u32 pid = current_pid_tgid >> 32;
 
-#ifndef KERNEL_LESS_5_2
-    // if target_ppid is 0 then we target all pids
-    if (target_pid != 0 && target_pid != pid) {
+    if (!is_target(pid)) {
         return 0;
     }
-#endif
-
-    u64 len = 0;
-    struct data_t data = {};
-    data.pid = pid;  // only process id
-    data.timestamp = bpf_ktime_get_ns();
 
     void *st = (void *)PT_REGS_PARM2(ctx);
     struct COM_QUERY_DATA query;
     bpf_probe_read_user(&query, sizeof(query), st);
-    bpf_probe_read_user(&data.query, sizeof(data.query), query.query);
-    bpf_probe_read_user(&data.alllen, sizeof(data.alllen), &query.length);
-    len = data.alllen;
-    len = (len < MAX_DATA_SIZE_MYSQL ? (len & (MAX_DATA_SIZE_MYSQL - 1))
-                                     : MAX_DATA_SIZE_MYSQL);
-    data.len = len;
-    bpf_get_current_comm(&data.comm, sizeof(data.comm));
-
-    bpf_map_update_elem(&sql_hash, &pid, &data, BPF_ANY);
-    //    bpf_perf_event_output(ctx, &events, BPF_F_CURRENT_CPU,
-    //    &data,sizeof(data));
+    start_query(current_pid_tgid, (void *)PT_REGS_PARM1(ctx), COM_QUERY,
+                query.query, query.length);
     return 0;
 }
 
@@ -207,27 +478,159 @@ int mysql57_query_return(struct pt_regs *ctx) {
     u64 current_pid_tgid = bpf_get_current_pid_tgid();
     u32 pid = current_pid_tgid >> 32;
 
-#ifndef KERNEL_LESS_5_2
-    // if target_ppid is 0 then we target all pids
-    if (target_pid != 0 && target_pid != pid) {
+    if (!is_target(pid)) {
         return 0;
     }
-#endif
 
     u8 command_return = (u64)PT_REGS_RC(ctx);
-    struct data_t *data = bpf_map_lookup_elem(&sql_hash, &pid);
-    if (!data) {
-        return 0;  // missed start
-    }
-    debug_bpf_printk("mysql57+ query:%s\n", data->query);
-    debug_bpf_printk("mysql57+ query return :%d\n", command_return);
     if (command_return == 1) {
-        data->retval = DISPATCH_COMMAND_V57_FAILED;
+        finish_query(ctx, current_pid_tgid, DISPATCH_COMMAND_V57_FAILED);
     } else {
-        data->retval = command_return;
+        finish_query(ctx, current_pid_tgid, command_return);
     }
-    bpf_perf_event_output(ctx, &events, BPF_F_CURRENT_CPU, data,
-                          sizeof(struct data_t));
 
     return 0;
-}
\ No newline at end of file
+}
+
+// mysql 8.0
+// https://github.com/mysql/mysql-server/blob/8.0/include/mysql/com_data.h
+// COM_QUERY_DATA and COM_STMT_PREPARE_DATA both start with query and length.
+struct COM_STMT_EXECUTE_DATA {
+    unsigned long stmt_id;
+    unsigned long open_cursor;
+    void *parameters;  // PS_PARAM *, see ps_param_size
+    unsigned long parameter_count;
+    unsigned char has_new_types;
+};
+
+struct COM_STMT_CLOSE_DATA {
+    unsigned int stmt_id;
+};
+
+// the fields of PS_PARAM common to every 8.0 release.
+struct PS_PARAM {
+    unsigned char null_bit;
+    int type;  // enum enum_field_types
+    unsigned char unsigned_type;
+    const unsigned char *value;
+    unsigned long length;
+};
+
+// start_stmt_execute saves the statement id and the parameters of an execute,
+// the SQL was sent by its prepare.
+static __inline void start_stmt_execute(u64 current_pid_tgid, void *thd,
+                                        void *com_data) {
+    u32 kZero = 0;
+    struct data_t *data = bpf_map_lookup_elem(&sql_heap, &kZero);
+    if (data == NULL) {
+        return;
+    }
+    struct COM_STMT_EXECUTE_DATA execute = {};
+    bpf_probe_read_user(&execute, sizeof(execute), com_data);
+
+    fill_event_header(&data->header, EVENT_TYPE_MYSQLD, current_pid_tgid);
+    data->header.conn_key = read_thd_thread_id(thd);
+    data->alllen = execute.parameter_count;
+    data->stmt_id = execute.stmt_id;
+    data->command = COM_STMT_EXECUTE;
+    data->retval = -1;
+
+    u64 param_size = 48;
+#ifndef KERNEL_LESS_5_2
+    param_size = ps_param_size;
+#endif
+    struct stmt_param_t *params = (struct stmt_param_t *)data->query;
+    u32 count = 0;
+#pragma unroll
+    for (int i = 0; i < MYSQL80_MAX_PARAMS; i++) {
+        if (i >= execute.parameter_count) {
+            break;
+        }
+        struct PS_PARAM param = {};
+        bpf_probe_read_user(&param, sizeof(param),
+                            execute.parameters + i * param_size);
+        params[i].null_bit = param.null_bit;
+        params[i].type = param.type;
+        params[i].unsigned_type = param.unsigned_type;
+        params[i].length = param.length;
+        u64 len = param.length;
+        len = (len < MYSQL80_PARAM_VALUE_SIZE
+                   ? (len & (MYSQL80_PARAM_VALUE_SIZE - 1))
+                   : MYSQL80_PARAM_VALUE_SIZE);
+        bpf_probe_read_user(&params[i].value, len, param.value);
+        count++;
+    }
+    data->header.len =
+        MYSQLD_BODY_FIXED_SIZE + count * sizeof(struct stmt_param_t);
+    bpf_map_update_elem(&sql_hash, &current_pid_tgid, data, BPF_ANY);
+}
+
+// start_stmt_close saves the statement id of a close, user space drops the
+// statement from its cache.
+static __inline void start_stmt_close(u64 current_pid_tgid, void *thd,
+                                      void *com_data) {
+    u32 kZero = 0;
+    struct data_t *data = bpf_map_lookup_elem(&sql_heap, &kZero);
+    if (data == NULL) {
+        return;
+    }
+    struct COM_STMT_CLOSE_DATA close = {};
+    bpf_probe_read_user(&close, sizeof(close), com_data);
+
+    fill_event_header(&data->header, EVENT_TYPE_MYSQLD, current_pid_tgid);
+    data->header.conn_key = read_thd_thread_id(thd);
+    data->header.len = MYSQLD_BODY_FIXED_SIZE;
+    data->alllen = 0;
+    data->stmt_id = close.stmt_id;
+    data->command = COM_STMT_CLOSE;
+    data->retval = -1;
+    bpf_map_update_elem(&sql_hash, &current_pid_tgid, data, BPF_ANY);
+}
+
+// bool dispatch_command(THD *thd, const COM_DATA *com_data,
+//                       enum enum_server_command command);
+// same signature as 5.7, prepared statements are captured too. The return
+// probe is mysql57_query_return.
+SEC("uprobe/dispatch_command_80")
+int mysql80_query(struct pt_regs *ctx) {
+    u64 command = (u64)PT_REGS_PARM3(ctx);
+    if (command != COM_QUERY && command != COM_STMT_PREPARE &&
+        command != COM_STMT_EXECUTE && command != COM_STMT_CLOSE) {
+        return 0;
+    }
+
+    u64 current_pid_tgid = bpf_get_current_pid_tgid();
+    u32 pid = current_pid_tgid >> 32;
+
+    if (!is_target(pid)) {
+        return 0;
+    }
+
+    void *thd = (void *)PT_REGS_PARM1(ctx);
+    void *st = (void *)PT_REGS_PARM2(ctx);
+    // executes and closes are not accounted, nothing to send either.
+    if (is_latency_only() && command != COM_QUERY) {
+        return 0;
+    }
+    switch (command) {
+        case COM_STMT_EXECUTE:
+            start_stmt_execute(current_pid_tgid, thd, st);
+            break;
+        case COM_STMT_CLOSE:
+            start_stmt_close(current_pid_tgid, thd, st);
+            break;
+        case COM_STMT_PREPARE: {
+            u64 thd_ptr = (u64)thd;
+            bpf_map_update_elem(&prepare_thds, &current_pid_tgid, &thd_ptr,
+                                BPF_ANY);
+        }
+        // fall through
+        default: {
+            struct COM_QUERY_DATA query;
+            bpf_probe_read_user(&query, sizeof(query), st);
+            start_query(current_pid_tgid, thd, command, query.query,
+                        query.length);
+        }
+    }
+    return 0;
+}
@@ -1,17 +1,124 @@
 #include "ecapture.h"
+#include "process.h"
 
+// enum pg_command, keep in sync with user/event_postgres.go.
+#define PG_SIMPLE_QUERY 0
+#define PG_PARSE 1
+#define PG_BIND 2
+#define PG_EXECUTE 3
+
+// NAMEDATALEN, the size of statement and portal names.
+#define PG_NAME_LEN 64
+
+// header.len carries the length of the body. query is only filled by simple
+// queries and parse messages, and only its captured bytes, NUL included, are
+// sent.
 struct data_t {
-    u64 pid;
-    u64 timestamp;
+    struct event_header_t header;
+    u64 duration_ns;  // simple queries and executes
+    u8 command;       // enum pg_command
+    char stmt_name[PG_NAME_LEN];
+    char portal_name[PG_NAME_LEN];
     char query[MAX_DATA_SIZE_POSTGRES];
-    char comm[TASK_COMM_LEN];
 };
 
+#define POSTGRES_BODY_FIXED_SIZE \
+    (__builtin_offsetof(struct data_t, query) - EVENT_HEADER_SIZE)
+
 struct
 {
     __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
 } events SEC(".maps");
 
+// Running queries and executes, keyed by pid_tgid. Each backend is a process,
+// so it holds at most one entry. LRU, so entries of killed backends do not
+// leak.
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __type(key, u64);
+    __type(value, struct data_t);
+    __uint(max_entries, 2048);
+} query_hash SEC(".maps");
+
+// struct data_t is too large for the 512-byte stack.
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __type(key, u32);
+    __type(value, struct data_t);
+    __uint(max_entries, 1);
+} pg_heap SEC(".maps");
+
+#ifndef KERNEL_LESS_5_2
+// only queries running for slow_threshold_ns or longer are sent, 0 sends
+// every query.
+const volatile u64 slow_threshold_ns = 0;
+
+// at most query_max_len bytes of a query are captured, NUL included.
+const volatile u32 query_max_len = MAX_DATA_SIZE_POSTGRES;
+#endif
+
+static __inline struct data_t *create_pg_event(u64 current_pid_tgid,
+                                               u8 command) {
+    u32 kZero = 0;
+    struct data_t *data = bpf_map_lookup_elem(&pg_heap, &kZero);
+    if (data == NULL) {
+        return NULL;
+    }
+    fill_event_header(&data->header, EVENT_TYPE_POSTGRES, current_pid_tgid);
+    data->header.len = POSTGRES_BODY_FIXED_SIZE;
+    data->duration_ns = 0;
+    data->command = command;
+    data->stmt_name[0] = 0;
+    data->portal_name[0] = 0;
+    return data;
+}
+
+// read_query copies the NUL terminated query at src into data, at most
+// query_max_len bytes.
+static __inline void read_query(struct data_t *data, const char *src) {
+    u64 max_len = MAX_DATA_SIZE_POSTGRES;
+#ifndef KERNEL_LESS_5_2
+    max_len = query_max_len;
+#endif
+    max_len = (max_len < MAX_DATA_SIZE_POSTGRES
+                   ? (max_len & (MAX_DATA_SIZE_POSTGRES - 1))
+                   : MAX_DATA_SIZE_POSTGRES);
+    long len = bpf_probe_read_user_str(&data->query, max_len, src);
+    if (len < 0) {
+        len = 0;
+    }
+    data->header.len = POSTGRES_BODY_FIXED_SIZE + len;
+}
+
+// send_pg_event sends data, only the captured bytes of query.
+static __inline void send_pg_event(struct pt_regs *ctx, struct data_t *data) {
+    u64 len = data->header.len - POSTGRES_BODY_FIXED_SIZE;
+    len = (len < MAX_DATA_SIZE_POSTGRES ? (len & (MAX_DATA_SIZE_POSTGRES - 1))
+                                        : MAX_DATA_SIZE_POSTGRES);
+    bpf_perf_event_output(ctx, &events, BPF_F_CURRENT_CPU, data,
+                          __builtin_offsetof(struct data_t, query) + len);
+}
+
+// finish_query sends the query or execute started by the current backend, if
+// it ran for slow_threshold_ns at least.
+static __inline int finish_query(struct pt_regs *ctx, u64 current_pid_tgid) {
+    struct data_t *data = bpf_map_lookup_elem(&query_hash, &current_pid_tgid);
+    if (!data) {
+        return 0;  // missed start
+    }
+    // header.timestamp_ns was set by the entry probe.
+    data->duration_ns = bpf_ktime_get_ns() - data->header.timestamp_ns;
+#ifndef KERNEL_LESS_5_2
+    if (data->duration_ns < slow_threshold_ns) {
+        bpf_map_delete_elem(&query_hash, &current_pid_tgid);
+        return 0;
+    }
+#endif
+    send_pg_event(ctx, data);
+    bpf_map_delete_elem(&query_hash, &current_pid_tgid);
+    return 0;
+}
+
 // https://github.com/postgres/postgres/blob/7b7ed046cb2ad9f6efac90380757d5977f0f563f/src/backend/tcop/postgres.c#L987-L992
 // hook function exec_simple_query
 // versions 10 - now
@@ -22,20 +129,124 @@ int postgres_query(struct pt_regs *ctx) {
     u64 current_pid_tgid = bpf_get_current_pid_tgid();
     u32 pid = current_pid_tgid >> 32;
 
-#ifndef KERNEL_LESS_5_2
-    // if target_ppid is 0 then we target all pids
-    if (target_pid != 0 && target_pid != pid) {
+    if (!is_target(pid)) {
         return 0;
     }
-#endif
-
-    struct data_t data = {};
-    data.pid = pid;   // only process id
-    data.timestamp = bpf_ktime_get_ns();
 
+    struct data_t *data = create_pg_event(current_pid_tgid, PG_SIMPLE_QUERY);
+    if (data == NULL) {
+        return 0;
+    }
     char *sql_string= (char *)PT_REGS_PARM1(ctx);
-    bpf_get_current_comm(&data.comm, sizeof(data.comm));
-    bpf_probe_read(&data.query, sizeof(data.query), sql_string);
-    bpf_perf_event_output(ctx, &events, BPF_F_CURRENT_CPU, &data, sizeof(data));
+    read_query(data, sql_string);
+    bpf_map_update_elem(&query_hash, &current_pid_tgid, data, BPF_ANY);
     return 0;
 }
+
+SEC("uretprobe/exec_simple_query")
+int postgres_query_return(struct pt_regs *ctx) {
+    u64 current_pid_tgid = bpf_get_current_pid_tgid();
+    u32 pid = current_pid_tgid >> 32;
+
+    if (!is_target(pid)) {
+        return 0;
+    }
+
+    return finish_query(ctx, current_pid_tgid);
+}
+
+// Extended query protocol. The statement text is only sent by parse, bind
+// tells which statement a portal runs, and execute only sends the portal and
+// its duration. User space keeps the statements and portals of each backend.
+
+// static void exec_parse_message(const char *query_string,
+//                                const char *stmt_name, Oid *paramTypes,
+//                                int numParams)
+SEC("uprobe/exec_parse_message")
+int postgres_parse(struct pt_regs *ctx) {
+    u64 current_pid_tgid = bpf_get_current_pid_tgid();
+    u32 pid = current_pid_tgid >> 32;
+
+    if (!is_target(pid)) {
+        return 0;
+    }
+
+    struct data_t *data = create_pg_event(current_pid_tgid, PG_PARSE);
+    if (data == NULL) {
+        return 0;
+    }
+    bpf_probe_read_user_str(&data->stmt_name, sizeof(data->stmt_name),
+                            (void *)PT_REGS_PARM2(ctx));
+    read_query(data, (const char *)PT_REGS_PARM1(ctx));
+    send_pg_event(ctx, data);
+    return 0;
+}
+
+// https://github.com/postgres/postgres/blob/master/src/include/lib/stringinfo.h
+struct StringInfoData {
+    char *data;
+    int len;
+    int maxlen;
+    int cursor;
+};
+
+// static void exec_bind_message(StringInfo input_message)
+// the message starts with the portal name and the statement name.
+SEC("uprobe/exec_bind_message")
+int postgres_bind(struct pt_regs *ctx) {
+    u64 current_pid_tgid = bpf_get_current_pid_tgid();
+    u32 pid = current_pid_tgid >> 32;
+
+    if (!is_target(pid)) {
+        return 0;
+    }
+
+    struct data_t *data = create_pg_event(current_pid_tgid, PG_BIND);
+    if (data == NULL) {
+        return 0;
+    }
+    struct StringInfoData msg = {};
+    bpf_probe_read_user(&msg, sizeof(msg), (void *)PT_REGS_PARM1(ctx));
+    char *portal = msg.data + msg.cursor;
+    long len = bpf_probe_read_user_str(&data->portal_name,
+                                       sizeof(data->portal_name), portal);
+    if (len <= 0) {
+        return 0;
+    }
+    bpf_probe_read_user_str(&data->stmt_name, sizeof(data->stmt_name),
+                            portal + len);
+    bpf_perf_event_output(ctx, &events, BPF_F_CURRENT_CPU, data,
+                          EVENT_HEADER_SIZE + POSTGRES_BODY_FIXED_SIZE);
+    return 0;
+}
+
+// static void exec_execute_message(const char *portal_name, long max_rows)
+SEC("uprobe/exec_execute_message")
+int postgres_execute(struct pt_regs *ctx) {
+    u64 current_pid_tgid = bpf_get_current_pid_tgid();
+    u32 pid = current_pid_tgid >> 32;
+
+    if (!is_target(pid)) {
+        return 0;
+    }
+
+    struct data_t *data = create_pg_event(current_pid_tgid, PG_EXECUTE);
+    if (data == NULL) {
+        return 0;
+    }
+    bpf_probe_read_user_str(&data->portal_name, sizeof(data->portal_name),
+                            (void *)PT_REGS_PARM1(ctx));
+    bpf_map_update_elem(&query_hash, &current_pid_tgid, data, BPF_ANY);
+    return 0;
+}
+
+SEC("uretprobe/exec_execute_message")
+int postgres_execute_return(struct pt_regs *ctx) {
+    u64 current_pid_tgid = bpf_get_current_pid_tgid();
+    u32 pid = current_pid_tgid >> 32;
+
+    if (!is_target(pid)) {
+        return 0;
+    }
+    return finish_query(ctx, current_pid_tgid);
+}
@@ -0,0 +1,236 @@
+#ifndef ECAPTURE_PROCESS_H
+#define ECAPTURE_PROCESS_H
+
+// Process metadata side channel.
+// exec/fork/exit are published once per process on proc_events, so data
+// events only need to carry pid/tid. User space keeps a cache of it, see
+// user/process.go.
+
+#ifndef NOCORE
+#include "bpf/bpf_core_read.h"
+#else
+#include <linux/sched.h>
+#include <linux/sched/signal.h>
+#endif
+
+// header.len carries the length of the body. exe and cmdline are only filled
+// by exec events, fork and exit events only send comm and ppid.
+struct process_event_t {
+    struct event_header_t header;
+    char comm[TASK_COMM_LEN];
+    u32 ppid;
+    char exe[MAX_PATH_SIZE];
+    char cmdline[MAX_CMDLINE_SIZE];
+};
+
+#define PROCESS_BODY_FIXED_SIZE (TASK_COMM_LEN + sizeof(u32))
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+} proc_events SEC(".maps");
+
+// tgids of the targeted process tree. user space seeds it with target_pid and
+// its running descendants, then the fork/exit tracepoints below keep it up to
+// date. Only used when target_tree is set.
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __type(key, u32);
+    __type(value, u8);
+    __uint(max_entries, 65536);
+} target_tgids SEC(".maps");
+
+// struct process_event_t is too large for the 512-byte stack.
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __type(key, u32);
+    __type(value, struct process_event_t);
+    __uint(max_entries, 1);
+} proc_event_heap SEC(".maps");
+
+// Tracepoint arguments, via
+// /sys/kernel/debug/tracing/events/sched/sched_process_*/format
+// Declared here so that CO-RE and NOCORE builds share the same layout.
+struct sched_process_exec_args {
+    u64 __unused__;
+    u32 filename_loc;  // __data_loc char[] filename
+    int pid;
+    int old_pid;
+};
+
+struct sched_process_exit_args {
+    u64 __unused__;
+    char comm[TASK_COMM_LEN];
+    int pid;
+    int prio;
+};
+
+// is_target returns 1 if events of pid should be captured.
+static __inline int is_target(u32 pid) {
+#ifndef KERNEL_LESS_5_2
+    // if target_ppid is 0 then we target all pids
+    if (target_pid == 0 || target_pid == pid) {
+        return 1;
+    }
+    if (target_tree && bpf_map_lookup_elem(&target_tgids, &pid) != NULL) {
+        return 1;
+    }
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+static __inline struct process_event_t *create_process_event(
+    u8 type, u64 current_pid_tgid) {
+    u32 kZero = 0;
+    struct process_event_t *event =
+        bpf_map_lookup_elem(&proc_event_heap, &kZero);
+    if (event == NULL) {
+        return NULL;
+    }
+    fill_event_header(&event->header, type, current_pid_tgid);
+    event->header.len = PROCESS_BODY_FIXED_SIZE;
+    event->ppid = 0;
+    return event;
+}
+
+SEC("tracepoint/sched/sched_process_exec")
+int tracepoint_sched_process_exec(struct sched_process_exec_args *ctx) {
+    u64 current_pid_tgid = bpf_get_current_pid_tgid();
+    u32 pid = current_pid_tgid >> 32;
+
+    if (!is_target(pid)) {
+        return 0;
+    }
+
+    struct process_event_t *event =
+        create_process_event(EVENT_TYPE_PROCESS_EXEC, current_pid_tgid);
+    if (event == NULL) {
+        return 0;
+    }
+    bpf_get_current_comm(&event->comm, sizeof(event->comm));
+
+    // __data_loc: low 16 bits are the offset from ctx, high 16 bits the size.
+    u32 filename_off = ctx->filename_loc & 0xFFFF;
+    bpf_probe_read_str(&event->exe, sizeof(event->exe),
+                       (void *)ctx + filename_off);
+
+    __builtin_memset(&event->cmdline, 0, sizeof(event->cmdline));
+#ifndef NOCORE
+    struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+    event->ppid = BPF_CORE_READ(task, real_parent, tgid);
+    unsigned long arg_start = BPF_CORE_READ(task, mm, arg_start);
+    unsigned long arg_end = BPF_CORE_READ(task, mm, arg_end);
+    unsigned long arg_len = arg_end - arg_start;
+    // arguments are separated by NUL, user space splits them.
+    arg_len = (arg_len < MAX_CMDLINE_SIZE ? (arg_len & (MAX_CMDLINE_SIZE - 1))
+                                          : MAX_CMDLINE_SIZE);
+    bpf_probe_read_user(&event->cmdline, arg_len, (void *)arg_start);
+#endif
+
+    event->header.len = sizeof(struct process_event_t) - EVENT_HEADER_SIZE;
+    bpf_perf_event_output(ctx, &proc_events, BPF_F_CURRENT_CPU, event,
+                          sizeof(struct process_event_t));
+    return 0;
+}
+
+// raw tracepoint: the tracepoint format only has child_pid, the task is
+// needed to tell a new process from a new thread.
+// TP_PROTO(struct task_struct *parent, struct task_struct *child)
+SEC("raw_tracepoint/sched_process_fork")
+int raw_tracepoint_sched_process_fork(struct bpf_raw_tracepoint_args *ctx) {
+    u64 current_pid_tgid = bpf_get_current_pid_tgid();
+    u32 ppid = current_pid_tgid >> 32;
+    struct task_struct *child = (struct task_struct *)ctx->args[1];
+    pid_t child_pid = 0;
+    pid_t child_tgid = 0;
+#ifndef NOCORE
+    child_pid = BPF_CORE_READ(child, pid);
+    child_tgid = BPF_CORE_READ(child, tgid);
+#else
+    bpf_probe_read(&child_pid, sizeof(child_pid), &child->pid);
+    bpf_probe_read(&child_tgid, sizeof(child_tgid), &child->tgid);
+#endif
+
+    // pthread_create forks too, a thread is not a new process.
+    if (child_pid != child_tgid) {
+        return 0;
+    }
+
+    if (!is_target(ppid)) {
+        return 0;
+    }
+
+#ifndef KERNEL_LESS_5_2
+    // children of the tree are part of it, from their first instruction.
+    if (target_tree) {
+        u32 tgid = child_tgid;
+        u8 kOne = 1;
+        bpf_map_update_elem(&target_tgids, &tgid, &kOne, BPF_ANY);
+    }
+#endif
+
+    struct process_event_t *event =
+        create_process_event(EVENT_TYPE_PROCESS_FORK, current_pid_tgid);
+    if (event == NULL) {
+        return 0;
+    }
+    // the header describes the child, not the current (parent) task. The
+    // child runs a copy of its parent, comm included.
+    event->header.pid = child_tgid;
+    event->header.tid = child_pid;
+    event->ppid = ppid;
+    bpf_get_current_comm(&event->comm, sizeof(event->comm));
+    bpf_perf_event_output(ctx, &proc_events, BPF_F_CURRENT_CPU, event,
+                          EVENT_HEADER_SIZE + PROCESS_BODY_FIXED_SIZE);
+    return 0;
+}
+
+// group_dead returns 1 if the current task is the last one of its thread
+// group. do_exit decrements signal->live before the exit tracepoint.
+static __inline int group_dead(void) {
+    struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+    int live = 0;
+#ifndef NOCORE
+    live = BPF_CORE_READ(task, signal, live.counter);
+#else
+    struct signal_struct *signal = NULL;
+    bpf_probe_read(&signal, sizeof(signal), &task->signal);
+    bpf_probe_read(&live, sizeof(live), &signal->live.counter);
+#endif
+    return live == 0;
+}
+
+SEC("tracepoint/sched/sched_process_exit")
+int tracepoint_sched_process_exit(struct sched_process_exit_args *ctx) {
+    u64 current_pid_tgid = bpf_get_current_pid_tgid();
+    u32 pid = current_pid_tgid >> 32;
+
+    // the process ends with its last thread, which may not be the leader.
+    if (!group_dead()) {
+        return 0;
+    }
+
+    // checked before pid leaves the tree, its exit belongs to the tree.
+    int target = is_target(pid);
+#ifndef KERNEL_LESS_5_2
+    if (target_tree) {
+        bpf_map_delete_elem(&target_tgids, &pid);
+    }
+#endif
+    if (!target) {
+        return 0;
+    }
+
+    struct process_event_t *event =
+        create_process_event(EVENT_TYPE_PROCESS_EXIT, current_pid_tgid);
+    if (event == NULL) {
+        return 0;
+    }
+    bpf_get_current_comm(&event->comm, sizeof(event->comm));
+    bpf_perf_event_output(ctx, &proc_events, BPF_F_CURRENT_CPU, event,
+                          EVENT_HEADER_SIZE + PROCESS_BODY_FIXED_SIZE);
+    return 0;
+}
+
+#endif
@@ -1,30 +1,37 @@
 #include "ecapture.h"
+#include "process.h"
+
+// One object for every TLS library: they share the event arrays, the
+// in-flight args maps and the heap, so that a single reader serves them all.
+// User space only attaches the probes of the libraries it found.
 
-enum ssl_data_event_type { kSSLRead, kSSLWrite };
 const u32 invalidFD = 0;
 
+// library of a tls data event, user space prints it.
+enum tls_library_t {
+    TLS_LIBRARY_OPENSSL = 1,
+    TLS_LIBRARY_GNUTLS,
+    TLS_LIBRARY_NSPR
+};
+
+// header.conn_key carries the socket fd (openssl only), header.len the
+// length of the body: library and data.
 struct ssl_data_event_t {
-    enum ssl_data_event_type type;
-    u64 timestamp_ns;
-    u32 pid;
-    u32 tid;
+    struct event_header_t header;
+    u8 library;
     char data[MAX_DATA_SIZE_OPENSSL];
-    s32 data_len;
-    char comm[TASK_COMM_LEN];
-    u32 fd;
 };
 
+#define TLS_BODY_FIXED_SIZE (__builtin_offsetof(struct ssl_data_event_t, data) - EVENT_HEADER_SIZE)
+
 struct {
     __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
 } tls_events SEC(".maps");
 
+// header.conn_key carries the socket fd.
 struct connect_event_t {
-    u64 timestamp_ns;
-    u32 pid;
-    u32 tid;
-    u32 fd;
+    struct event_header_t header;
     char sa_data[SA_DATA_LEN];
-    char comm[TASK_COMM_LEN];
 };
 
 struct {
@@ -41,7 +48,8 @@ struct active_ssl_buf {
  ***********************************************************/
 
 // Key is thread ID (from bpf_get_current_pid_tgid).
-// Value is a pointer to the data buffer argument to SSL_write/SSL_read.
+// Value is a pointer to the data buffer argument of the read/write function,
+// and the socket fd if the library exposes it.
 struct {
     __uint(type, BPF_MAP_TYPE_HASH);
     __type(key, u64);
@@ -94,7 +102,7 @@ struct ssl_st {
  ***********************************************************/
 
 static __inline struct ssl_data_event_t* create_ssl_data_event(
-    u64 current_pid_tgid) {
+    u64 current_pid_tgid, u8 type, u8 library) {
     u32 kZero = 0;
     struct ssl_data_event_t* event =
         bpf_map_lookup_elem(&data_buffer_heap, &kZero);
@@ -102,11 +110,9 @@ static __inline struct ssl_data_event_t* create_ssl_data_event(
         return NULL;
     }
 
-    const u32 kMask32b = 0xffffffff;
-    event->timestamp_ns = bpf_ktime_get_ns();
-    event->pid = current_pid_tgid >> 32;
-    event->tid = current_pid_tgid & kMask32b;
-    event->fd = invalidFD;
+    fill_event_header(&event->header, type, current_pid_tgid);
+    event->header.conn_key = invalidFD;
+    event->library = library;
 
     return event;
 }
@@ -115,113 +121,113 @@ static __inline struct ssl_data_event_t* create_ssl_data_event(
  * BPF syscall processing functions
  ***********************************************************/
 
-static int process_SSL_data(struct pt_regs* ctx, u64 id,
-                            enum ssl_data_event_type type, const char* buf,
-                            u32 fd) {
+static int process_SSL_data(struct pt_regs* ctx, u64 id, u8 type, u8 library,
+                            const char* buf, u32 fd) {
     int len = (int)PT_REGS_RC(ctx);
     if (len < 0) {
         return 0;
     }
 
-    struct ssl_data_event_t* event = create_ssl_data_event(id);
+    struct ssl_data_event_t* event = create_ssl_data_event(id, type, library);
     if (event == NULL) {
         return 0;
     }
 
-    event->type = type;
-    event->fd = fd;
+    event->header.conn_key = fd;
     // This is a max function, but it is written in such a way to keep older BPF
     // verifiers happy.
-    event->data_len =
+    u32 data_len =
         (len < MAX_DATA_SIZE_OPENSSL ? (len & (MAX_DATA_SIZE_OPENSSL - 1))
                                      : MAX_DATA_SIZE_OPENSSL);
-    bpf_probe_read(event->data, event->data_len, buf);
-    bpf_get_current_comm(&event->comm, sizeof(event->comm));
+    event->header.len = TLS_BODY_FIXED_SIZE + data_len;
+    bpf_probe_read(event->data, data_len, buf);
+    // only send the header and the bytes actually read.
     bpf_perf_event_output(ctx, &tls_events, BPF_F_CURRENT_CPU, event,
-                          sizeof(struct ssl_data_event_t));
+                          __builtin_offsetof(struct ssl_data_event_t, data) +
+                              data_len);
     return 0;
 }
 
-/***********************************************************
- * BPF probe function entry-points
- ***********************************************************/
-
-// Function signature being probed:
-// int SSL_write(SSL *ssl, const void *buf, int num);
-SEC("uprobe/SSL_write")
-int probe_entry_SSL_write(struct pt_regs* ctx) {
+// save_ssl_args remembers the buffer of a read/write call until it returns.
+static __inline int save_ssl_args(void* args_map, const char* buf, u32 fd) {
     u64 current_pid_tgid = bpf_get_current_pid_tgid();
     u32 pid = current_pid_tgid >> 32;
 
-#ifndef KERNEL_LESS_5_2
-    // if target_ppid is 0 then we target all pids
-    if (target_pid != 0 && target_pid != pid) {
+    if (!is_target(pid)) {
         return 0;
     }
-#endif
-    debug_bpf_printk("openssl uprobe/SSL_write pid :%d\n", pid);
 
-    void* ssl = (void*)PT_REGS_PARM1(ctx);
-    // https://github.com/openssl/openssl/blob/OpenSSL_1_1_1-stable/crypto/bio/bio_local.h
-    struct ssl_st ssl_info;
-    bpf_probe_read_user(&ssl_info, sizeof(ssl_info), ssl);
-
-    struct BIO bio_w;
-    bpf_probe_read_user(&bio_w, sizeof(bio_w), ssl_info.wbio);
-
-    // get fd ssl->wbio->num
-    u32 fd = bio_w.num;
-    debug_bpf_printk("openssl uprobe SSL_write FD:%d\n", fd);
-
-    const char* buf = (const char*)PT_REGS_PARM2(ctx);
     struct active_ssl_buf active_ssl_buf_t;
     __builtin_memset(&active_ssl_buf_t, 0, sizeof(active_ssl_buf_t));
     active_ssl_buf_t.fd = fd;
     active_ssl_buf_t.buf = buf;
-    bpf_map_update_elem(&active_ssl_write_args_map, &current_pid_tgid,
-                        &active_ssl_buf_t, BPF_ANY);
-
+    bpf_map_update_elem(args_map, &current_pid_tgid, &active_ssl_buf_t,
+                        BPF_ANY);
     return 0;
 }
 
-SEC("uretprobe/SSL_write")
-int probe_ret_SSL_write(struct pt_regs* ctx) {
+// send_ssl_data sends the buffer saved by save_ssl_args, when the call
+// returns.
+static __inline int send_ssl_data(struct pt_regs* ctx, void* args_map, u8 type,
+                                  u8 library) {
     u64 current_pid_tgid = bpf_get_current_pid_tgid();
     u32 pid = current_pid_tgid >> 32;
 
-#ifndef KERNEL_LESS_5_2
-    // if target_ppid is 0 then we target all pids
-    if (target_pid != 0 && target_pid != pid) {
+    if (!is_target(pid)) {
         return 0;
     }
-#endif
-    debug_bpf_printk("openssl uretprobe/SSL_write pid :%d\n", pid);
+
     struct active_ssl_buf* active_ssl_buf_t =
-        bpf_map_lookup_elem(&active_ssl_write_args_map, &current_pid_tgid);
+        bpf_map_lookup_elem(args_map, &current_pid_tgid);
     if (active_ssl_buf_t != NULL) {
         const char* buf;
         u32 fd = active_ssl_buf_t->fd;
         bpf_probe_read(&buf, sizeof(const char*), &active_ssl_buf_t->buf);
-        process_SSL_data(ctx, current_pid_tgid, kSSLWrite, buf, fd);
+        process_SSL_data(ctx, current_pid_tgid, type, library, buf, fd);
     }
-    bpf_map_delete_elem(&active_ssl_write_args_map, &current_pid_tgid);
+    bpf_map_delete_elem(args_map, &current_pid_tgid);
     return 0;
 }
 
+/***********************************************************
+ * BPF probe function entry-points: openssl
+ ***********************************************************/
+
+// Function signature being probed:
+// int SSL_write(SSL *ssl, const void *buf, int num);
+SEC("uprobe/SSL_write")
+int probe_entry_SSL_write(struct pt_regs* ctx) {
+    debug_bpf_printk("openssl uprobe/SSL_write pid :%d\n",
+                     bpf_get_current_pid_tgid() >> 32);
+
+    void* ssl = (void*)PT_REGS_PARM1(ctx);
+    // https://github.com/openssl/openssl/blob/OpenSSL_1_1_1-stable/crypto/bio/bio_local.h
+    struct ssl_st ssl_info;
+    bpf_probe_read_user(&ssl_info, sizeof(ssl_info), ssl);
+
+    struct BIO bio_w;
+    bpf_probe_read_user(&bio_w, sizeof(bio_w), ssl_info.wbio);
+
+    // get fd ssl->wbio->num
+    u32 fd = bio_w.num;
+    debug_bpf_printk("openssl uprobe SSL_write FD:%d\n", fd);
+
+    const char* buf = (const char*)PT_REGS_PARM2(ctx);
+    return save_ssl_args(&active_ssl_write_args_map, buf, fd);
+}
+
+SEC("uretprobe/SSL_write")
+int probe_ret_SSL_write(struct pt_regs* ctx) {
+    return send_ssl_data(ctx, &active_ssl_write_args_map, EVENT_TYPE_TLS_WRITE,
+                         TLS_LIBRARY_OPENSSL);
+}
+
 // Function signature being probed:
 // int SSL_read(SSL *s, void *buf, int num)
 SEC("uprobe/SSL_read")
 int probe_entry_SSL_read(struct pt_regs* ctx) {
-    u64 current_pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = current_pid_tgid >> 32;
-    debug_bpf_printk("openssl uprobe/SSL_read pid :%d\n", pid);
-
-#ifndef KERNEL_LESS_5_2
-    // if target_ppid is 0 then we target all pids
-    if (target_pid != 0 && target_pid != pid) {
-        return 0;
-    }
-#endif
+    debug_bpf_printk("openssl uprobe/SSL_read pid :%d\n",
+                     bpf_get_current_pid_tgid() >> 32);
 
     void* ssl = (void*)PT_REGS_PARM1(ctx);
     // https://github.com/openssl/openssl/blob/OpenSSL_1_1_1-stable/crypto/bio/bio_local.h
@@ -233,41 +239,16 @@ int probe_entry_SSL_read(struct pt_regs* ctx) {
 
     // get fd ssl->rbio->num
     u32 fd = bio_r.num;
-    debug_bpf_printk("openssl uprobe PID:%d, SSL_read FD:%d\n", pid, fd);
+    debug_bpf_printk("openssl uprobe SSL_read FD:%d\n", fd);
 
     const char* buf = (const char*)PT_REGS_PARM2(ctx);
-    struct active_ssl_buf active_ssl_buf_t;
-    __builtin_memset(&active_ssl_buf_t, 0, sizeof(active_ssl_buf_t));
-    active_ssl_buf_t.fd = fd;
-    active_ssl_buf_t.buf = buf;
-    bpf_map_update_elem(&active_ssl_read_args_map, &current_pid_tgid,
-                        &active_ssl_buf_t, BPF_ANY);
-    return 0;
+    return save_ssl_args(&active_ssl_read_args_map, buf, fd);
 }
 
 SEC("uretprobe/SSL_read")
 int probe_ret_SSL_read(struct pt_regs* ctx) {
-    u64 current_pid_tgid = bpf_get_current_pid_tgid();
-    u32 pid = current_pid_tgid >> 32;
-    debug_bpf_printk("openssl uretprobe/SSL_read pid :%d\n", pid);
-
-#ifndef KERNEL_LESS_5_2
-    // if target_ppid is 0 then we target all pids
-    if (target_pid != 0 && target_pid != pid) {
-        return 0;
-    }
-#endif
-
-    struct active_ssl_buf* active_ssl_buf_t =
-        bpf_map_lookup_elem(&active_ssl_read_args_map, &current_pid_tgid);
-    if (active_ssl_buf_t != NULL) {
-        const char* buf;
-        u32 fd = active_ssl_buf_t->fd;
-        bpf_probe_read(&buf, sizeof(const char*), &active_ssl_buf_t->buf);
-        process_SSL_data(ctx, current_pid_tgid, kSSLRead, buf, fd);
-    }
-    bpf_map_delete_elem(&active_ssl_read_args_map, &current_pid_tgid);
-    return 0;
+    return send_ssl_data(ctx, &active_ssl_read_args_map, EVENT_TYPE_TLS_READ,
+                         TLS_LIBRARY_OPENSSL);
 }
 
 // https://github.com/lattera/glibc/blob/895ef79e04a953cac1493863bcae29ad85657ee1/socket/connect.c
@@ -277,12 +258,9 @@ int probe_connect(struct pt_regs* ctx) {
     u64 current_pid_tgid = bpf_get_current_pid_tgid();
     u32 pid = current_pid_tgid >> 32;
 
-#ifndef KERNEL_LESS_5_2
-    // if target_ppid is 0 then we target all pids
-    if (target_pid != 0 && target_pid != pid) {
+    if (!is_target(pid)) {
         return 0;
     }
-#endif
 
     u32 fd = (u32)PT_REGS_PARM1(ctx);
     struct sockaddr* saddr = (struct sockaddr*)PT_REGS_PARM2(ctx);
@@ -300,14 +278,79 @@ int probe_connect(struct pt_regs* ctx) {
 
     struct connect_event_t conn;
     __builtin_memset(&conn, 0, sizeof(conn));
-    conn.timestamp_ns = bpf_ktime_get_ns();
-    conn.pid = pid;
-    conn.tid = current_pid_tgid;
-    conn.fd = fd;
+    fill_event_header(&conn.header, EVENT_TYPE_CONNECT, current_pid_tgid);
+    conn.header.conn_key = fd;
+    conn.header.len = sizeof(conn) - EVENT_HEADER_SIZE;
     bpf_probe_read(&conn.sa_data, SA_DATA_LEN, &saddr->sa_data);
-    bpf_get_current_comm(&conn.comm, sizeof(conn.comm));
 
     bpf_perf_event_output(ctx, &connect_events, BPF_F_CURRENT_CPU, &conn,
                           sizeof(struct connect_event_t));
     return 0;
-}
\ No newline at end of file
+}
+
+/***********************************************************
+ * BPF probe function entry-points: gnutls
+ ***********************************************************/
+
+// http://gnu.ist.utl.pt/software/gnutls/manual/gnutls/gnutls.html#gnutls_record_send
+// Function signature being probed:
+// ssize_t gnutls_record_send (gnutls_session session, const void * data, size_t
+// sizeofdata)
+SEC("uprobe/gnutls_record_send")
+int probe_entry_gnutls_record_send(struct pt_regs* ctx) {
+    const char* buf = (const char*)PT_REGS_PARM2(ctx);
+    return save_ssl_args(&active_ssl_write_args_map, buf, invalidFD);
+}
+
+SEC("uretprobe/gnutls_record_send")
+int probe_ret_gnutls_record_send(struct pt_regs* ctx) {
+    return send_ssl_data(ctx, &active_ssl_write_args_map, EVENT_TYPE_TLS_WRITE,
+                         TLS_LIBRARY_GNUTLS);
+}
+
+// ssize_t gnutls_record_recv (gnutls_session session, void * data, size_t
+// sizeofdata)
+SEC("uprobe/gnutls_record_recv")
+int probe_entry_gnutls_record_recv(struct pt_regs* ctx) {
+    const char* buf = (const char*)PT_REGS_PARM2(ctx);
+    return save_ssl_args(&active_ssl_read_args_map, buf, invalidFD);
+}
+
+SEC("uretprobe/gnutls_record_recv")
+int probe_ret_gnutls_record_recv(struct pt_regs* ctx) {
+    return send_ssl_data(ctx, &active_ssl_read_args_map, EVENT_TYPE_TLS_READ,
+                         TLS_LIBRARY_GNUTLS);
+}
+
+/***********************************************************
+ * BPF probe function entry-points: nspr
+ ***********************************************************/
+
+// https://www-archive.mozilla.org/projects/nspr/reference/html/priofnc.html#19250
+// PRInt32 PR_Write(PRFileDesc *fd, const void *buf, PRInt32 amount);
+// also attached to PR_Send.
+SEC("uprobe/PR_Write")
+int probe_entry_PR_Write(struct pt_regs* ctx) {
+    const char* buf = (const char*)PT_REGS_PARM2(ctx);
+    return save_ssl_args(&active_ssl_write_args_map, buf, invalidFD);
+}
+
+SEC("uretprobe/PR_Write")
+int probe_ret_PR_Write(struct pt_regs* ctx) {
+    return send_ssl_data(ctx, &active_ssl_write_args_map, EVENT_TYPE_TLS_WRITE,
+                         TLS_LIBRARY_NSPR);
+}
+
+// PRInt32 PR_Read(PRFileDesc *fd, void *buf, PRInt32 amount);
+// also attached to PR_Recv.
+SEC("uprobe/PR_Read")
+int probe_entry_PR_Read(struct pt_regs* ctx) {
+    const char* buf = (const char*)PT_REGS_PARM2(ctx);
+    return save_ssl_args(&active_ssl_read_args_map, buf, invalidFD);
+}
+
+SEC("uretprobe/PR_Read")
+int probe_ret_PR_Read(struct pt_regs* ctx) {
+    return send_ssl_data(ctx, &active_ssl_read_args_map, EVENT_TYPE_TLS_READ,
+                         TLS_LIBRARY_NSPR);
+}
@@ -0,0 +1,183 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"fmt"
+	"strconv"
+	"strings"
+
+	"golang.org/x/sys/unix"
+)
+
+const (
+	// upper bound of tracked sessions.
+	BASH_SESSIONS_SIZE = 65536
+
+	// commands of a session kept before they are streamed, the session goes
+	// on in the next chunk.
+	BASH_SESSION_COMMANDS = 64
+
+	// upper bound of the lines kept by all sessions, the least recently
+	// active sessions are streamed first when it is hit.
+	BASH_SESSIONS_MAX_BYTES = 64 * 1024 * 1024
+)
+
+type bashCommand struct {
+	TimestampNs uint64
+	Pid         uint32
+	Cwd         string
+	Line        string
+	Retval      uint32
+	Executed    bool
+}
+
+// bashSession is the interactive session of a group of shells, identified
+// by its session id. Its commands are in the order they were read.
+type bashSession struct {
+	Sid      uint32
+	Leader   string // comm of the leader, the session ends after it exited
+	Tty      string
+	LoginUid uint32
+	Commands []bashCommand
+	size     int // bytes of the lines of Commands
+	chunk    int // number of chunks already streamed
+}
+
+func (this *bashSession) String(complete bool) string {
+	var b strings.Builder
+	loginUid := "N/A"
+	if this.LoginUid != BASH_LOGINUID_UNSET {
+		loginUid = fmt.Sprintf("%d", this.LoginUid)
+	}
+	state := "active"
+	if complete {
+		state = "closed"
+	}
+	fmt.Fprintf(&b, " Session Sid:%d, \tLeader:%s, \tTty:%s, \tLoginUid:%s, \tChunk:%d, \tCommands:%d, \tState:%s", this.Sid, this.Leader, this.Tty, loginUid, this.chunk, len(this.Commands), state)
+	for _, c := range this.Commands {
+		retval := "N/A"
+		if c.Executed {
+			retval = fmt.Sprintf("%d", c.Retval)
+		}
+		fmt.Fprintf(&b, "\n  Time:%d, \tPID:%d, \tCwd:%s, \tRetvalue:%s, \tLine:%s", c.TimestampNs, c.Pid, c.Cwd, retval, c.Line)
+	}
+	return b.String()
+}
+
+func (this *bashSession) AppendJSON(dst []byte, complete bool) []byte {
+	dst = append(dst, `{"event":"bash_session"`...)
+	dst = appendJSONUint(dst, "sid", uint64(this.Sid))
+	dst = appendJSONField(dst, "leader", this.Leader)
+	dst = appendJSONField(dst, "tty", this.Tty)
+	dst = appendJSONLoginUid(dst, this.LoginUid)
+	dst = appendJSONUint(dst, "chunk", uint64(this.chunk))
+	if complete {
+		dst = appendJSONField(dst, "state", "closed")
+	} else {
+		dst = appendJSONField(dst, "state", "active")
+	}
+	dst = append(appendJSONKey(dst, "commands"), '[')
+	for i, c := range this.Commands {
+		if i > 0 {
+			dst = append(dst, ',')
+		}
+		dst = append(dst, `{"time_ns":`...)
+		dst = strconv.AppendUint(dst, c.TimestampNs, 10)
+		dst = appendJSONUint(dst, "pid", uint64(c.Pid))
+		dst = appendJSONField(dst, "cwd", c.Cwd)
+		dst = appendJSONRetval(dst, c.Executed, c.Retval)
+		dst = appendJSONField(dst, "line", c.Line)
+		dst = append(dst, '}')
+	}
+	return append(dst, ']', '}')
+}
+
+// bashSessions groups the lines of each session, and streams a session when
+// it ends or when the bounds are hit, so that memory stays flat whatever the
+// number of shells. It is not safe for concurrent use.
+type bashSessions struct {
+	sessions *lruCache // sid -> *bashSession
+	size     int       // bytes of the lines of all sessions
+	output   func(session *bashSession, complete bool)
+}
+
+func newBashSessions(output func(session *bashSession, complete bool)) *bashSessions {
+	this := &bashSessions{
+		sessions: newLruCache(BASH_SESSIONS_SIZE),
+		output:   output,
+	}
+	this.sessions.onEvict = func(_, session interface{}) {
+		this.stream(session.(*bashSession), false)
+	}
+	return this
+}
+
+// Add appends a line to its session.
+func (this *bashSessions) Add(line *bashEvent) {
+	var session *bashSession
+	if s, found := this.sessions.Get(line.Sid); found {
+		session = s.(*bashSession)
+	} else {
+		session = &bashSession{Sid: line.Sid, Leader: processes.Comm(line.Sid), Tty: line.Tty, LoginUid: line.LoginUid}
+		this.sessions.Add(line.Sid, session)
+	}
+
+	command := bashCommand{
+		TimestampNs: line.TimestampNs,
+		Pid:         line.Pid,
+		Cwd:         line.Cwd,
+		Line:        unix.ByteSliceToString(line.Line),
+		Retval:      line.Retval,
+		Executed:    line.Executed,
+	}
+	session.Commands = append(session.Commands, command)
+	session.size += len(command.Line)
+	this.size += len(command.Line)
+
+	if len(session.Commands) >= BASH_SESSION_COMMANDS {
+		this.stream(session, false)
+	}
+	for this.size > BASH_SESSIONS_MAX_BYTES {
+		_, oldest, ok := this.sessions.RemoveOldest()
+		if !ok {
+			break
+		}
+		this.stream(oldest.(*bashSession), false)
+	}
+}
+
+// End streams the session sid, its leader exited.
+func (this *bashSessions) End(sid uint32) {
+	s, found := this.sessions.Get(sid)
+	if !found {
+		return
+	}
+	this.sessions.Remove(sid)
+	this.stream(s.(*bashSession), true)
+}
+
+// EndAll streams every session as active, eCapture is exiting.
+func (this *bashSessions) EndAll() {
+	for {
+		_, session, ok := this.sessions.RemoveOldest()
+		if !ok {
+			break
+		}
+		this.stream(session.(*bashSession), false)
+	}
+}
+
+// stream outputs the commands of session, and forgets them.
+func (this *bashSessions) stream(session *bashSession, complete bool) {
+	if len(session.Commands) == 0 && !complete {
+		return
+	}
+	this.output(session, complete)
+	this.size -= session.size
+	session.size = 0
+	session.Commands = nil
+	session.chunk++
+}
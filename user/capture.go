@@ -0,0 +1,256 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"bytes"
+	"compress/flate"
+	"encoding/binary"
+	"fmt"
+	"hash/crc32"
+	"os"
+	"sync"
+	"time"
+)
+
+/*
+Capture file, written with --write and read by `ecapture read`.
+Integers are little endian, strings are a u16 length and the bytes.
+
+	file header:
+	    char magic[8];          // CAPTURE_MAGIC
+	    u16  version;           // CAPTURE_VERSION
+	    u64  start;             // capture start, unix nano
+	    str  module;            // module name, eg: EBPFProbeBash
+	blocks, until the end of the file:
+	    u32  compressed_len;
+	    u32  raw_len;
+	    u32  records;
+	    u32  crc32;             // IEEE, of the compressed bytes
+	    u64  first_ns, last_ns; // time range of the records, bpf_ktime_get_ns
+	    u8   data[compressed_len]; // raw deflate of:
+	        u32 procs; { u32 pid; u32 ppid; u64 cgroup_id; str comm; str exe; str cmdline; str container_id; }
+	        u32 conns; { u32 pid; u32 fd; u8 ipv6; u8 ip[16]; u16 port; }
+	        { u32 len; u8 event[len]; } * records
+
+Records are the raw events as read from the perf buffers, starting with
+struct event_header_t, so the reader decodes them with the same code as a
+live capture. The dictionaries carry the processes and the connections the
+records of the block refer to, as known when they were captured.
+*/
+const (
+	CAPTURE_MAGIC   = "eCapture"
+	CAPTURE_VERSION = 1
+
+	CAPTURE_FILE_HEADER_SIZE  = 8 + 2 + 8
+	CAPTURE_BLOCK_HEADER_SIZE = 4 + 4 + 4 + 4 + 8 + 8
+
+	// records buffered before a block is compressed and written.
+	CAPTURE_BLOCK_SIZE = 256 * 1024
+
+	// a partial block is written after this long, so that a slow capture
+	// still reaches the disk.
+	CAPTURE_FLUSH_INTERVAL = 5 * time.Second
+
+	// upper bound of raw_len, for corrupted files.
+	CAPTURE_BLOCK_MAX_SIZE = 64 * 1024 * 1024
+)
+
+// captureConns is implemented by modules that resolve the connection of
+// their events, the capture file carries it for the reader.
+type captureConns interface {
+	lookupConn(pid, fd uint32) (connAddr, bool)
+	AddConn(pid, fd uint32, addr connAddr)
+}
+
+// captureWriter appends the raw events of a module to a capture file, in
+// blocks of CAPTURE_BLOCK_SIZE. Only the sink of the pipeline appends, the
+// lock orders it with the final Flush on exit.
+type captureWriter struct {
+	lock  sync.Mutex
+	f     *os.File
+	conns captureConns // nil if the module has no connections
+
+	records []byte
+	count   uint32
+	first   uint64
+	last    uint64
+	procs   map[uint32]*ProcessInfo
+	dict    map[connKey]connAddr
+
+	flushed time.Time // when the last block was written
+
+	raw []byte
+	zw  *flate.Writer
+	zb  bytes.Buffer
+}
+
+func newCaptureWriter(path string, mod IModule) (*captureWriter, error) {
+	f, err := os.OpenFile(path, os.O_WRONLY|os.O_CREATE|os.O_TRUNC, 0600)
+	if err != nil {
+		return nil, err
+	}
+	this := &captureWriter{
+		f:       f,
+		records: make([]byte, 0, CAPTURE_BLOCK_SIZE+MAX_DATA_SIZE),
+		procs:   make(map[uint32]*ProcessInfo),
+		dict:    make(map[connKey]connAddr),
+		flushed: time.Now(),
+	}
+	this.conns, _ = mod.(captureConns)
+	// BestSpeed: the capture host only pays for cheap appends.
+	this.zw, _ = flate.NewWriter(&this.zb, flate.BestSpeed)
+
+	hdr := make([]byte, CAPTURE_FILE_HEADER_SIZE, CAPTURE_FILE_HEADER_SIZE+2+len(mod.Name()))
+	copy(hdr, CAPTURE_MAGIC)
+	binary.LittleEndian.PutUint16(hdr[8:10], CAPTURE_VERSION)
+	binary.LittleEndian.PutUint64(hdr[10:18], uint64(time.Now().UnixNano()))
+	hdr = appendCaptureString(hdr, mod.Name())
+	if _, err = f.Write(hdr); err != nil {
+		f.Close()
+		return nil, err
+	}
+	return this, nil
+}
+
+// Append adds a raw event, raw must hold a valid event header.
+func (this *captureWriter) Append(raw []byte) error {
+	pid := binary.LittleEndian.Uint32(raw[16:20])
+	fd := binary.LittleEndian.Uint32(raw[4:8])
+	ts := binary.LittleEndian.Uint64(raw[8:16])
+
+	this.lock.Lock()
+	defer this.lock.Unlock()
+	if _, f := this.procs[pid]; !f {
+		this.procs[pid] = processes.Get(pid)
+	}
+	if fd != 0 && this.conns != nil {
+		key := connKey{pid: pid, fd: fd}
+		if _, f := this.dict[key]; !f {
+			if addr, f := this.conns.lookupConn(pid, fd); f {
+				this.dict[key] = addr
+			}
+		}
+	}
+	if this.count == 0 || ts < this.first {
+		this.first = ts
+	}
+	if this.count == 0 || ts > this.last {
+		this.last = ts
+	}
+	this.count++
+	var l [4]byte
+	binary.LittleEndian.PutUint32(l[:], uint32(len(raw)))
+	this.records = append(this.records, l[:]...)
+	this.records = append(this.records, raw...)
+	if len(this.records) >= CAPTURE_BLOCK_SIZE {
+		return this.flush()
+	}
+	return nil
+}
+
+// Flush writes the buffered records as a block.
+func (this *captureWriter) Flush() error {
+	this.lock.Lock()
+	defer this.lock.Unlock()
+	return this.flush()
+}
+
+// Tick writes a partial block once CAPTURE_FLUSH_INTERVAL elapsed.
+func (this *captureWriter) Tick(now time.Time) error {
+	this.lock.Lock()
+	defer this.lock.Unlock()
+	if now.Sub(this.flushed) < CAPTURE_FLUSH_INTERVAL {
+		return nil
+	}
+	return this.flush()
+}
+
+func (this *captureWriter) flush() error {
+	this.flushed = time.Now()
+	if this.count == 0 {
+		return nil
+	}
+
+	raw := this.raw[:0]
+	raw = appendUint32(raw, uint32(len(this.procs)))
+	for _, p := range this.procs {
+		raw = appendUint32(raw, p.Pid)
+		raw = appendUint32(raw, p.Ppid)
+		raw = appendUint64(raw, p.CgroupId)
+		raw = appendCaptureString(raw, p.Comm)
+		raw = appendCaptureString(raw, p.Exe)
+		raw = appendCaptureString(raw, p.Cmdline)
+		raw = appendCaptureString(raw, p.ContainerId)
+	}
+	raw = appendUint32(raw, uint32(len(this.dict)))
+	for key, addr := range this.dict {
+		raw = appendUint32(raw, key.pid)
+		raw = appendUint32(raw, key.fd)
+		if addr.ipv6 {
+			raw = append(raw, 1)
+		} else {
+			raw = append(raw, 0)
+		}
+		raw = append(raw, addr.ip[:]...)
+		raw = append(raw, byte(addr.port), byte(addr.port>>8))
+	}
+	raw = append(raw, this.records...)
+	this.raw = raw
+
+	this.zb.Reset()
+	this.zb.Write(make([]byte, CAPTURE_BLOCK_HEADER_SIZE))
+	this.zw.Reset(&this.zb)
+	this.zw.Write(raw)
+	if err := this.zw.Close(); err != nil {
+		return err
+	}
+	block := this.zb.Bytes()
+	data := block[CAPTURE_BLOCK_HEADER_SIZE:]
+	binary.LittleEndian.PutUint32(block[0:4], uint32(len(data)))
+	binary.LittleEndian.PutUint32(block[4:8], uint32(len(raw)))
+	binary.LittleEndian.PutUint32(block[8:12], this.count)
+	binary.LittleEndian.PutUint32(block[12:16], crc32.ChecksumIEEE(data))
+	binary.LittleEndian.PutUint64(block[16:24], this.first)
+	binary.LittleEndian.PutUint64(block[24:32], this.last)
+
+	this.records = this.records[:0]
+	this.count = 0
+	for pid := range this.procs {
+		delete(this.procs, pid)
+	}
+	for key := range this.dict {
+		delete(this.dict, key)
+	}
+	if _, err := this.f.Write(block); err != nil {
+		return fmt.Errorf("write capture block: %v", err)
+	}
+	return nil
+}
+
+// Close writes the last block and closes the file.
+func (this *captureWriter) Close() error {
+	err := this.Flush()
+	if e := this.f.Close(); err == nil {
+		err = e
+	}
+	return err
+}
+
+func appendUint32(dst []byte, v uint32) []byte {
+	return append(dst, byte(v), byte(v>>8), byte(v>>16), byte(v>>24))
+}
+
+func appendUint64(dst []byte, v uint64) []byte {
+	return appendUint32(appendUint32(dst, uint32(v)), uint32(v>>32))
+}
+
+func appendCaptureString(dst []byte, s string) []byte {
+	if len(s) > 0xFFFF {
+		s = s[:0xFFFF]
+	}
+	dst = append(dst, byte(len(s)), byte(len(s)>>8))
+	return append(dst, s...)
+}
@@ -0,0 +1,348 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"bufio"
+	"bytes"
+	"compress/flate"
+	"context"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"hash/crc32"
+	"io"
+	"log"
+	"os"
+	"time"
+)
+
+// captureBlock is a block of a capture file, see capture.go.
+type captureBlock struct {
+	Records uint32
+	FirstNs uint64
+	LastNs  uint64
+
+	procs   []*ProcessInfo
+	conns   []captureConn
+	records []byte // { u32 len; u8 event[len]; } * Records
+}
+
+type captureConn struct {
+	key  connKey
+	addr connAddr
+}
+
+// captureReader reads a capture file written by captureWriter.
+type captureReader struct {
+	f      *os.File
+	r      *bufio.Reader
+	Module string
+	Start  time.Time
+
+	data []byte
+	raw  bytes.Buffer
+	zr   io.ReadCloser
+}
+
+func openCapture(path string) (*captureReader, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	this := &captureReader{f: f, r: bufio.NewReaderSize(f, 256*1024)}
+	hdr := make([]byte, CAPTURE_FILE_HEADER_SIZE)
+	if _, err = io.ReadFull(this.r, hdr); err != nil {
+		f.Close()
+		return nil, fmt.Errorf("read capture header: %v", err)
+	}
+	if string(hdr[:8]) != CAPTURE_MAGIC {
+		f.Close()
+		return nil, fmt.Errorf("%s is not a capture file", path)
+	}
+	if v := binary.LittleEndian.Uint16(hdr[8:10]); v != CAPTURE_VERSION {
+		f.Close()
+		return nil, fmt.Errorf("unsupported capture version:%d, want:%d", v, CAPTURE_VERSION)
+	}
+	this.Start = time.Unix(0, int64(binary.LittleEndian.Uint64(hdr[10:18])))
+	if this.Module, err = this.readString(); err != nil {
+		f.Close()
+		return nil, fmt.Errorf("read capture header: %v", err)
+	}
+	this.zr = flate.NewReader(bytes.NewReader(nil))
+	return this, nil
+}
+
+func (this *captureReader) readString() (string, error) {
+	var l [2]byte
+	if _, err := io.ReadFull(this.r, l[:]); err != nil {
+		return "", err
+	}
+	s := make([]byte, binary.LittleEndian.Uint16(l[:]))
+	if _, err := io.ReadFull(this.r, s); err != nil {
+		return "", err
+	}
+	return string(s), nil
+}
+
+// Next reads the next block into b, it returns io.EOF at the end of the file.
+func (this *captureReader) Next(b *captureBlock) error {
+	var hdr [CAPTURE_BLOCK_HEADER_SIZE]byte
+	if _, err := io.ReadFull(this.r, hdr[:]); err != nil {
+		if err == io.ErrUnexpectedEOF {
+			return fmt.Errorf("capture block header truncated")
+		}
+		return err
+	}
+	compressed := binary.LittleEndian.Uint32(hdr[0:4])
+	rawLen := binary.LittleEndian.Uint32(hdr[4:8])
+	if compressed > CAPTURE_BLOCK_MAX_SIZE || rawLen > CAPTURE_BLOCK_MAX_SIZE {
+		return fmt.Errorf("capture block too large: %d/%d bytes", compressed, rawLen)
+	}
+	b.Records = binary.LittleEndian.Uint32(hdr[8:12])
+	b.FirstNs = binary.LittleEndian.Uint64(hdr[16:24])
+	b.LastNs = binary.LittleEndian.Uint64(hdr[24:32])
+
+	if cap(this.data) < int(compressed) {
+		this.data = make([]byte, compressed)
+	}
+	this.data = this.data[:compressed]
+	if _, err := io.ReadFull(this.r, this.data); err != nil {
+		return fmt.Errorf("capture block truncated: %v", err)
+	}
+	if crc := crc32.ChecksumIEEE(this.data); crc != binary.LittleEndian.Uint32(hdr[12:16]) {
+		return fmt.Errorf("capture block checksum mismatch")
+	}
+
+	this.zr.(flate.Resetter).Reset(bytes.NewReader(this.data), nil)
+	this.raw.Reset()
+	this.raw.Grow(int(rawLen))
+	if _, err := this.raw.ReadFrom(this.zr); err != nil {
+		return fmt.Errorf("decompress capture block: %v", err)
+	}
+	if this.raw.Len() != int(rawLen) {
+		return fmt.Errorf("capture block is %d bytes, header says %d", this.raw.Len(), rawLen)
+	}
+	return b.decode(this.raw.Bytes())
+}
+
+func (this *captureReader) Close() error {
+	return this.f.Close()
+}
+
+var errCaptureBlockShort = errors.New("capture block truncated")
+
+func (this *captureBlock) decode(raw []byte) error {
+	d := captureDecoder{b: raw}
+	this.procs = this.procs[:0]
+	for n := d.uint32(); n > 0 && d.err == nil; n-- {
+		p := &ProcessInfo{Pid: d.uint32(), Ppid: d.uint32(), CgroupId: d.uint64()}
+		p.Comm = d.string()
+		p.Exe = d.string()
+		p.Cmdline = d.string()
+		p.ContainerId = d.string()
+		this.procs = append(this.procs, p)
+	}
+	this.conns = this.conns[:0]
+	for n := d.uint32(); n > 0 && d.err == nil; n-- {
+		var c captureConn
+		c.key.pid = d.uint32()
+		c.key.fd = d.uint32()
+		b := d.bytes(1 + 16 + 2)
+		if b == nil {
+			break
+		}
+		c.addr.ipv6 = b[0] != 0
+		copy(c.addr.ip[:], b[1:17])
+		c.addr.port = binary.LittleEndian.Uint16(b[17:19])
+		this.conns = append(this.conns, c)
+	}
+	if d.err != nil {
+		return d.err
+	}
+	this.records = d.b
+	return nil
+}
+
+// Each calls fn with every raw event of the block.
+func (this *captureBlock) Each(fn func(raw []byte) error) error {
+	d := captureDecoder{b: this.records}
+	for len(d.b) > 0 {
+		raw := d.bytes(int(d.uint32()))
+		if d.err != nil {
+			return d.err
+		}
+		if err := fn(raw); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// captureDecoder reads the little endian fields of a block, the first error
+// sticks.
+type captureDecoder struct {
+	b   []byte
+	err error
+}
+
+func (this *captureDecoder) bytes(n int) []byte {
+	if this.err != nil {
+		return nil
+	}
+	if n > len(this.b) {
+		this.err = errCaptureBlockShort
+		return nil
+	}
+	b := this.b[:n]
+	this.b = this.b[n:]
+	return b
+}
+
+func (this *captureDecoder) uint32() uint32 {
+	if b := this.bytes(4); b != nil {
+		return binary.LittleEndian.Uint32(b)
+	}
+	return 0
+}
+
+func (this *captureDecoder) uint64() uint64 {
+	if b := this.bytes(8); b != nil {
+		return binary.LittleEndian.Uint64(b)
+	}
+	return 0
+}
+
+func (this *captureDecoder) string() string {
+	l := 0
+	if b := this.bytes(2); b != nil {
+		l = int(binary.LittleEndian.Uint16(b))
+	}
+	return string(this.bytes(l))
+}
+
+// captureEventStruct returns the event struct of a kernel event type, it
+// matches the decode functions the modules register for their maps.
+func captureEventStruct(t KERNEL_EVENT_TYPE) IEventStruct {
+	switch t {
+	case KERNEL_EVENT_TLS_READ, KERNEL_EVENT_TLS_WRITE:
+		return &SSLDataEvent{}
+	case KERNEL_EVENT_CONNECT:
+		return &ConnDataEvent{}
+	case KERNEL_EVENT_BASH, KERNEL_EVENT_BASH_RETVAL:
+		return &bashEvent{}
+	case KERNEL_EVENT_MYSQLD:
+		return &mysqldEvent{}
+	case KERNEL_EVENT_POSTGRES:
+		return &postgresEvent{}
+	case KERNEL_EVENT_PROCESS_EXEC, KERNEL_EVENT_PROCESS_FORK, KERNEL_EVENT_PROCESS_EXIT:
+		return &ProcessEvent{}
+	}
+	return nil
+}
+
+// captureConfig returns the default config of a module, for reading its
+// capture files.
+func captureConfig(name string) (IConfig, error) {
+	switch name {
+	case MODULE_NAME_BASH:
+		conf := NewBashConfig()
+		conf.ErrNo = BASH_ERRNO_DEFAULT
+		return conf, nil
+	case MODULE_NAME_MYSQLD:
+		return NewMysqldConfig(), nil
+	case MODULE_NAME_POSTGRES:
+		return NewPostgresConfig(), nil
+	case MODULE_NAME_OPENSSL:
+		return NewTlsConfig(), nil
+	}
+	return nil, fmt.Errorf("cant found module: %s", name)
+}
+
+// ReadCapture decodes the events of a capture file and prints them with the
+// module that wrote it, without loading any eBPF program.
+func ReadCapture(ctx context.Context, logger *log.Logger, path string, hex bool, format string) error {
+	cr, err := openCapture(path)
+	if err != nil {
+		return err
+	}
+	defer cr.Close()
+
+	mod := GetModuleByName(cr.Module)
+	if mod == nil {
+		return fmt.Errorf("cant found module: %s", cr.Module)
+	}
+	conf, err := captureConfig(cr.Module)
+	if err != nil {
+		return err
+	}
+	conf.SetHex(hex)
+	conf.SetFormat(format)
+	if err = mod.Init(ctx, logger, conf); err != nil {
+		return err
+	}
+	replay := mod.(interface {
+		initOutput()
+		setOffline()
+		replay(IEventStruct, []byte) error
+	})
+	replay.initOutput()
+	// the pids and fds of the file are not those of this host, unknown ones
+	// stay COMM_NOT_FOUND and CONN_NOT_FOUND.
+	replay.setOffline()
+	processes.SetOffline()
+	conns, _ := mod.(captureConns)
+	logger.Printf("%s capture of %s, started at %s", path, mod.Name(), cr.Start.Format(time.RFC3339))
+
+	// event structs by kernel event type, bound to the module.
+	var protos [256]IEventStruct
+	var b captureBlock
+	var blocks, records, decodeErrors uint64
+	for {
+		if err = cr.Next(&b); err != nil {
+			if err == io.EOF {
+				break
+			}
+			mod.Flush()
+			return err
+		}
+		blocks++
+		for _, p := range b.procs {
+			processes.Put(p)
+		}
+		if conns != nil {
+			for _, c := range b.conns {
+				conns.AddConn(c.key.pid, c.key.fd, c.addr)
+			}
+		}
+		err = b.Each(func(raw []byte) error {
+			records++
+			if len(raw) == 0 {
+				decodeErrors++
+				return nil
+			}
+			t := raw[0]
+			if protos[t] == nil {
+				if protos[t] = captureEventStruct(KERNEL_EVENT_TYPE(t)); protos[t] == nil {
+					decodeErrors++
+					return nil
+				}
+				protos[t].SetModule(mod)
+			}
+			// the block buffer is reused, and modules may keep events.
+			if e := replay.replay(protos[t], append([]byte(nil), raw...)); e != nil {
+				decodeErrors++
+			}
+			return nil
+		})
+		if err != nil {
+			mod.Flush()
+			return err
+		}
+	}
+	mod.Flush()
+	logger.Printf("%s: %d blocks, %d records, %d decode errors", path, blocks, records, decodeErrors)
+	return nil
+}
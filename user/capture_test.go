@@ -0,0 +1,175 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"bytes"
+	"encoding/binary"
+	"io"
+	"net"
+	"os"
+	"path/filepath"
+	"strings"
+	"testing"
+)
+
+// writeTestCapture writes two blocks of events of pid 1000: a TLS write and
+// a connect, then a bash line.
+func writeTestCapture(t *testing.T, path string) (*MOpenSSLProbe, [][]byte) {
+	m := &MOpenSSLProbe{}
+	m.name = MODULE_NAME_OPENSSL
+	m.AddConn(1000, 7, newConnAddrV4([]byte{0x01, 0xbb, 10, 0, 0, 1}))
+	processes.Put(&ProcessInfo{Pid: 1000, Ppid: 1, Comm: "curl", Exe: "/usr/bin/curl", CgroupId: 42, ContainerId: strings.Repeat("ab", 32)})
+
+	connect := testConnectPayload()
+	binary.LittleEndian.PutUint64(connect[8:16], 123456790)
+	records := [][]byte{testTlsPayload(), connect, testBashPayload()}
+	w, err := newCaptureWriter(path, m)
+	if err != nil {
+		t.Fatal(err)
+	}
+	for i, raw := range records {
+		if err = w.Append(raw); err != nil {
+			t.Fatal(err)
+		}
+		if i == 1 {
+			if err = w.Flush(); err != nil {
+				t.Fatal(err)
+			}
+		}
+	}
+	if err = w.Close(); err != nil {
+		t.Fatal(err)
+	}
+	return m, records
+}
+
+// The reader gets back the records and the dictionaries of every block.
+func TestCaptureRoundTrip(t *testing.T) {
+	path := filepath.Join(t.TempDir(), "tls.ecap")
+	m, records := writeTestCapture(t, path)
+	cr, err := openCapture(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer cr.Close()
+	if cr.Module != m.Name() {
+		t.Fatalf("module %q, want %q", cr.Module, m.Name())
+	}
+
+	var b captureBlock
+	var got [][]byte
+	for _, want := range []struct {
+		records     uint32
+		first, last uint64
+		conns       int
+	}{
+		{2, 123456789, 123456790, 1},
+		{1, 123456789, 123456789, 1},
+	} {
+		if err = cr.Next(&b); err != nil {
+			t.Fatal(err)
+		}
+		if b.Records != want.records || b.FirstNs != want.first || b.LastNs != want.last {
+			t.Errorf("block of %d records from %d to %d, want %d from %d to %d", b.Records, b.FirstNs, b.LastNs, want.records, want.first, want.last)
+		}
+		if len(b.procs) != 1 || *b.procs[0] != *processes.Get(1000) {
+			t.Errorf("processes %+v, want %+v", b.procs, processes.Get(1000))
+		}
+		addr, _ := m.lookupConn(1000, 7)
+		if len(b.conns) != want.conns || b.conns[0].key != (connKey{pid: 1000, fd: 7}) || b.conns[0].addr != addr {
+			t.Errorf("connections %+v", b.conns)
+		}
+		b.Each(func(raw []byte) error {
+			got = append(got, append([]byte(nil), raw...))
+			return nil
+		})
+	}
+	if err = cr.Next(&b); err != io.EOF {
+		t.Fatalf("after the last block: %v", err)
+	}
+	if len(got) != len(records) {
+		t.Fatalf("%d records, want %d", len(got), len(records))
+	}
+	for i := range records {
+		if !bytes.Equal(got[i], records[i]) {
+			t.Errorf("record %d differs", i)
+		}
+	}
+}
+
+// A corrupted or truncated block is an error, the blocks before it are read.
+func TestCaptureDamaged(t *testing.T) {
+	dir := t.TempDir()
+	path := filepath.Join(dir, "tls.ecap")
+	writeTestCapture(t, path)
+	b, err := os.ReadFile(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	first := CAPTURE_FILE_HEADER_SIZE + 2 + len(MODULE_NAME_OPENSSL)
+	second := first + CAPTURE_BLOCK_HEADER_SIZE + int(binary.LittleEndian.Uint32(b[first:first+4]))
+
+	for _, c := range []struct {
+		name   string
+		damage func([]byte) []byte
+		err    string
+	}{
+		{"checksum", func(b []byte) []byte { b[second+CAPTURE_BLOCK_HEADER_SIZE] ^= 0xff; return b }, "checksum mismatch"},
+		{"truncated data", func(b []byte) []byte { return b[:len(b)-1] }, "capture block truncated"},
+		{"truncated header", func(b []byte) []byte { return b[:second+CAPTURE_BLOCK_HEADER_SIZE-1] }, "capture block header truncated"},
+	} {
+		damaged := filepath.Join(dir, strings.Replace(c.name, " ", "_", -1))
+		if err = os.WriteFile(damaged, c.damage(append([]byte(nil), b...)), 0600); err != nil {
+			t.Fatal(err)
+		}
+		cr, err := openCapture(damaged)
+		if err != nil {
+			t.Fatal(err)
+		}
+		var block captureBlock
+		if err = cr.Next(&block); err != nil {
+			t.Errorf("%s: first block: %v", c.name, err)
+		}
+		if err = cr.Next(&block); err == nil || !strings.Contains(err.Error(), c.err) {
+			t.Errorf("%s: second block: %v, want %q", c.name, err, c.err)
+		}
+		cr.Close()
+	}
+}
+
+// Reading a capture file, processes and connections unknown to the file are
+// not looked up on this host.
+func TestCaptureOffline(t *testing.T) {
+	c := NewProcessCache()
+	c.SetOffline()
+	if comm := c.Comm(uint32(os.Getpid())); comm != COMM_NOT_FOUND {
+		t.Errorf("comm %q read from /proc", comm)
+	}
+	c.Put(&ProcessInfo{Pid: 5, ContainerId: "restored"})
+	exec := &ProcessEvent{}
+	exec.Type, exec.Pid = KERNEL_EVENT_PROCESS_EXEC, 5
+	copy(exec.Comm[:], "sh")
+	c.Dispatch(exec)
+	if info := c.Get(5); info.Comm != "sh" || info.ContainerId != "restored" {
+		t.Errorf("after exec: %+v", info)
+	}
+
+	ln, err := net.Listen("tcp4", "127.0.0.1:0")
+	if err != nil {
+		t.Skip(err)
+	}
+	defer ln.Close()
+	f, err := ln.(*net.TCPListener).File()
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer f.Close()
+	m := &MOpenSSLProbe{}
+	m.setOffline()
+	if addr, found := m.lookupConn(uint32(os.Getpid()), uint32(f.Fd())); found {
+		t.Errorf("connection resolved to %s", addr)
+	}
+}
@@ -9,6 +9,7 @@ import (
 	"log"
 	"os"
 	"path/filepath"
+	"strconv"
 	"strings"
 )
 
@@ -193,45 +194,102 @@ const (
 	COLORWHITE  = "\033[37m"
 )
 
-func dumpByteSlice(b []byte, perfix string) *bytes.Buffer {
-	var a [CHUNK_SIZE]byte
-	bb := new(bytes.Buffer)
-	n := (len(b) + (CHUNK_SIZE - 1)) &^ (CHUNK_SIZE - 1)
-
-	for i := 0; i < n; i++ {
-
-		// 序号列
-		if i%CHUNK_SIZE == 0 {
-			bb.WriteString(perfix)
-			bb.WriteString(fmt.Sprintf("%04d", i))
+// hexDumpTable holds " XX" of every byte, hexDumpAscii its gutter character.
+var hexDumpTable, hexDumpAscii = func() (t [256][3]byte, a [256]byte) {
+	const digits = "0123456789ABCDEF"
+	for i := 0; i < 256; i++ {
+		t[i] = [3]byte{' ', digits[i>>4], digits[i&0x0F]}
+		// 非ASCII 改为 .
+		if i < 32 || i > 126 {
+			a[i] = '.'
+		} else {
+			a[i] = byte(i)
 		}
+	}
+	return
+}()
 
+func dumpByteSlice(b []byte, perfix string) *bytes.Buffer {
+	lines := (len(b) + (CHUNK_SIZE - 1)) / CHUNK_SIZE
+	// perfix, offset, 3 gaps, 16 bytes, ascii gutter, newline.
+	dst := make([]byte, 0, lines*(len(perfix)+4+4+2+2+CHUNK_SIZE*3+4+CHUNK_SIZE+1))
+	return bytes.NewBuffer(appendHexDump(dst, b, perfix))
+}
+
+// hexDumpLine is a full line after its offset column: the gaps are already
+// there, appendHexDump only fills in the bytes at hexDumpColumns and the
+// ascii gutter.
+var hexDumpLine, hexDumpColumns = func() (l [4 + 2 + 4 + 2 + CHUNK_SIZE*3 + 4 + CHUNK_SIZE + 1]byte, c [CHUNK_SIZE]int) {
+	for i := range l {
+		l[i] = ' '
+	}
+	l[len(l)-1] = '\n'
+	p := 0
+	for j := range c {
 		// 长度的一半，则输出4个空格
-		if i%CHUNK_SIZE_HALF == 0 {
-			bb.WriteString("    ")
-		} else if i%(CHUNK_SIZE_HALF/2) == 0 {
-			bb.WriteString("  ")
+		if j%CHUNK_SIZE_HALF == 0 {
+			p += 4
+		} else if j%(CHUNK_SIZE_HALF/2) == 0 {
+			p += 2
 		}
+		c[j] = p
+		p += 3
+	}
+	return
+}()
 
-		if i < len(b) {
-			bb.WriteString(fmt.Sprintf(" %02X", b[i]))
+// appendHexDump appends the hex dump of b to dst, from lookup tables without
+// fmt, and returns the extended buffer.
+func appendHexDump(dst []byte, b []byte, perfix string) []byte {
+	for off := 0; off < len(b); off += CHUNK_SIZE {
+		// 序号列, %04d
+		dst = append(dst, perfix...)
+		if off < 10000 {
+			dst = append(dst, byte('0'+off/1000), byte('0'+off/100%10), byte('0'+off/10%10), byte('0'+off%10))
 		} else {
-			bb.WriteString("  ")
+			dst = strconv.AppendInt(dst, int64(off), 10)
 		}
 
-		// 非ASCII 改为 .
-		if i >= len(b) {
-			a[i%CHUNK_SIZE] = ' '
-		} else if b[i] < 32 || b[i] > 126 {
-			a[i%CHUNK_SIZE] = '.'
-		} else {
-			a[i%CHUNK_SIZE] = b[i]
+		if len(b)-off >= CHUNK_SIZE {
+			start := len(dst)
+			dst = append(dst, hexDumpLine[:]...)
+			line := dst[start : start+len(hexDumpLine)]
+			ascii := line[len(line)-1-CHUNK_SIZE : len(line)-1]
+			chunk := b[off : off+CHUNK_SIZE]
+			for j := 0; j < CHUNK_SIZE; j++ {
+				c := chunk[j]
+				h := &hexDumpTable[c]
+				// h[0] is the space already in the line.
+				p := hexDumpColumns[j]
+				line[p+1], line[p+2] = h[1], h[2]
+				ascii[j] = hexDumpAscii[c]
+			}
+			continue
 		}
 
-		// 如果到达size长度，则换行
-		if i%CHUNK_SIZE == (CHUNK_SIZE - 1) {
-			bb.WriteString(fmt.Sprintf("    %s\n", string(a[:])))
+		// the last line, missing bytes are blank.
+		var ascii [CHUNK_SIZE]byte
+		for j := 0; j < CHUNK_SIZE; j++ {
+			if j%CHUNK_SIZE_HALF == 0 {
+				dst = append(dst, "    "...)
+			} else if j%(CHUNK_SIZE_HALF/2) == 0 {
+				dst = append(dst, "  "...)
+			}
+
+			if i := off + j; i < len(b) {
+				h := &hexDumpTable[b[i]]
+				dst = append(dst, h[0], h[1], h[2])
+				ascii[j] = hexDumpAscii[b[i]]
+			} else {
+				dst = append(dst, "  "...)
+				ascii[j] = ' '
+			}
 		}
+
+		// 如果到达size长度，则换行
+		dst = append(dst, "    "...)
+		dst = append(dst, ascii[:]...)
+		dst = append(dst, '\n')
 	}
-	return bb
+	return dst
 }
@@ -0,0 +1,138 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"bytes"
+	"fmt"
+	"testing"
+)
+
+// refDumpByteSlice is the fmt based hex dump that appendHexDump replaced,
+// the reference for its output.
+func refDumpByteSlice(b []byte, perfix string) *bytes.Buffer {
+	var a [CHUNK_SIZE]byte
+	bb := new(bytes.Buffer)
+	n := (len(b) + (CHUNK_SIZE - 1)) &^ (CHUNK_SIZE - 1)
+
+	for i := 0; i < n; i++ {
+
+		// 序号列
+		if i%CHUNK_SIZE == 0 {
+			bb.WriteString(perfix)
+			bb.WriteString(fmt.Sprintf("%04d", i))
+		}
+
+		// 长度的一半，则输出4个空格
+		if i%CHUNK_SIZE_HALF == 0 {
+			bb.WriteString("    ")
+		} else if i%(CHUNK_SIZE_HALF/2) == 0 {
+			bb.WriteString("  ")
+		}
+
+		if i < len(b) {
+			bb.WriteString(fmt.Sprintf(" %02X", b[i]))
+		} else {
+			bb.WriteString("  ")
+		}
+
+		// 非ASCII 改为 .
+		if i >= len(b) {
+			a[i%CHUNK_SIZE] = ' '
+		} else if b[i] < 32 || b[i] > 126 {
+			a[i%CHUNK_SIZE] = '.'
+		} else {
+			a[i%CHUNK_SIZE] = b[i]
+		}
+
+		// 如果到达size长度，则换行
+		if i%CHUNK_SIZE == (CHUNK_SIZE - 1) {
+			bb.WriteString(fmt.Sprintf("    %s\n", string(a[:])))
+		}
+	}
+	return bb
+}
+
+// testDumpData returns n bytes going through every byte value.
+func testDumpData(n int) []byte {
+	b := make([]byte, n)
+	for i := range b {
+		b[i] = byte(i * 7)
+	}
+	return b
+}
+
+func TestDumpByteSlice(t *testing.T) {
+	// partial and full last lines, and offsets of 5 digits: the line at
+	// 10000 is the first one past %04d.
+	lengths := []int{0, 1, 4, 5, 8, 9, 15, 16, 17, 31, 32, 33, 100, 4096,
+		9999, 10000, 10001, 10015, 10016, 10017, 10021, 16384, 100000 + 3}
+	for _, perfix := range []string{"", COLORGREEN} {
+		for _, n := range lengths {
+			b := testDumpData(n)
+			want := refDumpByteSlice(b, perfix).String()
+			if got := dumpByteSlice(b, perfix).String(); got != want {
+				t.Errorf("len %d, perfix %q:\n%s\nwant:\n%s", n, perfix, tailLines(got, 2), tailLines(want, 2))
+			}
+		}
+	}
+}
+
+// tailLines returns the last n lines of s.
+func tailLines(s string, n int) string {
+	i := len(s)
+	for ; n >= 0 && i > 0; n-- {
+		i = bytes.LastIndexByte([]byte(s[:i]), '\n')
+		if i < 0 {
+			return s
+		}
+	}
+	return s[i+1:]
+}
+
+func BenchmarkDumpByteSlice(b *testing.B) {
+	for _, n := range []int{64, 1024, 16384} {
+		data := testDumpData(n)
+		b.Run(fmt.Sprintf("fmt/%d", n), func(b *testing.B) {
+			b.ReportAllocs()
+			b.SetBytes(int64(n))
+			for i := 0; i < b.N; i++ {
+				refDumpByteSlice(data, COLORGREEN)
+			}
+		})
+		b.Run(fmt.Sprintf("table/%d", n), func(b *testing.B) {
+			b.ReportAllocs()
+			b.SetBytes(int64(n))
+			for i := 0; i < b.N; i++ {
+				dumpByteSlice(data, COLORGREEN)
+			}
+		})
+		// the output buffers of the pipeline are reused.
+		b.Run(fmt.Sprintf("append/%d", n), func(b *testing.B) {
+			dst := appendHexDump(nil, data, COLORGREEN)
+			b.ReportAllocs()
+			b.SetBytes(int64(n))
+			for i := 0; i < b.N; i++ {
+				dst = appendHexDump(dst[:0], data, COLORGREEN)
+			}
+		})
+	}
+}
+
+// bash lines print as they did with fmt, the hex dump from appendHexDump.
+func TestBashEventString(t *testing.T) {
+	var e bashEvent
+	if err := e.Decode(testBashPayload()); err != nil {
+		t.Fatal(err)
+	}
+	e.Cwd, e.Executed, e.Retval = "/tmp", true, 2
+	head := fmt.Sprintf(" PID:%d, \tComm:%s, \tSid:%d, \tTty:%s, \tLoginUid:%d, \tCwd:%s, \tRetvalue:%d, \tLine:\n", e.Pid, e.comm(), e.Sid, e.Tty, e.LoginUid, e.Cwd, e.Retval)
+	if got, want := e.String(), head+"ls -al /tmp"; got != want {
+		t.Errorf("String:\n%q\nwant:\n%q", got, want)
+	}
+	if got, want := e.StringHex(), head+refDumpByteSlice([]byte("ls -al /tmp"), "").String()+","; got != want {
+		t.Errorf("StringHex:\n%q\nwant:\n%q", got, want)
+	}
+}
@@ -6,6 +6,7 @@ package user
 
 import (
 	"errors"
+	"fmt"
 	"os"
 	"strings"
 )
@@ -13,19 +14,25 @@ import (
 // Bashpath 与 readline 两个参数，使用时二选一
 type BashConfig struct {
 	eConfig
-	Bashpath string `json:"bashpath"` //bash的文件路径
-	Readline string `json:"readline"`
-	ErrNo	 int
-	elfType  uint8  //
+	Bashpath   string `json:"bashpath"` //bash的文件路径
+	Readline   string `json:"readline"`
+	ErrNo      int
+	LineMaxLen uint32 `json:"lineMaxLen"` // 命令行最大捕获长度
+	Session    bool   `json:"session"`    // 按会话聚合输出
+	elfType    uint8  //
 }
 
 func NewBashConfig() *BashConfig {
-	config := &BashConfig{}
+	config := &BashConfig{LineMaxLen: MAX_DATA_SIZE_BASH}
 	return config
 }
 
 func (this *BashConfig) Check() error {
 
+	if this.LineMaxLen == 0 || this.LineMaxLen > MAX_DATA_SIZE_BASH {
+		return fmt.Errorf("line max length must be in [1, %d].", MAX_DATA_SIZE_BASH)
+	}
+
 	// 如果readline 配置，且存在，则直接返回。
 	if this.Readline != "" || len(strings.TrimSpace(this.Readline)) > 0 {
 		_, e := os.Stat(this.Readline)
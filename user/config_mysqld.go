@@ -26,12 +26,17 @@ const (
 // 最终使用mysqld参数
 type MysqldConfig struct {
 	eConfig
-	Mysqldpath  string      `json:"mysqldPath"` //curl的文件路径
-	FuncName    string      `json:"funcName"`
-	Offset      uint64      `json:"offset"`
-	elfType     uint8       //
-	version     MYSQLD_TYPE //
-	versionInfo string      // info
+	Mysqldpath      string      `json:"mysqldPath"` //curl的文件路径
+	FuncName        string      `json:"funcName"`
+	Offset          uint64      `json:"offset"`
+	ThdIdOffset     uint64      `json:"thdIdOffset"`     // THD::m_thread_id 的偏移，用于获取连接ID
+	ThdStmtIdOffset uint64      `json:"thdStmtIdOffset"` // THD::statement_id_counter 的偏移，用于获取预处理语句ID
+	QueryMaxLen     uint32      `json:"queryMaxLen"`     // SQL 最大捕获长度
+	Latency         bool        `json:"latency"`         // 只统计耗时直方图，不输出SQL
+	Interval        uint64      `json:"interval"`        // 耗时直方图输出间隔，秒
+	elfType         uint8       //
+	version         MYSQLD_TYPE //
+	versionInfo     string      // info
 }
 
 func NewMysqldConfig() *MysqldConfig {
@@ -52,6 +57,14 @@ func (this *MysqldConfig) Check() error {
 	}
 	this.elfType = ELF_TYPE_BIN
 
+	if this.QueryMaxLen == 0 || this.QueryMaxLen > MYSQLD_MAX_DATA_SIZE {
+		return errors.New(fmt.Sprintf("query max length must be in [1, %d].", MYSQLD_MAX_DATA_SIZE))
+	}
+
+	if this.Latency && this.Interval == 0 {
+		return errors.New("latency interval must be greater than 0.")
+	}
+
 	//如果配置 funcname ，则使用用户指定的函数名
 	if this.FuncName != "" || len(strings.TrimSpace(this.FuncName)) > 0 {
 		return nil
@@ -150,3 +163,13 @@ func getMysqlVer(buf []byte) (MYSQLD_TYPE, string) {
 	}
 	return MYSQLD_TYPE_UNKNOW, ""
 }
+
+// psParamSize returns sizeof(PS_PARAM) of the mysqld 8.0 release, 8.0.23
+// added name and name_length to it.
+func (this *MysqldConfig) psParamSize() uint64 {
+	var minor int
+	if _, err := fmt.Sscanf(this.versionInfo, "mysqld-8.0.%d", &minor); err == nil && minor < 23 {
+		return 32
+	}
+	return 48
+}
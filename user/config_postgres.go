@@ -5,6 +5,7 @@ Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
 package user
 
 import (
+	"fmt"
 	"os"
 	"strings"
 
@@ -15,15 +16,21 @@ type PostgresConfig struct {
 	eConfig
 	PostgresPath string `json:"postgresPath"`
 	FuncName     string `json:"funcName"`
+	Threshold    uint64 `json:"threshold"`   // 慢查询阈值，毫秒，0 为全部输出
+	QueryMaxLen  uint32 `json:"queryMaxLen"` // SQL 最大捕获长度
 }
 
 func NewPostgresConfig() *PostgresConfig {
-	config := &PostgresConfig{}
+	config := &PostgresConfig{QueryMaxLen: POSTGRES_MAX_DATA_SIZE}
 	return config
 }
 
 func (this *PostgresConfig) Check() error {
 
+	if this.QueryMaxLen == 0 || this.QueryMaxLen > POSTGRES_MAX_DATA_SIZE {
+		return errors.New(fmt.Sprintf("query max length must be in [1, %d].", POSTGRES_MAX_DATA_SIZE))
+	}
+
 	if this.PostgresPath == "" || len(strings.TrimSpace(this.PostgresPath)) <= 0 {
 		return errors.New("Postgres path cant be null.")
 	}
@@ -0,0 +1,50 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"errors"
+	"fmt"
+	"strings"
+)
+
+// TLS libraries share one module and one ebpf object, each library is only
+// probed if it is found.
+type TlsConfig struct {
+	eConfig
+	Openssl *OpensslConfig
+	Gnutls  *GnutlsConfig
+	Nspr    *NsprConfig
+
+	PcapFile string // write the plaintext to this pcapng file instead of printing it
+
+	// why a library is not probed, set by Check.
+	opensslErr, gnutlsErr, nsprErr error
+}
+
+func NewTlsConfig() *TlsConfig {
+	config := &TlsConfig{
+		Openssl: NewOpensslConfig(),
+		Gnutls:  NewGnutlsConfig(),
+		Nspr:    NewNsprConfig(),
+	}
+	return config
+}
+
+func (this *TlsConfig) Check() error {
+	this.opensslErr = this.Openssl.Check()
+	this.gnutlsErr = this.Gnutls.Check()
+	this.nsprErr = this.Nspr.Check()
+	if this.opensslErr == nil || this.gnutlsErr == nil || this.nsprErr == nil {
+		return nil
+	}
+
+	errs := []string{
+		fmt.Sprintf("openssl: %v", this.opensslErr),
+		fmt.Sprintf("gnutls: %v", this.gnutlsErr),
+		fmt.Sprintf("nspr: %v", this.nsprErr),
+	}
+	return errors.New(fmt.Sprintf("cant found any tls library, %s", strings.Join(errs, ", ")))
+}
@@ -0,0 +1,103 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"bufio"
+	"encoding/binary"
+	"encoding/hex"
+	"fmt"
+	"os"
+	"strconv"
+	"strings"
+)
+
+// socketAddrs maps socket inodes to their remote address, for a network
+// namespace.
+type socketAddrs map[uint64]connAddr
+
+// parseProcNetTcp adds the connected sockets of a /proc/net/tcp{,6} table to
+// addrs:
+//
+//	sl  local_address rem_address   st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode
+//	0: 0100007F:0277 0100007F:A3C2 01 00000000:00000000 00:00000000 00000000     0        0 31454 ...
+func parseProcNetTcp(path string, ipv6 bool, addrs socketAddrs) {
+	f, err := os.Open(path)
+	if err != nil {
+		return
+	}
+	defer f.Close()
+
+	scanner := bufio.NewScanner(f)
+	scanner.Scan() // header
+	for scanner.Scan() {
+		fields := strings.Fields(scanner.Text())
+		if len(fields) < 10 {
+			continue
+		}
+		addr, ok := parseProcNetAddr(fields[2], ipv6)
+		if !ok || addr.port == 0 {
+			// listening or not connected.
+			continue
+		}
+		inode, err := strconv.ParseUint(fields[9], 10, 64)
+		if err != nil || inode == 0 {
+			continue
+		}
+		addrs[inode] = addr
+	}
+}
+
+// parseProcNetAddr parses ADDR:PORT, ADDR is made of 32-bit words in host
+// byte order, PORT is in hex.
+func parseProcNetAddr(s string, ipv6 bool) (connAddr, bool) {
+	var addr connAddr
+	i := strings.IndexByte(s, ':')
+	if i < 0 {
+		return addr, false
+	}
+	port, err := strconv.ParseUint(s[i+1:], 16, 16)
+	if err != nil {
+		return addr, false
+	}
+	addr.port = uint16(port)
+
+	var raw [16]byte
+	n, err := hex.Decode(raw[:], []byte(s[:i]))
+	if err != nil || (ipv6 && n != 16) || (!ipv6 && n != 4) {
+		return addr, false
+	}
+	for w := 0; w < n; w += 4 {
+		// the hex text is the big endian dump of a host order word.
+		binary.LittleEndian.PutUint32(addr.ip[w:], binary.BigEndian.Uint32(raw[w:]))
+	}
+	addr.ipv6 = ipv6
+	return addr, true
+}
+
+// socketInode returns the inode of the socket the fd link points to:
+// socket:[31454]
+func socketInode(link string) (uint64, bool) {
+	target, err := os.Readlink(link)
+	if err != nil || !strings.HasPrefix(target, "socket:[") || !strings.HasSuffix(target, "]") {
+		return 0, false
+	}
+	inode, err := strconv.ParseUint(target[len("socket:["):len(target)-1], 10, 64)
+	return inode, err == nil
+}
+
+// resolveConn returns the remote address of the socket fd of pid, from
+// /proc/<pid>/fd and /proc/<pid>/net/tcp{,6}.
+func resolveConn(pid, fd uint32) (connAddr, bool) {
+	inode, ok := socketInode(fmt.Sprintf("/proc/%d/fd/%d", pid, fd))
+	if !ok {
+		return connAddr{}, false
+	}
+	addrs := make(socketAddrs)
+	parseProcNetTcp(fmt.Sprintf("/proc/%d/net/tcp", pid), false, addrs)
+	parseProcNetTcp(fmt.Sprintf("/proc/%d/net/tcp6", pid), true, addrs)
+	addr, found := addrs[inode]
+	return addr, found
+}
@@ -0,0 +1,123 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"fmt"
+	"os"
+	"runtime"
+	"strconv"
+	"sync"
+)
+
+// netnsSockets parses /proc/<pid>/net/tcp{,6} once per network namespace.
+type netnsSockets struct {
+	lock sync.Mutex
+	ns   map[string]*netnsEntry
+}
+
+type netnsEntry struct {
+	once  sync.Once
+	addrs socketAddrs
+}
+
+func (this *netnsSockets) get(pid uint32) socketAddrs {
+	ns, err := os.Readlink(fmt.Sprintf("/proc/%d/ns/net", pid))
+	if err != nil {
+		// no access to the namespace, parse the tables of the process.
+		ns = fmt.Sprintf("pid:%d", pid)
+	}
+	this.lock.Lock()
+	entry, found := this.ns[ns]
+	if !found {
+		entry = &netnsEntry{}
+		this.ns[ns] = entry
+	}
+	this.lock.Unlock()
+
+	entry.once.Do(func() {
+		entry.addrs = make(socketAddrs)
+		parseProcNetTcp(fmt.Sprintf("/proc/%d/net/tcp", pid), false, entry.addrs)
+		parseProcNetTcp(fmt.Sprintf("/proc/%d/net/tcp6", pid), true, entry.addrs)
+	})
+	return entry.addrs
+}
+
+// seedConns adds the connected sockets of the target processes to the
+// connection table, for the connections opened before eCapture started.
+// Processes are walked in parallel. It returns the number of sockets added.
+func (this *MOpenSSLProbe) seedConns() int {
+	var pids []uint32
+	switch {
+	case this.conf.GetPid() == 0:
+		entries, err := os.ReadDir("/proc")
+		if err != nil {
+			return 0
+		}
+		for _, entry := range entries {
+			if pid, err := strconv.ParseUint(entry.Name(), 10, 32); err == nil {
+				pids = append(pids, uint32(pid))
+			}
+		}
+	case this.conf.GetPidTree():
+		pids = processTree(uint32(this.conf.GetPid()))
+	default:
+		pids = []uint32{uint32(this.conf.GetPid())}
+	}
+
+	namespaces := &netnsSockets{ns: make(map[string]*netnsEntry)}
+	work := make(chan uint32)
+	var wg sync.WaitGroup
+	var total int64
+	var totalLock sync.Mutex
+	for i := 0; i < runtime.NumCPU(); i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			var n int64
+			for pid := range work {
+				n += int64(this.seedPidConns(pid, namespaces))
+			}
+			totalLock.Lock()
+			total += n
+			totalLock.Unlock()
+		}()
+	}
+	for _, pid := range pids {
+		work <- pid
+	}
+	close(work)
+	wg.Wait()
+	return int(total)
+}
+
+func (this *MOpenSSLProbe) seedPidConns(pid uint32, namespaces *netnsSockets) int {
+	dir := fmt.Sprintf("/proc/%d/fd", pid)
+	entries, err := os.ReadDir(dir)
+	if err != nil {
+		return 0
+	}
+
+	var addrs socketAddrs
+	var n int
+	for _, entry := range entries {
+		inode, ok := socketInode(dir + "/" + entry.Name())
+		if !ok {
+			continue
+		}
+		fd, err := strconv.ParseUint(entry.Name(), 10, 32)
+		if err != nil {
+			continue
+		}
+		if addrs == nil {
+			addrs = namespaces.get(pid)
+		}
+		if addr, found := addrs[inode]; found {
+			this.AddConn(pid, uint32(fd), addr)
+			n++
+		}
+	}
+	return n
+}
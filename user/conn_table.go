@@ -0,0 +1,221 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"context"
+	"encoding/binary"
+	"net"
+	"strconv"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+const (
+	CONN_TABLE_SHARDS = 64
+
+	// connections not looked up for this long are evicted, see resolveConn.
+	CONN_TABLE_TTL   = 30 * time.Minute
+	CONN_TABLE_SWEEP = time.Minute
+
+	// a socket missing from the table is resolved from /proc at most once
+	// per interval.
+	CONN_RESOLVE_INTERVAL = time.Minute
+)
+
+// connAddr is a remote address in binary form, formatted only when printed.
+type connAddr struct {
+	ip   [net.IPv6len]byte
+	ipv6 bool
+	port uint16
+}
+
+// newConnAddrV4 builds a connAddr from sockaddr_in.sa_data: port then IPv4
+// address, both in network byte order.
+func newConnAddrV4(saData []byte) connAddr {
+	var addr connAddr
+	addr.port = binary.BigEndian.Uint16(saData[0:2])
+	copy(addr.ip[:net.IPv4len], saData[2:6])
+	return addr
+}
+
+func (this connAddr) String() string {
+	var ip net.IP
+	if this.ipv6 {
+		ip = net.IP(this.ip[:])
+	} else {
+		ip = net.IPv4(this.ip[0], this.ip[1], this.ip[2], this.ip[3])
+	}
+	return net.JoinHostPort(ip.String(), strconv.Itoa(int(this.port)))
+}
+
+// AppendTo appends the address formatted as String does.
+func (this connAddr) AppendTo(dst []byte) []byte {
+	if this.ipv6 {
+		return append(dst, this.String()...)
+	}
+	for i := 0; i < net.IPv4len; i++ {
+		if i > 0 {
+			dst = append(dst, '.')
+		}
+		dst = strconv.AppendUint(dst, uint64(this.ip[i]), 10)
+	}
+	dst = append(dst, ':')
+	return strconv.AppendUint(dst, uint64(this.port), 10)
+}
+
+type connKey struct {
+	pid uint32
+	fd  uint32
+}
+
+type connEntry struct {
+	addr     connAddr
+	gen      uint64 // generation of the table when it was added
+	lastSeen int64  // unix nano, atomic
+}
+
+// connTable maps (pid, fd) to the remote address of the socket.
+//
+// Lookups are lock-free: every shard is a sync.Map, which serves stable keys
+// without locking, writers of a shard take its lock. A process exit does not walk the table, it records the
+// current generation for the pid instead, and entries added before it are
+// stale. A background sweep drops stale entries, and those not looked up for
+// CONN_TABLE_TTL, so that the table does not grow forever; an open
+// connection evicted that way is resolved again on its next lookup.
+type connTable struct {
+	shards   [CONN_TABLE_SHARDS]connShard
+	exits    sync.Map // pid -> generation of its last exit
+	resolves sync.Map // connKey -> unix nano of the last resolve attempt
+	gen      uint64   // atomic
+	size     int64    // atomic
+}
+
+type connShard struct {
+	lock  sync.Mutex
+	conns sync.Map // connKey -> *connEntry
+}
+
+func (this *connTable) shard(key connKey) *connShard {
+	return &this.shards[(key.pid*31+key.fd)%CONN_TABLE_SHARDS]
+}
+
+func (this *connTable) Add(pid, fd uint32, addr connAddr) {
+	key := connKey{pid: pid, fd: fd}
+	entry := &connEntry{
+		addr:     addr,
+		gen:      atomic.LoadUint64(&this.gen),
+		lastSeen: time.Now().UnixNano(),
+	}
+	shard := this.shard(key)
+	shard.lock.Lock()
+	if _, found := shard.conns.Load(key); !found {
+		atomic.AddInt64(&this.size, 1)
+	}
+	shard.conns.Store(key, entry)
+	shard.lock.Unlock()
+}
+
+func (this *connTable) Get(pid, fd uint32) (connAddr, bool) {
+	key := connKey{pid: pid, fd: fd}
+	v, found := this.shard(key).conns.Load(key)
+	if !found {
+		return connAddr{}, false
+	}
+	entry := v.(*connEntry)
+	if this.stale(pid, entry) {
+		return connAddr{}, false
+	}
+	atomic.StoreInt64(&entry.lastSeen, time.Now().UnixNano())
+	return entry.addr, true
+}
+
+// tryResolve reports whether the socket fd of pid, missing from the table,
+// should be resolved from /proc now.
+func (this *connTable) tryResolve(pid, fd uint32, now time.Time) bool {
+	key := connKey{pid: pid, fd: fd}
+	if last, found := this.resolves.Load(key); found && now.UnixNano()-last.(int64) < int64(CONN_RESOLVE_INTERVAL) {
+		return false
+	}
+	this.resolves.Store(key, now.UnixNano())
+	return true
+}
+
+// Del forgets the socket fd of pid.
+func (this *connTable) Del(pid, fd uint32) {
+	key := connKey{pid: pid, fd: fd}
+	shard := this.shard(key)
+	shard.lock.Lock()
+	if _, found := shard.conns.Load(key); found {
+		shard.conns.Delete(key)
+		atomic.AddInt64(&this.size, -1)
+	}
+	shard.lock.Unlock()
+}
+
+// Exit forgets every socket of pid.
+func (this *connTable) Exit(pid uint32) {
+	this.exits.Store(pid, atomic.AddUint64(&this.gen, 1))
+}
+
+func (this *connTable) Len() int {
+	return int(atomic.LoadInt64(&this.size))
+}
+
+// stale reports whether entry was added before pid exited.
+func (this *connTable) stale(pid uint32, entry *connEntry) bool {
+	exit, found := this.exits.Load(pid)
+	return found && entry.gen < exit.(uint64)
+}
+
+// sweep drops the stale and expired entries.
+func (this *connTable) sweep(now time.Time) {
+	start := atomic.LoadUint64(&this.gen)
+	deadline := now.Add(-CONN_TABLE_TTL).UnixNano()
+	for i := range this.shards {
+		shard := &this.shards[i]
+		shard.conns.Range(func(k, v interface{}) bool {
+			key, entry := k.(connKey), v.(*connEntry)
+			if !this.stale(key.pid, entry) && atomic.LoadInt64(&entry.lastSeen) >= deadline {
+				return true
+			}
+			shard.lock.Lock()
+			// unless it was replaced meanwhile.
+			if cur, found := shard.conns.Load(key); found && cur == entry {
+				shard.conns.Delete(key)
+				atomic.AddInt64(&this.size, -1)
+			}
+			shard.lock.Unlock()
+			return true
+		})
+	}
+	this.resolves.Range(func(key, last interface{}) bool {
+		if now.UnixNano()-last.(int64) >= int64(CONN_RESOLVE_INTERVAL) {
+			this.resolves.Delete(key)
+		}
+		return true
+	})
+	// entries older than these exits are all gone now.
+	this.exits.Range(func(pid, exit interface{}) bool {
+		if exit.(uint64) <= start {
+			this.exits.Delete(pid)
+		}
+		return true
+	})
+}
+
+func (this *connTable) run(ctx context.Context) {
+	ticker := time.NewTicker(CONN_TABLE_SWEEP)
+	defer ticker.Stop()
+	for {
+		select {
+		case _ = <-ctx.Done():
+			return
+		case now := <-ticker.C:
+			this.sweep(now)
+		}
+	}
+}
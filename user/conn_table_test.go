@@ -0,0 +1,103 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"net"
+	"os"
+	"testing"
+	"time"
+)
+
+// Lookups keep a connection in the table, a connection without any lookup
+// for CONN_TABLE_TTL is evicted.
+func TestConnTableSweep(t *testing.T) {
+	var conns connTable
+	addr := newConnAddrV4([]byte{0x01, 0xbb, 10, 0, 0, 1})
+	conns.Add(1000, 3, addr)
+	conns.Add(1000, 4, addr)
+
+	conns.Get(1000, 3)
+	conns.sweep(time.Now().Add(CONN_TABLE_TTL / 2))
+	if conns.Len() != 2 {
+		t.Fatalf("%d connections after the sweep, want 2", conns.Len())
+	}
+	conns.sweep(time.Now().Add(CONN_TABLE_TTL + time.Second))
+	if conns.Len() != 0 {
+		t.Fatalf("%d connections after the TTL, want 0", conns.Len())
+	}
+}
+
+func TestConnTableTryResolve(t *testing.T) {
+	var conns connTable
+	now := time.Now()
+	if !conns.tryResolve(1000, 3, now) {
+		t.Fatal("first attempt refused")
+	}
+	if conns.tryResolve(1000, 3, now.Add(CONN_RESOLVE_INTERVAL/2)) {
+		t.Fatal("second attempt within CONN_RESOLVE_INTERVAL allowed")
+	}
+	if !conns.tryResolve(1000, 4, now) {
+		t.Fatal("attempt for another fd refused")
+	}
+	if !conns.tryResolve(1000, 3, now.Add(CONN_RESOLVE_INTERVAL)) {
+		t.Fatal("attempt after CONN_RESOLVE_INTERVAL refused")
+	}
+}
+
+// resolveConn finds the remote address of a socket of this process.
+func TestResolveConn(t *testing.T) {
+	ln, err := net.Listen("tcp4", "127.0.0.1:0")
+	if err != nil {
+		t.Skip(err)
+	}
+	defer ln.Close()
+	c, err := net.Dial("tcp4", ln.Addr().String())
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer c.Close()
+	f, err := c.(*net.TCPConn).File()
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer f.Close()
+
+	addr, found := resolveConn(uint32(os.Getpid()), uint32(f.Fd()))
+	if !found {
+		t.Fatal("connection not resolved")
+	}
+	if addr.String() != ln.Addr().String() {
+		t.Fatalf("resolved %s, want %s", addr, ln.Addr())
+	}
+	if _, found = resolveConn(uint32(os.Getpid()), 0); found {
+		t.Fatal("resolved stdin")
+	}
+}
+
+// gnutls and nspr events have no fd, their connection is never looked up.
+func TestSSLDataEventConn(t *testing.T) {
+	m := &MOpenSSLProbe{}
+	addr := newConnAddrV4([]byte{0x01, 0xbb, 10, 0, 0, 1})
+	m.AddConn(1000, 0, addr)
+	m.AddConn(1000, 5, addr)
+
+	for _, c := range []struct {
+		library uint8
+		fd      uint32
+		found   bool
+	}{
+		{TLS_LIBRARY_OPENSSL, 5, true},
+		{TLS_LIBRARY_OPENSSL, 0, false},
+		{TLS_LIBRARY_GNUTLS, 0, false},
+		{TLS_LIBRARY_NSPR, 5, false},
+	} {
+		e := &SSLDataEvent{module: m, Library: c.library}
+		e.Pid, e.ConnKey = 1000, c.fd
+		if _, found := e.conn(); found != c.found {
+			t.Errorf("library %d, fd %d: found %v, want %v", c.library, c.fd, found, c.found)
+		}
+	}
+}
@@ -12,8 +12,6 @@ const (
 	MODULE_NAME_MYSQLD   = "EBPFProbeMysqld"
 	MODULE_NAME_POSTGRES = "EBPFProbePostgres"
 	MODULE_NAME_OPENSSL  = "EBPFProbeOPENSSL"
-	MODULE_NAME_GNUTLS   = "EBPFProbeGNUTLS"
-	MODULE_NAME_NSPR     = "EBPFProbeNSPR"
 )
 
 const (
@@ -1,57 +1,152 @@
 package user
 
 import (
-	"bytes"
 	"encoding/binary"
 	"fmt"
-
-	"golang.org/x/sys/unix"
+	"strconv"
 )
 
 /*
- u32 pid;
- u8 line[MAX_DATE_SIZE_BASH];
+ struct event_header_t header;
  u32 retval;
- char comm[TASK_COMM_LEN];
+ u32 sid;
+ u32 loginuid;
+ char tty[TTY_NAME_LEN];
+ u8 line[MAX_DATA_SIZE_BASH]; // only the captured bytes are sent
 */
 
-const MAX_DATA_SIZE_BASH = 256
+const MAX_DATA_SIZE_BASH = 1024 * 4
+
+const TTY_NAME_LEN = 16
+
+// retval, sid, loginuid and tty
+const BASH_BODY_FIXED_SIZE = 4 + 4 + 4 + TTY_NAME_LEN
+
+// KERNEL_EVENT_BASH_RETVAL events only carry retval
+const BASH_RETVAL_BODY_SIZE = 4
 
+// loginuid of processes not started by a login
+const BASH_LOGINUID_UNSET = 0xFFFFFFFF
+
+// A line is sent when readline returns, its retval in a later
+// KERNEL_EVENT_BASH_RETVAL event. The module pairs them, see
+// MBashProbe.Dispatcher.
 type bashEvent struct {
 	module     IModule
 	event_type EVENT_TYPE
-	Pid        uint32
-	Line       [MAX_DATA_SIZE_BASH]uint8
-	Retval     uint32
-	Comm       [16]byte
+	EventHeader
+	Retval   uint32
+	Sid      uint32
+	LoginUid uint32
+	Tty      string
+	Line     []uint8
+	Executed bool   // the retval of the line was received
+	Cwd      string // read from /proc when the line is received
+	Comm     string // idem, the line may be printed after the shell exited
 }
 
-func (this *bashEvent) Decode(payload []byte) (err error) {
-	buf := bytes.NewBuffer(payload)
-	if err = binary.Read(buf, binary.LittleEndian, &this.Pid); err != nil {
-		return
+// comm returns the command name of the shell.
+func (this *bashEvent) comm() string {
+	if this.Comm != "" {
+		return this.Comm
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Line); err != nil {
+	return processes.Comm(this.Pid)
+}
+
+func (this *bashEvent) Decode(payload []byte) (err error) {
+	var body []byte
+	if body, err = this.EventHeader.Decode(payload); err != nil {
 		return
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Retval); err != nil {
-		return
+	this.Executed = false
+	if this.Type == KERNEL_EVENT_BASH_RETVAL {
+		if len(body) < BASH_RETVAL_BODY_SIZE {
+			return fmt.Errorf("bash retval event body too short: %d bytes", len(body))
+		}
+		this.Retval = binary.LittleEndian.Uint32(body[0:4])
+		return nil
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Comm); err != nil {
-		return
+	if len(body) < BASH_BODY_FIXED_SIZE {
+		return fmt.Errorf("bash event body too short: %d bytes", len(body))
 	}
-
+	this.Retval = binary.LittleEndian.Uint32(body[0:4])
+	this.Sid = binary.LittleEndian.Uint32(body[4:8])
+	this.LoginUid = binary.LittleEndian.Uint32(body[8:12])
+	setString(&this.Tty, body[12:12+TTY_NAME_LEN])
+	this.Line = body[BASH_BODY_FIXED_SIZE:]
 	return nil
 }
 
 func (this *bashEvent) String() string {
-	s := fmt.Sprintf(fmt.Sprintf(" PID:%d, \tComm:%s, \tRetvalue:%d, \tLine:\n%s", this.Pid, this.Comm, this.Retval, unix.ByteSliceToString((this.Line[:]))))
-	return s
+	return string(this.AppendString(nil))
 }
 
 func (this *bashEvent) StringHex() string {
-	s := fmt.Sprintf(fmt.Sprintf(" PID:%d, \tComm:%s, \tRetvalue:%d, \tLine:\n%s,", this.Pid, this.Comm, this.Retval, dumpByteSlice([]byte(unix.ByteSliceToString((this.Line[:]))), "")))
-	return s
+	return string(this.AppendStringHex(nil))
+}
+
+// appendHead appends what String and StringHex print before the line.
+func (this *bashEvent) appendHead(dst []byte) []byte {
+	dst = append(dst, " PID:"...)
+	dst = strconv.AppendUint(dst, uint64(this.Pid), 10)
+	dst = append(dst, ", \tComm:"...)
+	dst = append(dst, this.comm()...)
+	dst = append(dst, ", \tSid:"...)
+	dst = strconv.AppendUint(dst, uint64(this.Sid), 10)
+	dst = append(dst, ", \tTty:"...)
+	dst = append(dst, this.Tty...)
+	dst = append(dst, ", \tLoginUid:"...)
+	if this.LoginUid == BASH_LOGINUID_UNSET {
+		dst = append(dst, "N/A"...)
+	} else {
+		dst = strconv.AppendUint(dst, uint64(this.LoginUid), 10)
+	}
+	dst = append(dst, ", \tCwd:"...)
+	dst = append(dst, this.Cwd...)
+	dst = append(dst, ", \tRetvalue:"...)
+	if this.Executed {
+		dst = strconv.AppendUint(dst, uint64(this.Retval), 10)
+	} else {
+		dst = append(dst, "N/A"...)
+	}
+	return append(dst, ", \tLine:\n"...)
+}
+
+func (this *bashEvent) AppendString(dst []byte) []byte {
+	return append(this.appendHead(dst), trimNul(this.Line)...)
+}
+
+func (this *bashEvent) AppendStringHex(dst []byte) []byte {
+	dst = appendHexDump(this.appendHead(dst), trimNul(this.Line), "")
+	return append(dst, ',')
+}
+
+func (this *bashEvent) AppendJSON(dst []byte) []byte {
+	dst = appendJSONHeader(dst, &this.EventHeader, this.comm())
+	dst = appendJSONUint(dst, "sid", uint64(this.Sid))
+	dst = appendJSONField(dst, "tty", this.Tty)
+	dst = appendJSONLoginUid(dst, this.LoginUid)
+	dst = appendJSONField(dst, "cwd", this.Cwd)
+	dst = appendJSONRetval(dst, this.Executed, this.Retval)
+	dst = appendJSONPayload(dst, "line", trimNul(this.Line))
+	return append(dst, '}')
+}
+
+// appendJSONLoginUid appends the "loginuid" field, null if unset.
+func appendJSONLoginUid(dst []byte, loginUid uint32) []byte {
+	if loginUid == BASH_LOGINUID_UNSET {
+		return append(appendJSONKey(dst, "loginuid"), "null"...)
+	}
+	return appendJSONUint(dst, "loginuid", uint64(loginUid))
+}
+
+// appendJSONRetval appends the "retval" field, null if the line was not
+// executed.
+func appendJSONRetval(dst []byte, executed bool, retval uint32) []byte {
+	if !executed {
+		return append(appendJSONKey(dst, "retval"), "null"...)
+	}
+	return appendJSONInt(dst, "retval", int64(int32(retval)))
 }
 
 func (this *bashEvent) SetModule(module IModule) {
@@ -65,7 +160,7 @@ func (this *bashEvent) Module() IModule {
 func (this *bashEvent) Clone() IEventStruct {
 	event := new(bashEvent)
 	event.module = this.module
-	event.event_type = EVENT_TYPE_OUTPUT
+	event.event_type = EVENT_TYPE_MODULE_DATA
 	return event
 }
 
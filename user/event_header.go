@@ -0,0 +1,122 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"strconv"
+)
+
+// EVENT_HEADER_VERSION must match EVENT_HEADER_VERSION in kern/common.h
+const EVENT_HEADER_VERSION = 1
+
+// EVENT_HEADER_SIZE is sizeof(struct event_header_t)
+const EVENT_HEADER_SIZE = 32
+
+type KERNEL_EVENT_TYPE uint8
+
+// enum event_type in kern/common.h
+const (
+	KERNEL_EVENT_TLS_READ KERNEL_EVENT_TYPE = iota + 1
+	KERNEL_EVENT_TLS_WRITE
+	KERNEL_EVENT_CONNECT
+	KERNEL_EVENT_BASH
+	KERNEL_EVENT_MYSQLD
+	KERNEL_EVENT_POSTGRES
+	KERNEL_EVENT_PROCESS_EXEC
+	KERNEL_EVENT_PROCESS_FORK
+	KERNEL_EVENT_PROCESS_EXIT
+	KERNEL_EVENT_BASH_RETVAL
+)
+
+var kernelEventNames = [...]string{
+	KERNEL_EVENT_TLS_READ:     "tls_read",
+	KERNEL_EVENT_TLS_WRITE:    "tls_write",
+	KERNEL_EVENT_CONNECT:      "connect",
+	KERNEL_EVENT_BASH:         "bash",
+	KERNEL_EVENT_MYSQLD:       "mysqld",
+	KERNEL_EVENT_POSTGRES:     "postgres",
+	KERNEL_EVENT_PROCESS_EXEC: "exec",
+	KERNEL_EVENT_PROCESS_FORK: "fork",
+	KERNEL_EVENT_PROCESS_EXIT: "exit",
+	KERNEL_EVENT_BASH_RETVAL:  "bash_retval",
+}
+
+func (this KERNEL_EVENT_TYPE) String() string {
+	if int(this) < len(kernelEventNames) && kernelEventNames[this] != "" {
+		return kernelEventNames[this]
+	}
+	return "unknow_" + strconv.Itoa(int(this))
+}
+
+/*
+struct event_header_t {
+    u8 type;
+    u8 version;
+    u16 len;
+    u32 conn_key;
+    u64 timestamp_ns;
+    u32 pid;
+    u32 tid;
+    u64 cgroup_id;
+} __attribute__((packed));
+*/
+type EventHeader struct {
+	Type        KERNEL_EVENT_TYPE
+	Version     uint8
+	Len         uint16
+	ConnKey     uint32
+	TimestampNs uint64
+	Pid         uint32
+	Tid         uint32
+	CgroupId    uint64
+}
+
+// Decode decodes the common header of a kernel event, and returns its body.
+// The body is sliced from payload, not copied.
+func (this *EventHeader) Decode(payload []byte) (body []byte, err error) {
+	if len(payload) < EVENT_HEADER_SIZE {
+		return nil, fmt.Errorf("event too short: %d bytes, header needs %d", len(payload), EVENT_HEADER_SIZE)
+	}
+	// fixed offsets of struct event_header_t, binary.Read would go through
+	// reflection and allocate for every event.
+	this.Type = KERNEL_EVENT_TYPE(payload[0])
+	this.Version = payload[1]
+	this.Len = binary.LittleEndian.Uint16(payload[2:4])
+	this.ConnKey = binary.LittleEndian.Uint32(payload[4:8])
+	this.TimestampNs = binary.LittleEndian.Uint64(payload[8:16])
+	this.Pid = binary.LittleEndian.Uint32(payload[16:20])
+	this.Tid = binary.LittleEndian.Uint32(payload[20:24])
+	this.CgroupId = binary.LittleEndian.Uint64(payload[24:32])
+	if this.Version != EVENT_HEADER_VERSION {
+		return nil, fmt.Errorf("unsupported event header version:%d, want:%d", this.Version, EVENT_HEADER_VERSION)
+	}
+	end := EVENT_HEADER_SIZE + int(this.Len)
+	if len(payload) < end {
+		return nil, fmt.Errorf("event body truncated: %d bytes, header says %d", len(payload)-EVENT_HEADER_SIZE, this.Len)
+	}
+	return payload[EVENT_HEADER_SIZE:end], nil
+}
+
+// setString sets *s to the NUL terminated string in b. Events are reused by
+// their pools, and a field like a tty or a statement name rarely changes from
+// one event to the next: it is only allocated when it does.
+func setString(s *string, b []byte) {
+	b = trimNul(b)
+	if *s != string(b) {
+		*s = string(b)
+	}
+}
+
+// trimNul returns b up to its first NUL, like unix.ByteSliceToString but
+// without the copy.
+func trimNul(b []byte) []byte {
+	if i := bytes.IndexByte(b, 0); i >= 0 {
+		return b[:i]
+	}
+	return b
+}
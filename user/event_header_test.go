@@ -0,0 +1,182 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"encoding/binary"
+	"encoding/json"
+	"fmt"
+	"strings"
+	"testing"
+)
+
+// testPayload returns a raw event of type t with body, as read from a perf
+// buffer.
+func testPayload(t KERNEL_EVENT_TYPE, body []byte) []byte {
+	payload := make([]byte, EVENT_HEADER_SIZE, EVENT_HEADER_SIZE+len(body))
+	payload[0] = uint8(t)
+	payload[1] = EVENT_HEADER_VERSION
+	binary.LittleEndian.PutUint16(payload[2:4], uint16(len(body)))
+	binary.LittleEndian.PutUint32(payload[4:8], 7)
+	binary.LittleEndian.PutUint64(payload[8:16], 123456789)
+	binary.LittleEndian.PutUint32(payload[16:20], 1000)
+	binary.LittleEndian.PutUint32(payload[20:24], 1001)
+	binary.LittleEndian.PutUint64(payload[24:32], 42)
+	return append(payload, body...)
+}
+
+func testTlsPayload() []byte {
+	body := make([]byte, TLS_BODY_FIXED_SIZE, TLS_BODY_FIXED_SIZE+256)
+	body[0] = TLS_LIBRARY_OPENSSL
+	for i := 0; i < 256; i++ {
+		body = append(body, 'a')
+	}
+	return testPayload(KERNEL_EVENT_TLS_WRITE, body)
+}
+
+func testConnectPayload() []byte {
+	body := make([]byte, SA_DATA_LEN)
+	binary.BigEndian.PutUint16(body[0:2], 443)
+	copy(body[2:6], []byte{10, 0, 0, 1})
+	return testPayload(KERNEL_EVENT_CONNECT, body)
+}
+
+func testBashPayload() []byte {
+	body := make([]byte, BASH_BODY_FIXED_SIZE)
+	binary.LittleEndian.PutUint32(body[4:8], 1000)
+	copy(body[12:], "pts/0")
+	body = append(body, "ls -al /tmp\x00"...)
+	return testPayload(KERNEL_EVENT_BASH, body)
+}
+
+func testMysqldPayload() []byte {
+	body := make([]byte, MYSQLD_BODY_FIXED_SIZE)
+	body[12] = COM_STMT_EXECUTE
+	for i := 0; i < 4; i++ {
+		param := make([]byte, MYSQL80_PARAM_SIZE)
+		binary.LittleEndian.PutUint32(param[4:8], 3)
+		copy(param[8:], "abc")
+		body = append(body, param...)
+	}
+	binary.LittleEndian.PutUint64(body[0:8], 4)
+	return testPayload(KERNEL_EVENT_MYSQLD, body)
+}
+
+func testPostgresPayload() []byte {
+	body := make([]byte, POSTGRES_BODY_FIXED_SIZE)
+	body[8] = PG_SIMPLE_QUERY
+	copy(body[9:], "stmt_1")
+	body = append(body, "select 1\x00"...)
+	return testPayload(KERNEL_EVENT_POSTGRES, body)
+}
+
+func testProcessPayload() []byte {
+	body := make([]byte, PROCESS_BODY_FIXED_SIZE+MAX_PATH_SIZE+MAX_CMDLINE_SIZE)
+	copy(body, "curl")
+	copy(body[PROCESS_BODY_FIXED_SIZE:], "/usr/bin/curl")
+	copy(body[PROCESS_BODY_FIXED_SIZE+MAX_PATH_SIZE:], "curl\x00-v\x00https://example.com\x00")
+	return testPayload(KERNEL_EVENT_PROCESS_EXEC, body)
+}
+
+var testDecoders = []struct {
+	name    string
+	event   IEventStruct
+	payload []byte
+}{
+	{"tls", &SSLDataEvent{}, testTlsPayload()},
+	{"connect", &ConnDataEvent{}, testConnectPayload()},
+	{"bash", &bashEvent{}, testBashPayload()},
+	{"mysqld", &mysqldEvent{}, testMysqldPayload()},
+	{"postgres", &postgresEvent{}, testPostgresPayload()},
+	{"process", &ProcessEvent{}, testProcessPayload()},
+}
+
+func TestEventHeaderDecode(t *testing.T) {
+	var h EventHeader
+	body, err := h.Decode(testPayload(KERNEL_EVENT_BASH, []byte("body")))
+	if err != nil {
+		t.Fatal(err)
+	}
+	want := EventHeader{Type: KERNEL_EVENT_BASH, Version: EVENT_HEADER_VERSION, Len: 4, ConnKey: 7, TimestampNs: 123456789, Pid: 1000, Tid: 1001, CgroupId: 42}
+	if h != want {
+		t.Fatalf("header %+v, want %+v", h, want)
+	}
+	if string(body) != "body" {
+		t.Fatalf("body %q, want %q", body, "body")
+	}
+	if _, err = h.Decode(testPayload(KERNEL_EVENT_BASH, []byte("body"))[:EVENT_HEADER_SIZE+2]); err == nil {
+		t.Fatal("truncated body decoded")
+	}
+}
+
+// Decoding an event into a reused struct must not allocate, events are
+// recycled by their pools.
+func TestDecodeAllocs(t *testing.T) {
+	for _, d := range testDecoders {
+		if err := d.event.Decode(d.payload); err != nil {
+			t.Fatalf("%s: %v", d.name, err)
+		}
+		allocs := testing.AllocsPerRun(1000, func() {
+			d.event.Decode(d.payload)
+		})
+		if allocs != 0 {
+			t.Errorf("%s: %v allocations per decoded event, want 0", d.name, allocs)
+		}
+	}
+}
+
+func BenchmarkEventHeaderDecode(b *testing.B) {
+	var h EventHeader
+	payload := testTlsPayload()
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		h.Decode(payload)
+	}
+}
+
+func BenchmarkDecode(b *testing.B) {
+	for _, d := range testDecoders {
+		b.Run(d.name, func(b *testing.B) {
+			b.ReportAllocs()
+			b.SetBytes(int64(len(d.payload)))
+			for i := 0; i < b.N; i++ {
+				d.event.Decode(d.payload)
+			}
+		})
+	}
+}
+
+// The heads of the query events, formatted in the sink of the pipeline, are
+// the prefixes fmt formatted, their JSON stays valid.
+func TestQueryEventHead(t *testing.T) {
+	var m mysqldEvent
+	if err := m.Decode(testMysqldPayload()); err != nil {
+		t.Fatal(err)
+	}
+	var p postgresEvent
+	if err := p.Decode(testPostgresPayload()); err != nil {
+		t.Fatal(err)
+	}
+	for _, c := range []struct {
+		event interface {
+			IEventStruct
+			orderedAppender
+		}
+		head string
+	}{
+		{&m, fmt.Sprintf(" PID:%d, TID:%d, Comm:%s, ConnID:%d, Time:%d, ", m.Pid, m.Tid, processes.Comm(m.Pid), m.ConnKey, m.TimestampNs)},
+		{&p, fmt.Sprintf(" PID: %d, Comm: %s, Time: %d, ", p.Pid, processes.Comm(p.Pid), p.TimestampNs)},
+	} {
+		if got := string(c.event.appendHead(nil, false)); got != c.head {
+			t.Errorf("head %q, want %q", got, c.head)
+		}
+		if s := c.event.String(); !strings.HasPrefix(s, c.head) {
+			t.Errorf("String %q, want the prefix %q", s, c.head)
+		}
+		if b := c.event.AppendJSON(nil); !json.Valid(b) {
+			t.Errorf("invalid JSON %s", b)
+		}
+	}
+}
@@ -5,22 +5,106 @@ Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
 package user
 
 import (
-	"bytes"
 	"encoding/binary"
 	"fmt"
+	"math"
+	"strconv"
+	"strings"
 
 	"golang.org/x/sys/unix"
 )
 
 /*
-   u64 pid;
-   u64 timestamp;
-   char query[MAX_DATA_SIZE];
+   struct event_header_t header; // header.conn_key is the THD connection id
    u64 alllen;
-   u64 len;
-   char comm[TASK_COMM_LEN];
+   u32 stmt_id;
+   u8 command;
+   s8 retval;
+   char query[MAX_DATA_SIZE_MYSQL]; // only the captured bytes are sent
 */
-const MYSQLD_MAX_DATA_SIZE = 256
+const MYSQLD_MAX_DATA_SIZE = 1024*32 - 64
+
+// alllen, stmt_id, command and retval
+const MYSQLD_BODY_FIXED_SIZE = 8 + 4 + 1 + 1
+
+// enum_server_command
+const (
+	COM_QUERY        = 3
+	COM_STMT_PREPARE = 22
+	COM_STMT_EXECUTE = 23
+	COM_STMT_CLOSE   = 25
+)
+
+/*
+struct stmt_param_t {
+    u8 null_bit;
+    u8 type;
+    u8 unsigned_type;
+    u8 reserved;
+    u32 length;
+    char value[MYSQL80_PARAM_VALUE_SIZE];
+};
+*/
+const MYSQL80_PARAM_VALUE_SIZE = 32
+const MYSQL80_PARAM_SIZE = 8 + MYSQL80_PARAM_VALUE_SIZE
+
+// enum_field_types
+const (
+	MYSQL_TYPE_TINY     = 1
+	MYSQL_TYPE_SHORT    = 2
+	MYSQL_TYPE_LONG     = 3
+	MYSQL_TYPE_FLOAT    = 4
+	MYSQL_TYPE_DOUBLE   = 5
+	MYSQL_TYPE_LONGLONG = 8
+	MYSQL_TYPE_YEAR     = 13
+)
+
+type mysqldStmtParam struct {
+	Null         bool
+	Type         uint8
+	UnsignedType bool
+	Length       uint32 // origin value length
+	Value        []byte // at most MYSQL80_PARAM_VALUE_SIZE bytes
+}
+
+// String formats the binary protocol value, strings and the other types are
+// quoted as is.
+func (this mysqldStmtParam) String() string {
+	if this.Null {
+		return "NULL"
+	}
+	v := this.Value
+	switch {
+	case this.Type == MYSQL_TYPE_TINY && len(v) >= 1:
+		if this.UnsignedType {
+			return fmt.Sprintf("%d", v[0])
+		}
+		return fmt.Sprintf("%d", int8(v[0]))
+	case (this.Type == MYSQL_TYPE_SHORT || this.Type == MYSQL_TYPE_YEAR) && len(v) >= 2:
+		if this.UnsignedType {
+			return fmt.Sprintf("%d", binary.LittleEndian.Uint16(v))
+		}
+		return fmt.Sprintf("%d", int16(binary.LittleEndian.Uint16(v)))
+	case this.Type == MYSQL_TYPE_LONG && len(v) >= 4:
+		if this.UnsignedType {
+			return fmt.Sprintf("%d", binary.LittleEndian.Uint32(v))
+		}
+		return fmt.Sprintf("%d", int32(binary.LittleEndian.Uint32(v)))
+	case this.Type == MYSQL_TYPE_LONGLONG && len(v) >= 8:
+		if this.UnsignedType {
+			return fmt.Sprintf("%d", binary.LittleEndian.Uint64(v))
+		}
+		return fmt.Sprintf("%d", int64(binary.LittleEndian.Uint64(v)))
+	case this.Type == MYSQL_TYPE_FLOAT && len(v) >= 4:
+		return fmt.Sprintf("%g", math.Float32frombits(binary.LittleEndian.Uint32(v)))
+	case this.Type == MYSQL_TYPE_DOUBLE && len(v) >= 8:
+		return fmt.Sprintf("%g", math.Float64frombits(binary.LittleEndian.Uint64(v)))
+	}
+	if int(this.Length) > len(v) {
+		return fmt.Sprintf("%q...(%d)", v, this.Length)
+	}
+	return fmt.Sprintf("%q", v)
+}
 
 const (
 	//dispatch_command_return
@@ -53,49 +137,178 @@ func (this dispatch_command_return) String() string {
 type mysqldEvent struct {
 	module     IModule
 	event_type EVENT_TYPE
-	Pid        uint64
-	Timestamp  uint64
-	query      [MYSQLD_MAX_DATA_SIZE]uint8
-	alllen     uint64
-	len        uint64
-	comm       [16]uint8
-	retval     dispatch_command_return
+	EventHeader
+	alllen  uint64
+	stmtId  uint32
+	command uint8
+	retval  dispatch_command_return
+	query   []uint8
+	params  []mysqldStmtParam
+
+	// SQL of the prepared statement, from the statement cache of the module.
+	stmtSql string
 }
 
 func (this *mysqldEvent) Decode(payload []byte) (err error) {
-	buf := bytes.NewBuffer(payload)
-	if err = binary.Read(buf, binary.LittleEndian, &this.Pid); err != nil {
+	var body []byte
+	if body, err = this.EventHeader.Decode(payload); err != nil {
 		return
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Timestamp); err != nil {
-		return
-	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.query); err != nil {
-		return
+	if len(body) < MYSQLD_BODY_FIXED_SIZE {
+		return fmt.Errorf("mysqld event body too short: %d bytes", len(body))
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.alllen); err != nil {
-		return
+	this.alllen = binary.LittleEndian.Uint64(body[0:8])
+	this.stmtId = binary.LittleEndian.Uint32(body[8:12])
+	this.command = body[12]
+	this.retval = dispatch_command_return(int8(body[13]))
+	this.query = body[MYSQLD_BODY_FIXED_SIZE:]
+	// the parameters of the previous event, which is done with, keep their
+	// array.
+	this.params = this.params[:0]
+	this.stmtSql = ""
+
+	switch this.command {
+	case COM_STMT_EXECUTE:
+		for b := this.query; len(b) >= MYSQL80_PARAM_SIZE; b = b[MYSQL80_PARAM_SIZE:] {
+			param := mysqldStmtParam{
+				Null:         b[0] != 0,
+				Type:         b[1],
+				UnsignedType: b[2] != 0,
+				Length:       binary.LittleEndian.Uint32(b[4:8]),
+			}
+			n := int(param.Length)
+			if n > MYSQL80_PARAM_VALUE_SIZE {
+				n = MYSQL80_PARAM_VALUE_SIZE
+			}
+			param.Value = b[8 : 8+n]
+			this.params = append(this.params, param)
+		}
+		fallthrough
+	case COM_STMT_PREPARE, COM_STMT_CLOSE:
+		// the statement cache of the module resolves them.
+		this.event_type = EVENT_TYPE_MODULE_DATA
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.len); err != nil {
-		return
+	return nil
+}
+
+// connId is the connection of the event, the thread serving it if the THD
+// connection id is unknown.
+func (this *mysqldEvent) connId() uint32 {
+	if this.ConnKey != 0 {
+		return this.ConnKey
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.comm); err != nil {
-		return
+	return this.Tid
+}
+
+// appendHead appends " PID:%d, TID:%d, Comm:%s, ConnID:%d, Time:%d, ", or the
+// JSON fields before "command". The comm is only known once the exec events
+// read before this one were dispatched, the pipeline formats the head in its
+// sink. See orderedAppender.
+func (this *mysqldEvent) appendHead(dst []byte, json bool) []byte {
+	if json {
+		dst = appendJSONHeader(dst, &this.EventHeader, processes.Comm(this.Pid))
+		return appendJSONUint(dst, "conn_id", uint64(this.ConnKey))
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.retval); err != nil {
-		return
+	dst = append(dst, " PID:"...)
+	dst = strconv.AppendUint(dst, uint64(this.Pid), 10)
+	dst = append(dst, ", TID:"...)
+	dst = strconv.AppendUint(dst, uint64(this.Tid), 10)
+	dst = append(dst, ", Comm:"...)
+	dst = append(dst, processes.Comm(this.Pid)...)
+	dst = append(dst, ", ConnID:"...)
+	dst = strconv.AppendUint(dst, uint64(this.ConnKey), 10)
+	dst = append(dst, ", Time:"...)
+	dst = strconv.AppendUint(dst, this.TimestampNs, 10)
+	return append(dst, ", "...)
+}
+
+// appendPayload appends what follows appendHead.
+func (this *mysqldEvent) appendPayload(dst []byte, json, hex bool) []byte {
+	if json {
+		return this.appendJSONBody(dst)
 	}
-	return nil
+	return append(dst, this.body()...)
 }
 
 func (this *mysqldEvent) String() string {
-	s := fmt.Sprintf(fmt.Sprintf(" PID:%d, Comm:%s, Time:%d,  length:(%d/%d),  return:%s, Line:%s", this.Pid, this.comm, this.Timestamp, this.len, this.alllen, this.retval, unix.ByteSliceToString((this.query[:]))))
-	return s
+	return string(this.appendPayload(this.appendHead(nil, false), false, false))
+}
+
+// body is the part of String after the head.
+func (this *mysqldEvent) body() string {
+	switch this.command {
+	case COM_STMT_PREPARE:
+		if this.stmtId == 0 {
+			return fmt.Sprintf("STMT_PREPARE id:unknown, length:(%d/%d),  return:%s, Line:%s", len(this.query), this.alllen, this.retval, unix.ByteSliceToString(this.query))
+		}
+		return fmt.Sprintf("STMT_PREPARE id:%d, length:(%d/%d),  return:%s, Line:%s", this.stmtId, len(this.query), this.alllen, this.retval, unix.ByteSliceToString(this.query))
+	case COM_STMT_EXECUTE:
+		params := make([]string, len(this.params))
+		for i, param := range this.params {
+			params[i] = param.String()
+		}
+		stmtSql := this.stmtSql
+		if stmtSql == "" {
+			stmtSql = "[PREPARED_BEFORE_CAPTURE]"
+		}
+		return fmt.Sprintf("STMT_EXECUTE id:%d, params:(%d/%d)[%s],  return:%s, Line:%s", this.stmtId, len(this.params), this.alllen, strings.Join(params, ", "), this.retval, stmtSql)
+	case COM_STMT_CLOSE:
+		return fmt.Sprintf("STMT_CLOSE id:%d", this.stmtId)
+	}
+	return fmt.Sprintf("length:(%d/%d),  return:%s, Line:%s", len(this.query), this.alllen, this.retval, unix.ByteSliceToString(this.query))
+}
+
+func (this *mysqldEvent) AppendJSON(dst []byte) []byte {
+	return this.appendPayload(this.appendHead(dst, true), true, false)
+}
+
+// appendJSONBody appends the fields of AppendJSON after the head.
+func (this *mysqldEvent) appendJSONBody(dst []byte) []byte {
+	switch this.command {
+	case COM_STMT_PREPARE:
+		dst = appendJSONField(dst, "command", "stmt_prepare")
+		if this.stmtId == 0 {
+			// the id could not be read.
+			dst = append(appendJSONKey(dst, "stmt_id"), "null"...)
+		} else {
+			dst = appendJSONUint(dst, "stmt_id", uint64(this.stmtId))
+		}
+		dst = appendJSONUint(dst, "len", this.alllen)
+		dst = appendJSONField(dst, "return", this.retval.String())
+		dst = appendJSONPayload(dst, "query", trimNul(this.query))
+	case COM_STMT_EXECUTE:
+		dst = appendJSONField(dst, "command", "stmt_execute")
+		dst = appendJSONUint(dst, "stmt_id", uint64(this.stmtId))
+		dst = appendJSONUint(dst, "len", this.alllen)
+		dst = appendJSONField(dst, "return", this.retval.String())
+		dst = append(appendJSONKey(dst, "params"), '[')
+		for i, param := range this.params {
+			if i > 0 {
+				dst = append(dst, ',')
+			}
+			dst = appendJSONString(dst, param.String())
+		}
+		dst = append(dst, ']')
+		if this.stmtSql == "" {
+			// prepared before the capture.
+			dst = append(appendJSONKey(dst, "query"), "null"...)
+		} else {
+			dst = appendJSONField(dst, "query", this.stmtSql)
+		}
+	case COM_STMT_CLOSE:
+		dst = appendJSONField(dst, "command", "stmt_close")
+		dst = appendJSONUint(dst, "stmt_id", uint64(this.stmtId))
+	default:
+		dst = appendJSONField(dst, "command", "query")
+		dst = appendJSONUint(dst, "len", this.alllen)
+		dst = appendJSONField(dst, "return", this.retval.String())
+		dst = appendJSONPayload(dst, "query", trimNul(this.query))
+	}
+	return append(dst, '}')
 }
 
 func (this *mysqldEvent) StringHex() string {
-	s := fmt.Sprintf(fmt.Sprintf(" PID:%d, Comm:%s, Time:%d,  length:(%d/%d),  return:%s, Line:%s", this.Pid, this.comm, this.Timestamp, this.len, this.alllen, this.retval, unix.ByteSliceToString((this.query[:]))))
-	return s
+	return this.String()
 }
 
 func (this *mysqldEvent) SetModule(module IModule) {
@@ -5,103 +5,178 @@ Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
 package user
 
 import (
-	"bytes"
-	"encoding/binary"
 	"fmt"
-	"net"
+	"strconv"
 )
 
-type AttachType int64
+const MAX_DATA_SIZE = 1024 * 4
+const SA_DATA_LEN = 14
 
+// TLS_BODY_FIXED_SIZE is TLS_BODY_FIXED_SIZE in kern/tls_kern.c
+const TLS_BODY_FIXED_SIZE = 1
+
+// enum tls_library_t in kern/tls_kern.c
 const (
-	PROBE_ENTRY AttachType = iota
-	PROBE_RET
+	TLS_LIBRARY_OPENSSL uint8 = iota + 1
+	TLS_LIBRARY_GNUTLS
+	TLS_LIBRARY_NSPR
 )
 
-const MAX_DATA_SIZE = 1024 * 4
-const SA_DATA_LEN = 14
-
+/*
+struct ssl_data_event_t {
+    struct event_header_t header;
+    u8 library;
+    char data[MAX_DATA_SIZE_OPENSSL];
+};
+*/
 type SSLDataEvent struct {
-	module       IModule
-	event_type   EVENT_TYPE
-	DataType     int64
-	Timestamp_ns uint64
-	Pid          uint32
-	Tid          uint32
-	Data         [MAX_DATA_SIZE]byte
-	Data_len     int32
-	Comm         [16]byte
-	Fd           uint32
+	module     IModule
+	event_type EVENT_TYPE
+	EventHeader
+	Library uint8
+	Data    []byte
 }
 
 func (this *SSLDataEvent) Decode(payload []byte) (err error) {
-	buf := bytes.NewBuffer(payload)
-	if err = binary.Read(buf, binary.LittleEndian, &this.DataType); err != nil {
-		return
-	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Timestamp_ns); err != nil {
+	var body []byte
+	if body, err = this.EventHeader.Decode(payload); err != nil {
 		return
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Pid); err != nil {
-		return
+	if len(body) < TLS_BODY_FIXED_SIZE {
+		return fmt.Errorf("tls event body too short: %d bytes", len(body))
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Tid); err != nil {
-		return
+	this.Library = body[0]
+	this.Data = body[TLS_BODY_FIXED_SIZE:]
+	return nil
+}
+
+func (this *SSLDataEvent) library() string {
+	switch this.Library {
+	case TLS_LIBRARY_OPENSSL:
+		return "openssl"
+	case TLS_LIBRARY_GNUTLS:
+		return "gnutls"
+	case TLS_LIBRARY_NSPR:
+		return "nspr"
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Data); err != nil {
-		return
+	return fmt.Sprintf("UNKNOW_%d", this.Library)
+}
+
+// hasConn reports whether the event carries the fd of its connection: only
+// openssl does, gnutls and nspr send invalidFD (0).
+func (this *SSLDataEvent) hasConn() bool {
+	return this.ConnKey != 0 && this.Library == TLS_LIBRARY_OPENSSL
+}
+
+// conn returns the remote address of the connection of the event.
+func (this *SSLDataEvent) conn() (connAddr, bool) {
+	m, ok := this.module.(*MOpenSSLProbe)
+	if !ok || !this.hasConn() {
+		return connAddr{}, false
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Data_len); err != nil {
-		return
+	return m.lookupConn(this.Pid, this.ConnKey)
+}
+
+// The address of the connection is only known once the connect events read
+// before this one were dispatched, so the pipeline formats the head of the
+// event in its sink, in read order, and the payload in its decoders. See
+// orderedAppender.
+
+// appendHead appends "PID:%d, Comm:%s, TID:%d, Lib:%s, <connInfo>, Payload:\n",
+// or the JSON fields before "data".
+func (this *SSLDataEvent) appendHead(dst []byte, json bool) []byte {
+	if json {
+		dst = appendJSONHeader(dst, &this.EventHeader, processes.Comm(this.Pid))
+		dst = appendJSONField(dst, "lib", this.library())
+		dst = appendJSONUint(dst, "fd", uint64(this.ConnKey))
+		dst = appendJSONKey(dst, "addr")
+		if addr, found := this.conn(); found {
+			dst = append(dst, '"')
+			dst = addr.AppendTo(dst)
+			dst = append(dst, '"')
+		} else {
+			dst = append(dst, "null"...)
+		}
+		return appendJSONUint(dst, "len", uint64(len(this.Data)))
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Comm); err != nil {
-		return
+
+	dst = append(dst, "PID:"...)
+	dst = strconv.AppendUint(dst, uint64(this.Pid), 10)
+	dst = append(dst, ", Comm:"...)
+	dst = append(dst, processes.Comm(this.Pid)...)
+	dst = append(dst, ", TID:"...)
+	dst = strconv.AppendUint(dst, uint64(this.Tid), 10)
+	dst = append(dst, ", Lib:"...)
+	dst = append(dst, this.library()...)
+	dst = append(dst, ", "...)
+
+	switch this.Type {
+	case KERNEL_EVENT_TLS_READ:
+		dst = append(dst, COLORGREEN+"Recived "...)
+		dst = strconv.AppendInt(dst, int64(len(this.Data)), 10)
+		dst = append(dst, COLORRESET+" bytes from "+COLORYELLOW...)
+	case KERNEL_EVENT_TLS_WRITE:
+		dst = append(dst, COLORPURPLE+"Send "...)
+		dst = strconv.AppendInt(dst, int64(len(this.Data)), 10)
+		dst = append(dst, COLORRESET+" bytes to "+COLORYELLOW...)
+	default:
+		dst = append(dst, COLORRED+"UNKNOW_"...)
+		dst = strconv.AppendUint(dst, uint64(this.Type), 10)
+		return append(dst, COLORRESET+", Payload:\n"...)
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Fd); err != nil {
-		return
+	if addr, found := this.conn(); found {
+		dst = addr.AppendTo(dst)
+	} else {
+		dst = append(dst, CONN_NOT_FOUND...)
 	}
-
-	return nil
+	return append(dst, COLORRESET+", Payload:\n"...)
 }
 
-func (this *SSLDataEvent) StringHex() string {
-	addr := this.module.(*MOpenSSLProbe).GetConn(this.Pid, this.Fd)
-
-	var perfix, connInfo string
-	switch AttachType(this.DataType) {
-	case PROBE_ENTRY:
-		connInfo = fmt.Sprintf("%sRecived %d%s bytes from %s%s%s", COLORGREEN, this.Data_len, COLORRESET, COLORYELLOW, addr, COLORRESET)
-		perfix = COLORGREEN
-	case PROBE_RET:
-		connInfo = fmt.Sprintf("%sSend %d%s bytes to %s%s%s", COLORPURPLE, this.Data_len, COLORRESET, COLORYELLOW, addr, COLORRESET)
-		perfix = fmt.Sprintf("%s\t", COLORPURPLE)
+// appendPayload appends what follows appendHead: the payload, as text, hex
+// dump or the JSON "data" field.
+func (this *SSLDataEvent) appendPayload(dst []byte, json, hex bool) []byte {
+	if json {
+		dst = appendJSONPayload(dst, "data", this.Data)
+		return append(dst, '}')
+	}
+	var color, perfix string
+	switch this.Type {
+	case KERNEL_EVENT_TLS_READ:
+		color = COLORGREEN
+		perfix = color
+	case KERNEL_EVENT_TLS_WRITE:
+		color = COLORPURPLE
+		perfix = color + "\t"
 	default:
-		perfix = fmt.Sprintf("UNKNOW_%d", this.DataType)
+		perfix = "UNKNOW_" + strconv.Itoa(int(this.Type))
+	}
+	if hex {
+		dst = appendHexDump(dst, this.Data, perfix)
+	} else {
+		dst = append(dst, color...)
+		dst = append(dst, this.Data...)
 	}
+	return append(dst, COLORRESET...)
+}
 
-	b := dumpByteSlice(this.Data[:this.Data_len], perfix)
-	b.WriteString(COLORRESET)
+func (this *SSLDataEvent) AppendStringHex(dst []byte) []byte {
+	return this.appendPayload(this.appendHead(dst, false), false, true)
+}
 
-	s := fmt.Sprintf("PID:%d, Comm:%s, TID:%d, %s, Payload:\n%s", this.Pid, this.Comm, this.Tid, connInfo, b.String())
-	return s
+func (this *SSLDataEvent) AppendString(dst []byte) []byte {
+	return this.appendPayload(this.appendHead(dst, false), false, false)
+}
+
+func (this *SSLDataEvent) AppendJSON(dst []byte) []byte {
+	return this.appendPayload(this.appendHead(dst, true), true, false)
+}
+
+func (this *SSLDataEvent) StringHex() string {
+	return string(this.AppendStringHex(nil))
 }
 
 func (this *SSLDataEvent) String() string {
-	addr := this.module.(*MOpenSSLProbe).GetConn(this.Pid, this.Fd)
-
-	var perfix, connInfo string
-	switch AttachType(this.DataType) {
-	case PROBE_ENTRY:
-		connInfo = fmt.Sprintf("%sRecived %d%s bytes from %s%s%s", COLORGREEN, this.Data_len, COLORRESET, COLORYELLOW, addr, COLORRESET)
-		perfix = COLORGREEN
-	case PROBE_RET:
-		connInfo = fmt.Sprintf("%sSend %d%s bytes to %s%s%s", COLORPURPLE, this.Data_len, COLORRESET, COLORYELLOW, addr, COLORRESET)
-		perfix = COLORPURPLE
-	default:
-		connInfo = fmt.Sprintf("%sUNKNOW_%d%s", COLORRED, this.DataType, COLORRESET)
-	}
-	s := fmt.Sprintf("PID:%d, Comm:%s, TID:%d, %s, Payload:\n%s%s%s", this.Pid, this.Comm, this.Tid, connInfo, perfix, string(this.Data[:this.Data_len]), COLORRESET)
-	return s
+	return string(this.AppendString(nil))
 }
 
 func (this *SSLDataEvent) SetModule(module IModule) {
@@ -115,7 +190,7 @@ func (this *SSLDataEvent) Module() IModule {
 func (this *SSLDataEvent) Clone() IEventStruct {
 	event := new(SSLDataEvent)
 	event.module = this.module
-	event.event_type = EVENT_TYPE_OUTPUT
+	event.event_type = this.event_type
 	return event
 }
 
@@ -125,61 +200,51 @@ func (this *SSLDataEvent) EventType() EVENT_TYPE {
 
 //  connect_events map
 /*
-uint64_t timestamp_ns;
-  uint32_t pid;
-  uint32_t tid;
-  uint32_t fd;
-  char sa_data[SA_DATA_LEN];
-  char comm[TASK_COMM_LEN];
+struct connect_event_t {
+    struct event_header_t header;
+    char sa_data[SA_DATA_LEN];
+};
 */
 type ConnDataEvent struct {
-	module      IModule
-	event_type  EVENT_TYPE
-	TimestampNs uint64
-	Pid         uint32
-	Tid         uint32
-	Fd          uint32
-	SaData      [SA_DATA_LEN]byte
-	Comm        [16]byte
-	Addr        string
+	module     IModule
+	event_type EVENT_TYPE
+	EventHeader
+	SaData [SA_DATA_LEN]byte
+	Addr   connAddr
 }
 
 func (this *ConnDataEvent) Decode(payload []byte) (err error) {
-	buf := bytes.NewBuffer(payload)
-	if err = binary.Read(buf, binary.LittleEndian, &this.TimestampNs); err != nil {
-		return
-	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Pid); err != nil {
-		return
-	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Tid); err != nil {
+	var body []byte
+	if body, err = this.EventHeader.Decode(payload); err != nil {
 		return
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Fd); err != nil {
-		return
-	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.SaData); err != nil {
-		return
+	if len(body) < SA_DATA_LEN {
+		return fmt.Errorf("connect event body too short: %d bytes", len(body))
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Comm); err != nil {
-		return
-	}
-	port := binary.BigEndian.Uint16(this.SaData[0:2])
-	ip := net.IPv4(this.SaData[2], this.SaData[3], this.SaData[4], this.SaData[5])
-	this.Addr = fmt.Sprintf("%s:%d", ip, port)
+	copy(this.SaData[:], body)
+	this.Addr = newConnAddrV4(this.SaData[:])
 	return nil
 }
 
 func (this *ConnDataEvent) StringHex() string {
-	s := fmt.Sprintf("PID:%d, Comm:%s, TID:%d, FD:%d, Addr: %s", this.Pid, this.Comm, this.Tid, this.Fd, this.Addr)
+	s := fmt.Sprintf("PID:%d, Comm:%s, TID:%d, FD:%d, Addr: %s", this.Pid, processes.Comm(this.Pid), this.Tid, this.ConnKey, this.Addr)
 	return s
 }
 
 func (this *ConnDataEvent) String() string {
-	s := fmt.Sprintf("PID:%d, Comm:%s, TID:%d, FD:%d, Addr: %s", this.Pid, this.Comm, this.Tid, this.Fd, this.Addr)
+	s := fmt.Sprintf("PID:%d, Comm:%s, TID:%d, FD:%d, Addr: %s", this.Pid, processes.Comm(this.Pid), this.Tid, this.ConnKey, this.Addr)
 	return s
 }
 
+func (this *ConnDataEvent) AppendJSON(dst []byte) []byte {
+	dst = appendJSONHeader(dst, &this.EventHeader, processes.Comm(this.Pid))
+	dst = appendJSONUint(dst, "fd", uint64(this.ConnKey))
+	dst = appendJSONKey(dst, "addr")
+	dst = append(dst, '"')
+	dst = this.Addr.AppendTo(dst)
+	return append(dst, '"', '}')
+}
+
 func (this *ConnDataEvent) SetModule(module IModule) {
 	this.module = module
 }
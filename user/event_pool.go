@@ -0,0 +1,47 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"reflect"
+	"sync"
+)
+
+// eventPool recycles the events of a module, one sync.Pool per event type,
+// instead of cloning a new event for every record.
+//
+// Only events the module is done with come back: EVENT_TYPE_OUTPUT once they
+// are printed, EVENT_TYPE_PROCESS once the process cache copied them.
+// EVENT_TYPE_MODULE_DATA events belong to the Dispatcher of the module, which
+// may keep them (pending bash lines, statement caches), so they are left to
+// the GC.
+type eventPool struct {
+	pools sync.Map // reflect.Type -> *sync.Pool
+}
+
+func (this *eventPool) pool(event IEventStruct) *sync.Pool {
+	t := reflect.TypeOf(event)
+	if p, found := this.pools.Load(t); found {
+		return p.(*sync.Pool)
+	}
+	p, _ := this.pools.LoadOrStore(t, &sync.Pool{New: func() interface{} {
+		return event.Clone()
+	}})
+	return p.(*sync.Pool)
+}
+
+// Get returns an event of the type of proto, as if cloned from it. Decode must
+// set every field it decodes, the event may have been decoded before.
+func (this *eventPool) Get(proto IEventStruct) IEventStruct {
+	return this.pool(proto).Get().(IEventStruct)
+}
+
+// Put releases event, it must not be used anymore.
+func (this *eventPool) Put(event IEventStruct) {
+	switch event.EventType() {
+	case EVENT_TYPE_OUTPUT, EVENT_TYPE_PROCESS:
+		this.pool(event).Put(event)
+	}
+}
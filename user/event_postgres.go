@@ -5,55 +5,152 @@ Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
 package user
 
 import (
-	"bytes"
 	"encoding/binary"
 	"fmt"
+	"strconv"
+	"time"
 
 	"golang.org/x/sys/unix"
 )
 
 /*
-   u64 pid;
-   u64 timestamp;
-   char query[MAX_DATA_SIZE];
-   char comm[TASK_COMM_LEN];
+   struct event_header_t header;
+   u64 duration_ns;
+   u8 command;
+   char stmt_name[PG_NAME_LEN];
+   char portal_name[PG_NAME_LEN];
+   char query[MAX_DATA_SIZE_POSTGRES]; // only the captured bytes are sent
 */
-const POSTGRES_MAX_DATA_SIZE = 256
+const POSTGRES_MAX_DATA_SIZE = 1024 * 4
+
+const PG_NAME_LEN = 64
+
+// duration_ns, command, stmt_name and portal_name
+const POSTGRES_BODY_FIXED_SIZE = 8 + 1 + PG_NAME_LEN*2
+
+// enum pg_command in kern/postgres_kern.c
+const (
+	PG_SIMPLE_QUERY = iota
+	PG_PARSE
+	PG_BIND
+	PG_EXECUTE
+)
 
 type postgresEvent struct {
 	module     IModule
 	event_type EVENT_TYPE
-	Pid        uint64
-	Timestamp  uint64
-	query      [POSTGRES_MAX_DATA_SIZE]uint8
-	comm       [16]uint8
+	EventHeader
+	duration   time.Duration
+	command    uint8
+	stmtName   string
+	portalName string
+	query      []uint8
+
+	// SQL of the executed statement, from the statement cache of the module.
+	stmtSql string
 }
 
 func (this *postgresEvent) Decode(payload []byte) (err error) {
-	buf := bytes.NewBuffer(payload)
-	if err = binary.Read(buf, binary.LittleEndian, &this.Pid); err != nil {
-		return
-	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.Timestamp); err != nil {
+	var body []byte
+	if body, err = this.EventHeader.Decode(payload); err != nil {
 		return
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.query); err != nil {
-		return
+	if len(body) < POSTGRES_BODY_FIXED_SIZE {
+		return fmt.Errorf("postgres event body too short: %d bytes", len(body))
 	}
-	if err = binary.Read(buf, binary.LittleEndian, &this.comm); err != nil {
-		return
+	this.duration = time.Duration(binary.LittleEndian.Uint64(body[0:8]))
+	this.command = body[8]
+	setString(&this.stmtName, body[9:9+PG_NAME_LEN])
+	setString(&this.portalName, body[9+PG_NAME_LEN:9+PG_NAME_LEN*2])
+	this.query = body[POSTGRES_BODY_FIXED_SIZE:]
+	this.stmtSql = ""
+	if this.command != PG_SIMPLE_QUERY {
+		// the statement cache of the module resolves them.
+		this.event_type = EVENT_TYPE_MODULE_DATA
 	}
 	return nil
 }
 
+// appendHead appends " PID: %d, Comm: %s, Time: %d, ", or the JSON fields
+// before "command", in the sink of the pipeline. See mysqldEvent.appendHead.
+func (this *postgresEvent) appendHead(dst []byte, json bool) []byte {
+	if json {
+		return appendJSONHeader(dst, &this.EventHeader, processes.Comm(this.Pid))
+	}
+	dst = append(dst, " PID: "...)
+	dst = strconv.AppendUint(dst, uint64(this.Pid), 10)
+	dst = append(dst, ", Comm: "...)
+	dst = append(dst, processes.Comm(this.Pid)...)
+	dst = append(dst, ", Time: "...)
+	dst = strconv.AppendUint(dst, this.TimestampNs, 10)
+	return append(dst, ", "...)
+}
+
+// appendPayload appends what follows appendHead.
+func (this *postgresEvent) appendPayload(dst []byte, json, hex bool) []byte {
+	if json {
+		return this.appendJSONBody(dst)
+	}
+	return append(dst, this.body()...)
+}
+
 func (this *postgresEvent) String() string {
-	s := fmt.Sprintf(fmt.Sprintf(" PID: %d, Comm: %s, Time: %d, Query: %s", this.Pid, this.comm, this.Timestamp, unix.ByteSliceToString((this.query[:]))))
-	return s
+	return string(this.appendPayload(this.appendHead(nil, false), false, false))
+}
+
+// body is the part of String after the head.
+func (this *postgresEvent) body() string {
+	switch this.command {
+	case PG_PARSE:
+		return fmt.Sprintf("Parse: %q, Query: %s", this.stmtName, unix.ByteSliceToString(this.query))
+	case PG_BIND:
+		return fmt.Sprintf("Bind: %q, Portal: %q", this.stmtName, this.portalName)
+	case PG_EXECUTE:
+		stmtSql := this.stmtSql
+		if stmtSql == "" {
+			stmtSql = "[PARSED_BEFORE_CAPTURE]"
+		}
+		return fmt.Sprintf("Execute: %q, Portal: %q, Duration: %s, Query: %s", this.stmtName, this.portalName, this.duration, stmtSql)
+	}
+	return fmt.Sprintf("Duration: %s, Query: %s", this.duration, unix.ByteSliceToString(this.query))
+}
+
+func (this *postgresEvent) AppendJSON(dst []byte) []byte {
+	return this.appendPayload(this.appendHead(dst, true), true, false)
+}
+
+// appendJSONBody appends the fields of AppendJSON after the head.
+func (this *postgresEvent) appendJSONBody(dst []byte) []byte {
+	switch this.command {
+	case PG_PARSE:
+		dst = appendJSONField(dst, "command", "parse")
+		dst = appendJSONField(dst, "stmt", this.stmtName)
+		dst = appendJSONPayload(dst, "query", trimNul(this.query))
+	case PG_BIND:
+		dst = appendJSONField(dst, "command", "bind")
+		dst = appendJSONField(dst, "stmt", this.stmtName)
+		dst = appendJSONField(dst, "portal", this.portalName)
+	case PG_EXECUTE:
+		dst = appendJSONField(dst, "command", "execute")
+		dst = appendJSONField(dst, "stmt", this.stmtName)
+		dst = appendJSONField(dst, "portal", this.portalName)
+		dst = appendJSONUint(dst, "duration_ns", uint64(this.duration))
+		if this.stmtSql == "" {
+			// parsed before the capture.
+			dst = append(appendJSONKey(dst, "query"), "null"...)
+		} else {
+			dst = appendJSONField(dst, "query", this.stmtSql)
+		}
+	default:
+		dst = appendJSONField(dst, "command", "query")
+		dst = appendJSONUint(dst, "duration_ns", uint64(this.duration))
+		dst = appendJSONPayload(dst, "query", trimNul(this.query))
+	}
+	return append(dst, '}')
 }
 
 func (this *postgresEvent) StringHex() string {
-	s := fmt.Sprintf(fmt.Sprintf(" PID: %d, Comm: %s, Time: %d, Query: %s", this.Pid, this.comm, this.Timestamp, unix.ByteSliceToString((this.query[:]))))
-	return s
+	return this.String()
 }
 
 func (this *postgresEvent) SetModule(module IModule) {
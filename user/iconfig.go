@@ -9,24 +9,52 @@ import "ecapture/pkg/util/kernel"
 type IConfig interface {
 	Check() error //检测配置合法性
 	GetPid() uint64
+	GetPidTree() bool
 	GetHex() bool
 	GetDebug() bool
+	GetPerfReaders() int
+	GetPinReaders() bool
+	GetPerfBufferSize() int
+	GetPerfWatermark() int
+	GetCaptureFile() string
+	GetFormat() string
 	SetPid(uint64)
+	SetPidTree(bool)
 	SetHex(bool)
 	SetDebug(bool)
+	SetPerfReaders(int)
+	SetPinReaders(bool)
+	SetPerfBufferSize(int)
+	SetPerfWatermark(int)
+	SetCaptureFile(string)
+	SetFormat(string)
 	EnableGlobalVar() bool //
 }
 
 type eConfig struct {
-	Pid   uint64
-	IsHex bool
-	Debug bool
+	Pid     uint64
+	PidTree bool // target the descendants of Pid too
+	IsHex   bool
+	Debug   bool
+
+	PerfReaders int  // goroutines sharing the per-CPU perf buffers, 0: one reader per map
+	PinReaders  bool // pin each of them to the CPUs it reads
+
+	PerfBufferSize int // per-CPU perf buffer size in bytes, 0: from the CPU count and PERF_BUFFER_BUDGET
+	PerfWatermark  int // bytes buffered before the reader is woken up, 0: every sample
+
+	CaptureFile string // write raw events to this capture file instead of printing them
+	Format      string // OUTPUT_FORMAT_TEXT or OUTPUT_FORMAT_JSON
 }
 
 func (this *eConfig) GetPid() uint64 {
 	return this.Pid
 }
 
+func (this *eConfig) GetPidTree() bool {
+	return this.PidTree
+}
+
 func (this *eConfig) GetDebug() bool {
 	return this.Debug
 }
@@ -35,14 +63,66 @@ func (this *eConfig) GetHex() bool {
 	return this.IsHex
 }
 
+func (this *eConfig) GetPerfReaders() int {
+	return this.PerfReaders
+}
+
+func (this *eConfig) GetPinReaders() bool {
+	return this.PinReaders
+}
+
+func (this *eConfig) GetPerfBufferSize() int {
+	return this.PerfBufferSize
+}
+
+func (this *eConfig) GetPerfWatermark() int {
+	return this.PerfWatermark
+}
+
+func (this *eConfig) GetCaptureFile() string {
+	return this.CaptureFile
+}
+
+func (this *eConfig) GetFormat() string {
+	return this.Format
+}
+
 func (this *eConfig) SetPid(pid uint64) {
 	this.Pid = pid
 }
 
+func (this *eConfig) SetPidTree(b bool) {
+	this.PidTree = b
+}
+
 func (this *eConfig) SetDebug(b bool) {
 	this.Debug = b
 }
 
+func (this *eConfig) SetPerfReaders(n int) {
+	this.PerfReaders = n
+}
+
+func (this *eConfig) SetPinReaders(b bool) {
+	this.PinReaders = b
+}
+
+func (this *eConfig) SetPerfBufferSize(size int) {
+	this.PerfBufferSize = size
+}
+
+func (this *eConfig) SetPerfWatermark(watermark int) {
+	this.PerfWatermark = watermark
+}
+
+func (this *eConfig) SetCaptureFile(path string) {
+	this.CaptureFile = path
+}
+
+func (this *eConfig) SetFormat(format string) {
+	this.Format = format
+}
+
 func (this *eConfig) SetHex(isHex bool) {
 	this.IsHex = isHex
 }
@@ -8,6 +8,9 @@ const (
 
 	// set as module cache data
 	EVENT_TYPE_MODULE_DATA
+
+	// process exec/fork/exit, kept in the shared process cache
+	EVENT_TYPE_PROCESS
 )
 
 type IEventStruct interface {
@@ -18,4 +21,7 @@ type IEventStruct interface {
 	Module() IModule
 	SetModule(IModule)
 	EventType() EVENT_TYPE
+
+	// AppendJSON appends the event as one JSON object, for --format json.
+	AppendJSON(dst []byte) []byte
 }
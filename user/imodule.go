@@ -8,7 +8,6 @@ import (
 	"github.com/cilium/ebpf/perf"
 	"github.com/cilium/ebpf/ringbuf"
 	"log"
-	"os"
 )
 
 type IModule interface {
@@ -39,6 +38,9 @@ type IModule interface {
 	DecodeFun(p *ebpf.Map) (IEventStruct, bool)
 
 	Dispatcher(IEventStruct)
+
+	// Flush 写出缓冲的输出
+	Flush() error
 }
 
 type Module struct {
@@ -54,12 +56,28 @@ type Module struct {
 	mType string
 
 	conf IConfig
+
+	// decoded events, recycled once dispatched.
+	events eventPool
+
+	pipeline *pipeline
+
+	// buffered output of the events.
+	output *moduleOutput
+
+	// raw events are written there instead, with --write.
+	capture *captureWriter
+
+	// reading a capture file: nothing is looked up on this host, see
+	// ReadCapture.
+	offline bool
 }
 
 // Init 对象初始化
 func (this *Module) Init(ctx context.Context, logger *log.Logger) {
 	this.ctx = ctx
 	this.logger = logger
+	this.output = newModuleOutput(logger)
 	return
 }
 
@@ -118,16 +136,107 @@ func (this *Module) run() {
 	}
 }
 
+// Flush writes the buffered output of the module. Once the module is stopped,
+// it also closes the capture file.
+func (this *Module) Flush() error {
+	this.waitPipeline()
+	if this.capture != nil {
+		flush := this.capture.Flush
+		if this.ctx.Err() != nil {
+			flush = this.capture.Close
+		}
+		if err := flush(); err != nil {
+			return err
+		}
+	}
+	return this.output.Flush()
+}
+
+// waitPipeline waits, once the module is stopped, for the pipeline to output
+// the records its readers drained on exit.
+func (this *Module) waitPipeline() {
+	if this.pipeline == nil || this.ctx.Err() == nil {
+		return
+	}
+	if !this.pipeline.wait(PIPELINE_CLOSE_TIMEOUT) {
+		this.logger.Printf("%s pipeline: events still queued after %v", this.child.Name(), PIPELINE_CLOSE_TIMEOUT)
+	}
+}
+
+// PipelineStats returns the counters and queue depths of the event pipeline.
+func (this *Module) PipelineStats() PipelineStats {
+	if this.pipeline == nil {
+		return PipelineStats{}
+	}
+	return this.pipeline.Stats()
+}
+
 func (this *Module) readEvents() error {
 	var errChan = make(chan error, 8)
+	this.initOutput()
+	if path := this.conf.GetCaptureFile(); path != "" {
+		capture, err := newCaptureWriter(path, this.child)
+		if err != nil {
+			return fmt.Errorf("create capture file %s: %v", path, err)
+		}
+		this.capture = capture
+		// the module still decodes and dispatches to keep its state, but
+		// formatting is left to `ecapture read`.
+		this.output.discard = true
+		this.logger.Printf("%s write events to capture file %s", this.child.Name(), path)
+	}
+	var ringbufMaps, perfMaps []*ebpf.Map
 	for _, event := range this.child.Events() {
 		switch {
 		case event.Type() == ebpf.RingBuf:
-			go this.ringbufEventReader(errChan, event)
+			ringbufMaps = append(ringbufMaps, event)
 		case event.Type() == ebpf.PerfEventArray:
-			go this.perfEventReader(errChan, event)
+			perfMaps = append(perfMaps, event)
 		default:
-			errChan <- fmt.Errorf("Not support mapType:%s , mapinfo:%s", event.Type().String(), event.String())
+			return fmt.Errorf("Not support mapType:%s , mapinfo:%s", event.Type().String(), event.String())
+		}
+	}
+
+	// every reader gets a lane of the pipeline.
+	var perCPUBuffer, watermark int
+	var shards []*perfShard
+	lanes := len(ringbufMaps) + len(perfMaps)
+	if len(perfMaps) > 0 {
+		perCPUBuffer = perfBufferSize(this.conf, len(perfMaps))
+		watermark = perfWatermark(this.conf, perCPUBuffer)
+		cpus := numPossibleCPUs()
+		this.logger.Printf("%s perf buffers: %d maps x %d CPUs x %d KB = %d KB, wakeup watermark: %d bytes",
+			this.child.Name(), len(perfMaps), cpus, perCPUBuffer/1024, len(perfMaps)*cpus*perCPUBuffer/1024, watermark)
+
+		// the reader of cilium/ebpf can't be woken up before the watermark
+		// is reached, a perf shard drains its buffers on a timer.
+		readers := this.conf.GetPerfReaders()
+		if readers == 0 && watermark > 0 {
+			readers = 1
+		}
+		if readers > 0 {
+			var err error
+			shards, err = newPerfShards(perfMaps, readers, perCPUBuffer, watermark)
+			if err != nil {
+				return fmt.Errorf("creating perf readers: %v", err)
+			}
+			lanes = len(ringbufMaps) + len(shards)
+		}
+	}
+	this.pipeline = newPipeline(this, lanes)
+	this.pipeline.start()
+
+	lane := 0
+	for _, em := range ringbufMaps {
+		go this.ringbufEventReader(errChan, em, this.pipeline.lanes[lane])
+		lane++
+	}
+	if shards != nil {
+		this.shardedPerfEventReader(errChan, shards, this.pipeline.lanes[lane:])
+	} else {
+		for _, em := range perfMaps {
+			go this.perfEventReader(errChan, em, perCPUBuffer, watermark, this.pipeline.lanes[lane])
+			lane++
 		}
 	}
 
@@ -139,13 +248,19 @@ func (this *Module) readEvents() error {
 	}
 }
 
-func (this *Module) perfEventReader(errChan chan error, em *ebpf.Map) {
-	rd, err := perf.NewReader(em, os.Getpagesize()*64)
+func (this *Module) perfEventReader(errChan chan error, em *ebpf.Map, perCPUBuffer, watermark int, lane *pipelineLane) {
+	defer lane.close()
+	rd, err := perf.NewReaderWithOptions(em, perCPUBuffer, perf.ReaderOptions{Watermark: watermark})
 	if err != nil {
 		errChan <- fmt.Errorf("creating %s reader dns: %s", em.String(), err)
 		return
 	}
 	defer rd.Close()
+	// interrupts Read
+	go func() {
+		<-this.ctx.Done()
+		rd.Close()
+	}()
 	for {
 		//判断ctx是不是结束
 		select {
@@ -165,29 +280,48 @@ func (this *Module) perfEventReader(errChan chan error, em *ebpf.Map) {
 		}
 
 		if record.LostSamples != 0 {
-			log.Printf("perf event ring buffer full, dropped %d samples", record.LostSamples)
+			lane.addLost(record.LostSamples)
 			continue
 		}
 
-		var event IEventStruct
-		event, err = this.child.Decode(em, record.RawSample)
-		if err != nil {
-			log.Printf("this.child.decode error:%v", err)
-			continue
-		}
+		// 解码、上报交给pipeline，读取不等待输出
+		lane.push(em, record.RawSample)
+	}
+}
 
-		// 上报数据
-		this.Dispatcher(event)
+// shardedPerfEventReader reads the perf buffers with --readers shards, each
+// one owning the buffers of a subset of the CPUs and a lane of the pipeline.
+func (this *Module) shardedPerfEventReader(errChan chan error, shards []*perfShard, lanes []*pipelineLane) {
+	for i, shard := range shards {
+		go func(shard *perfShard, lane *pipelineLane) {
+			defer lane.close()
+			defer shard.release()
+			if err := shard.run(lane, this.conf.GetPinReaders()); err != nil {
+				errChan <- err
+			}
+		}(shard, lanes[i])
 	}
+	go func() {
+		<-this.ctx.Done()
+		for _, shard := range shards {
+			shard.Close()
+		}
+	}()
 }
 
-func (this *Module) ringbufEventReader(errChan chan error, em *ebpf.Map) {
+func (this *Module) ringbufEventReader(errChan chan error, em *ebpf.Map, lane *pipelineLane) {
+	defer lane.close()
 	rd, err := ringbuf.NewReader(em)
 	if err != nil {
 		errChan <- fmt.Errorf("creating %s reader dns: %s", em.String(), err)
 		return
 	}
 	defer rd.Close()
+	// interrupts Read
+	go func() {
+		<-this.ctx.Done()
+		rd.Close()
+	}()
 	for {
 		//判断ctx是不是结束
 		select {
@@ -207,15 +341,8 @@ func (this *Module) ringbufEventReader(errChan chan error, em *ebpf.Map) {
 			return
 		}
 
-		var event IEventStruct
-		event, err = this.child.Decode(em, record.RawSample)
-		if err != nil {
-			log.Printf("this.child.decode error:%v", err)
-			continue
-		}
-
-		// 上报数据
-		this.Dispatcher(event)
+		// 解码、上报交给pipeline，读取不等待输出
+		lane.push(em, record.RawSample)
 	}
 }
 
@@ -226,21 +353,49 @@ func (this *Module) Decode(em *ebpf.Map, b []byte) (event IEventStruct, err erro
 		return
 	}
 
-	te := es.Clone()
+	te := this.events.Get(es)
 	err = te.Decode(b)
 	if err != nil {
+		this.events.Put(te)
 		return nil, err
 	}
 	return te, nil
 }
 
+// initOutput applies the output options of the config.
+func (this *Module) initOutput() {
+	if this.conf.GetFormat() == OUTPUT_FORMAT_JSON {
+		this.output.setJSON()
+	}
+}
+
+// setOffline marks the module as reading a capture file.
+func (this *Module) setOffline() {
+	this.offline = true
+}
+
+// replay decodes raw with the event struct proto and dispatches it, as the
+// pipeline would. Used to read capture files.
+func (this *Module) replay(proto IEventStruct, raw []byte) error {
+	event := this.events.Get(proto)
+	if err := event.Decode(raw); err != nil {
+		this.events.Put(event)
+		return err
+	}
+	this.Dispatcher(event)
+	return nil
+}
+
 // 写入数据，或者上传到远程数据库，写入到其他chan 等。
 func (this *Module) Dispatcher(event IEventStruct) {
 	switch event.EventType() {
 	case EVENT_TYPE_OUTPUT:
-		this.logger.Println(event)
+		this.output.WriteEvent(event, this.conf.GetHex())
 	case EVENT_TYPE_MODULE_DATA:
 		// Save to cache
 		this.child.Dispatcher(event)
+	case EVENT_TYPE_PROCESS:
+		processes.Dispatch(event.(*ProcessEvent))
 	}
+	this.events.Put(event)
 }
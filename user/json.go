@@ -0,0 +1,141 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"encoding/base64"
+	"strconv"
+	"unicode/utf8"
+	"unsafe"
+)
+
+// --format json writes every event as one JSON object per line. Events
+// append their fields themselves with the helpers below, encoding/json
+// would go through reflection and allocate for every event.
+
+const jsonHex = "0123456789abcdef"
+
+// jsonSafe[b] is true if the byte b is copied as is into a JSON string.
+var jsonSafe = func() (t [utf8.RuneSelf]bool) {
+	for b := 0x20; b < utf8.RuneSelf; b++ {
+		t[b] = b != '"' && b != '\\'
+	}
+	return
+}()
+
+// appendJSONString appends s as a quoted JSON string, in a single pass.
+// Invalid UTF-8 is replaced by U+FFFD.
+func appendJSONString(dst []byte, s string) []byte {
+	dst = append(dst, '"')
+	dst, _ = appendJSONEscaped(dst, s, false)
+	return append(dst, '"')
+}
+
+// appendJSONEscaped appends the escaped content of s. If strict, it stops at
+// the first invalid UTF-8 sequence and returns false.
+func appendJSONEscaped(dst []byte, s string, strict bool) ([]byte, bool) {
+	start := 0
+	for i := 0; i < len(s); {
+		b := s[i]
+		if b < utf8.RuneSelf {
+			if jsonSafe[b] {
+				i++
+				continue
+			}
+			dst = append(dst, s[start:i]...)
+			switch b {
+			case '"', '\\':
+				dst = append(dst, '\\', b)
+			case '\n':
+				dst = append(dst, '\\', 'n')
+			case '\r':
+				dst = append(dst, '\\', 'r')
+			case '\t':
+				dst = append(dst, '\\', 't')
+			default:
+				dst = append(dst, '\\', 'u', '0', '0', jsonHex[b>>4], jsonHex[b&0xF])
+			}
+			i++
+			start = i
+			continue
+		}
+		r, size := utf8.DecodeRuneInString(s[i:])
+		if r == utf8.RuneError && size == 1 {
+			if strict {
+				return dst, false
+			}
+			dst = append(dst, s[start:i]...)
+			dst = append(dst, "\ufffd"...)
+			i += size
+			start = i
+			continue
+		}
+		i += size
+	}
+	return append(dst, s[start:]...), true
+}
+
+// appendJSONPayload appends the field "key" with b as a JSON string if it is
+// valid UTF-8, else the field "key_base64" with b in base64. Text, the
+// common case, is only read once.
+func appendJSONPayload(dst []byte, key string, b []byte) []byte {
+	mark := len(dst)
+	dst = appendJSONKey(dst, key)
+	dst = append(dst, '"')
+	dst, ok := appendJSONEscaped(dst, bytesToString(b), true)
+	if ok {
+		return append(dst, '"')
+	}
+
+	dst = appendJSONKey(dst[:mark], key+"_base64")
+	dst = append(dst, '"')
+	n := base64.StdEncoding.EncodedLen(len(b))
+	if cap(dst)-len(dst) < n+1 {
+		grown := make([]byte, len(dst), len(dst)+n+1)
+		copy(grown, dst)
+		dst = grown
+	}
+	base64.StdEncoding.Encode(dst[len(dst):len(dst)+n], b)
+	return append(dst[:len(dst)+n], '"')
+}
+
+// appendJSONKey appends ,"key": , key must not need escaping.
+func appendJSONKey(dst []byte, key string) []byte {
+	dst = append(dst, ',', '"')
+	dst = append(dst, key...)
+	return append(dst, '"', ':')
+}
+
+func appendJSONUint(dst []byte, key string, v uint64) []byte {
+	return strconv.AppendUint(appendJSONKey(dst, key), v, 10)
+}
+
+func appendJSONInt(dst []byte, key string, v int64) []byte {
+	return strconv.AppendInt(appendJSONKey(dst, key), v, 10)
+}
+
+func appendJSONField(dst []byte, key, v string) []byte {
+	return appendJSONString(appendJSONKey(dst, key), v)
+}
+
+// appendJSONHeader opens the object of an event with the fields of its
+// header: {"event":..., "time_ns":..., "pid":..., "tid":..., "comm":...
+// The caller appends its own fields and the closing brace.
+func appendJSONHeader(dst []byte, h *EventHeader, comm string) []byte {
+	dst = append(dst, `{"event":"`...)
+	dst = append(dst, h.Type.String()...)
+	dst = append(dst, '"')
+	dst = appendJSONUint(dst, "time_ns", h.TimestampNs)
+	dst = appendJSONUint(dst, "pid", uint64(h.Pid))
+	dst = appendJSONUint(dst, "tid", uint64(h.Tid))
+	dst = appendJSONUint(dst, "cgroup_id", h.CgroupId)
+	return appendJSONField(dst, "comm", comm)
+}
+
+// bytesToString returns b as a string without copying, the string must not
+// outlive b.
+func bytesToString(b []byte) string {
+	return *(*string)(unsafe.Pointer(&b))
+}
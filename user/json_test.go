@@ -0,0 +1,135 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"encoding/base64"
+	"encoding/json"
+	"strings"
+	"testing"
+)
+
+func TestAppendJSONString(t *testing.T) {
+	for _, c := range []struct {
+		in, want string
+	}{
+		{"", `""`},
+		{"select 1", `"select 1"`},
+		{`a"b\c`, `"a\"b\\c"`},
+		{"a\nb\rc\td", `"a\nb\rc\td"`},
+		{"\x00\x01\x1f\x7f", `"\u0000\u0001\u001f` + "\x7f" + `"`},
+		{"héllo, 世界", `"héllo, 世界"`},
+		{"a\xffb", "\"a�b\""},
+		{"\xe4\xb8", "\"��\""},
+	} {
+		got := appendJSONString(nil, c.in)
+		if string(got) != c.want {
+			t.Errorf("%q: %s, want %s", c.in, got, c.want)
+			continue
+		}
+		var s string
+		if err := json.Unmarshal(got, &s); err != nil {
+			t.Errorf("%q: %s: %v", c.in, got, err)
+		}
+	}
+}
+
+// Payloads are strings if they are valid UTF-8, else base64 in a field of
+// their own.
+func TestAppendJSONPayload(t *testing.T) {
+	for _, c := range []struct {
+		in, key, want string
+	}{
+		{"GET / HTTP/1.1\r\n", "data", "GET / HTTP/1.1\r\n"},
+		{"\"quoted\" \\ \x01", "data", "\"quoted\" \\ \x01"},
+		{"\x16\x03\x01\x00\xa5\xff", "data_base64", base64.StdEncoding.EncodeToString([]byte("\x16\x03\x01\x00\xa5\xff"))},
+		{"valid text then \xc3", "data_base64", base64.StdEncoding.EncodeToString([]byte("valid text then \xc3"))},
+	} {
+		// the base64 fallback grows dst itself, start without spare room.
+		for _, dst := range [][]byte{[]byte("{\"x\":1"), append(make([]byte, 0, 1024), "{\"x\":1"...)} {
+			b := append(appendJSONPayload(dst, "data", []byte(c.in)), '}')
+			var fields map[string]interface{}
+			if err := json.Unmarshal(b, &fields); err != nil {
+				t.Fatalf("%q: %s: %v", c.in, b, err)
+			}
+			if len(fields) != 2 || fields[c.key] != c.want {
+				t.Errorf("%q: %s, want %q: %q", c.in, b, c.key, c.want)
+			}
+		}
+	}
+}
+
+func TestTrimNul(t *testing.T) {
+	for _, c := range []struct {
+		in, want string
+	}{
+		{"", ""},
+		{"ls", "ls"},
+		{"ls\x00", "ls"},
+		{"ls\x00-al\x00", "ls"},
+		{"\x00ls", ""},
+	} {
+		if got := string(trimNul([]byte(c.in))); got != c.want {
+			t.Errorf("%q: %q, want %q", c.in, got, c.want)
+		}
+	}
+}
+
+// Every event appends one valid JSON object, its header fields first.
+func TestAppendJSON(t *testing.T) {
+	for _, d := range testDecoders {
+		if err := d.event.Decode(d.payload); err != nil {
+			t.Fatalf("%s: %v", d.name, err)
+		}
+		a, ok := d.event.(interface{ AppendJSON([]byte) []byte })
+		if !ok {
+			continue
+		}
+		b := a.AppendJSON(nil)
+		var fields map[string]interface{}
+		if err := json.Unmarshal(b, &fields); err != nil {
+			t.Fatalf("%s: %s: %v", d.name, b, err)
+		}
+		for key, want := range map[string]interface{}{"time_ns": 123456789.0, "pid": 1000.0, "tid": 1001.0, "cgroup_id": 42.0} {
+			if fields[key] != want {
+				t.Errorf("%s: %s is %v, want %v", d.name, key, fields[key], want)
+			}
+		}
+		switch d.name {
+		case "tls":
+			if fields["data"] != strings.Repeat("a", 256) || fields["lib"] != "openssl" || fields["addr"] != nil {
+				t.Errorf("tls: %s", b)
+			}
+		case "bash":
+			// the line is trimmed at its NUL.
+			if fields["line"] != "ls -al /tmp" || fields["tty"] != "pts/0" {
+				t.Errorf("bash: %s", b)
+			}
+		case "postgres":
+			if fields["query"] != "select 1" {
+				t.Errorf("postgres: %s", b)
+			}
+		}
+	}
+}
+
+func BenchmarkAppendJSON(b *testing.B) {
+	for _, d := range testDecoders {
+		a, ok := d.event.(interface{ AppendJSON([]byte) []byte })
+		if !ok {
+			continue
+		}
+		if err := d.event.Decode(d.payload); err != nil {
+			b.Fatal(err)
+		}
+		b.Run(d.name, func(b *testing.B) {
+			dst := a.AppendJSON(nil)
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				dst = a.AppendJSON(dst[:0])
+			}
+		})
+	}
+}
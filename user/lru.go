@@ -0,0 +1,85 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import "container/list"
+
+// lruCache is a bounded map, the least recently used entry is dropped when
+// it is full. It is not safe for concurrent use.
+type lruCache struct {
+	size  int
+	ll    *list.List // of *lruEntry, most recently used first
+	items map[interface{}]*list.Element
+
+	// onEvict, if set, is called with the entries dropped by Add.
+	onEvict func(key, value interface{})
+}
+
+type lruEntry struct {
+	key   interface{}
+	value interface{}
+}
+
+func newLruCache(size int) *lruCache {
+	return &lruCache{
+		size:  size,
+		ll:    list.New(),
+		items: make(map[interface{}]*list.Element),
+	}
+}
+
+// Get returns the value of key, and marks it as recently used.
+func (this *lruCache) Get(key interface{}) (interface{}, bool) {
+	e, f := this.items[key]
+	if !f {
+		return nil, false
+	}
+	this.ll.MoveToFront(e)
+	return e.Value.(*lruEntry).value, true
+}
+
+// Add sets the value of key, dropping the least recently used entry if the
+// cache is full.
+func (this *lruCache) Add(key, value interface{}) {
+	if e, f := this.items[key]; f {
+		e.Value.(*lruEntry).value = value
+		this.ll.MoveToFront(e)
+		return
+	}
+	this.items[key] = this.ll.PushFront(&lruEntry{key: key, value: value})
+	if this.ll.Len() > this.size {
+		oldest := this.ll.Back()
+		this.ll.Remove(oldest)
+		entry := oldest.Value.(*lruEntry)
+		delete(this.items, entry.key)
+		if this.onEvict != nil {
+			this.onEvict(entry.key, entry.value)
+		}
+	}
+}
+
+// Remove drops key.
+func (this *lruCache) Remove(key interface{}) {
+	if e, f := this.items[key]; f {
+		this.ll.Remove(e)
+		delete(this.items, key)
+	}
+}
+
+// RemoveOldest drops the least recently used entry, and returns it.
+func (this *lruCache) RemoveOldest() (key, value interface{}, ok bool) {
+	oldest := this.ll.Back()
+	if oldest == nil {
+		return nil, nil, false
+	}
+	this.ll.Remove(oldest)
+	entry := oldest.Value.(*lruEntry)
+	delete(this.items, entry.key)
+	return entry.key, entry.value, true
+}
+
+func (this *lruCache) Len() int {
+	return this.ll.Len()
+}
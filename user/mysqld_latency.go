@@ -0,0 +1,88 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"fmt"
+	"strings"
+	"time"
+
+	"github.com/cilium/ebpf"
+)
+
+// enum stmt_type and MYSQLD_LATENCY_SLOTS in kern/mysqld_kern.c
+const MYSQLD_LATENCY_SLOTS = 32
+
+var mysqldStmtTypes = []string{"SELECT", "INSERT", "UPDATE", "DELETE", "DDL", "OTHER"}
+
+// mysqldLatency prints the query latency histograms of latency_hist every
+// interval, until the module is stopped. Each report only counts the queries
+// finished since the previous one.
+func (this *MMysqldProbe) mysqldLatency(histMap *ebpf.Map, interval time.Duration) {
+	var prev = make([]uint64, len(mysqldStmtTypes)*MYSQLD_LATENCY_SLOTS)
+	ticker := time.NewTicker(interval)
+	defer ticker.Stop()
+	for {
+		select {
+		case <-this.ctx.Done():
+			return
+		case <-ticker.C:
+		}
+
+		var b strings.Builder
+		for t, name := range mysqldStmtTypes {
+			var slots = make([]uint64, MYSQLD_LATENCY_SLOTS)
+			var total uint64
+			for i := range slots {
+				index := uint32(t*MYSQLD_LATENCY_SLOTS + i)
+				var count uint64
+				if err := histMap.Lookup(index, &count); err != nil {
+					this.logger.Printf("lookup latency_hist[%d] error:%v", index, err)
+					return
+				}
+				slots[i] = count - prev[index]
+				prev[index] = count
+				total += slots[i]
+			}
+			if total == 0 {
+				continue
+			}
+			fmt.Fprintf(&b, "\nstmt = %s, count = %d\n", name, total)
+			b.WriteString(formatLog2Hist("usecs", slots))
+		}
+		if b.Len() == 0 {
+			continue
+		}
+		this.logger.Printf("mysqld query latency, last %s:%s", interval, b.String())
+	}
+}
+
+// formatLog2Hist renders log2 slots as a text histogram, slot i counts the
+// values in [2^i, 2^(i+1)), slot 0 counts 0 and 1 too.
+func formatLog2Hist(unit string, slots []uint64) string {
+	const width = 40
+	var max uint64
+	last := -1
+	for i, v := range slots {
+		if v > max {
+			max = v
+		}
+		if v > 0 {
+			last = i
+		}
+	}
+	var b strings.Builder
+	fmt.Fprintf(&b, "%24s : %-10s |%-*s|\n", unit, "count", width, "distribution")
+	for i := 0; i <= last; i++ {
+		var low, high uint64
+		if i > 0 {
+			low = 1 << uint(i)
+		}
+		high = 1<<uint(i+1) - 1
+		stars := int(slots[i] * width / max)
+		fmt.Fprintf(&b, "%10d -> %-10d : %-10d |%-*s|\n", low, high, slots[i], width, strings.Repeat("*", stars))
+	}
+	return b.String()
+}
@@ -0,0 +1,59 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"sync"
+)
+
+// upper bound of cached prepared statements.
+const MYSQLD_STMT_CACHE_SIZE = 10240
+
+type mysqldStmtKey struct {
+	conn uint32
+	id   uint32
+}
+
+// mysqldStmtCache maps (connection, statement id) to the SQL of prepared
+// statements, so that an execute only carries the id and its parameters.
+// The ids are the ones mysqld gave, read by the return probe of the prepare
+// (see --thd-stmt-id-offset); they are never guessed, an unknown statement
+// is reported as such rather than as another one.
+type mysqldStmtCache struct {
+	sync.Mutex
+	stmts *lruCache // mysqldStmtKey -> SQL
+}
+
+func newMysqldStmtCache() *mysqldStmtCache {
+	return &mysqldStmtCache{
+		stmts: newLruCache(MYSQLD_STMT_CACHE_SIZE),
+	}
+}
+
+// Prepare records the statement id prepared on conn. A new connection on the
+// same key numbers its statements from 1 again, and overwrites them.
+func (this *mysqldStmtCache) Prepare(conn, id uint32, sql string) {
+	this.Lock()
+	defer this.Unlock()
+	this.stmts.Add(mysqldStmtKey{conn: conn, id: id}, sql)
+}
+
+// Get returns the SQL of a statement, "" if it is unknown.
+func (this *mysqldStmtCache) Get(conn, id uint32) string {
+	this.Lock()
+	defer this.Unlock()
+	sql, f := this.stmts.Get(mysqldStmtKey{conn: conn, id: id})
+	if !f {
+		return ""
+	}
+	return sql.(string)
+}
+
+// Close drops a statement closed by the client.
+func (this *mysqldStmtCache) Close(conn, id uint32) {
+	this.Lock()
+	defer this.Unlock()
+	this.stmts.Remove(mysqldStmtKey{conn: conn, id: id})
+}
@@ -0,0 +1,249 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"io"
+	"log"
+	"os"
+	"sync"
+	"time"
+)
+
+const (
+	// bytes buffered by the output of a module before they are written.
+	OUTPUT_BUFFER_SIZE = 64 * 1024
+
+	// buffered events are written at least this often.
+	OUTPUT_FLUSH_INTERVAL = 200 * time.Millisecond
+
+	// larger formatting buffers are not kept in outputBuffers.
+	OUTPUT_POOL_MAX_SIZE = 64 * 1024
+
+	// --format
+	OUTPUT_FORMAT_TEXT = "text"
+	OUTPUT_FORMAT_JSON = "json"
+)
+
+// eventAppender is implemented by events that format themselves into a
+// buffer, as String/StringHex would, without building intermediate strings.
+type eventAppender interface {
+	AppendString(dst []byte) []byte
+	AppendStringHex(dst []byte) []byte
+}
+
+// orderedAppender is implemented by output events whose head depends on state
+// the sink updates in read order, eg: the address of a connection, set by an
+// earlier connect event. The decoders of the pipeline format the payload in
+// parallel, the sink the head, when the turn of the event comes.
+type orderedAppender interface {
+	appendHead(dst []byte, json bool) []byte
+	appendPayload(dst []byte, json, hex bool) []byte
+}
+
+// appendEvent appends event to dst, formatted like String or StringHex.
+func appendEvent(dst []byte, event IEventStruct, hex bool) []byte {
+	if a, ok := event.(eventAppender); ok {
+		if hex {
+			return a.AppendStringHex(dst)
+		}
+		return a.AppendString(dst)
+	}
+	if hex {
+		return append(dst, event.StringHex()...)
+	}
+	return append(dst, event.String()...)
+}
+
+// outputBuffers are the buffers decoders format output events into.
+var outputBuffers = sync.Pool{
+	New: func() interface{} {
+		b := make([]byte, 0, 4096)
+		return &b
+	},
+}
+
+func getOutputBuffer() *[]byte {
+	b := outputBuffers.Get().(*[]byte)
+	*b = (*b)[:0]
+	return b
+}
+
+func putOutputBuffer(b *[]byte) {
+	if cap(*b) > OUTPUT_POOL_MAX_SIZE {
+		return
+	}
+	outputBuffers.Put(b)
+}
+
+// moduleOutput buffers the events printed by a module, and writes them to the
+// writer of its logger in batches, on size or on time, instead of one
+// logger.Println, one lock and one write(2) per event.
+//
+// Every module has its own moduleOutput, and only the sink of its pipeline
+// writes to it, so the lock is never contended: it only orders the sink and
+// a final Flush from another goroutine on exit. Lines keep the prefix and
+// the date/time of the logger, so the output reads as before.
+type moduleOutput struct {
+	lock    sync.Mutex
+	logger  *log.Logger
+	w       io.Writer
+	buf     []byte
+	discard bool // events go to a capture file, see --write
+	json    bool // JSON Lines on stdout, see --format
+
+	// date/time of the last line, formatted once per second.
+	stamp      []byte
+	stampSec   int64
+	stampFlags int
+}
+
+func newModuleOutput(logger *log.Logger) *moduleOutput {
+	return &moduleOutput{
+		logger: logger,
+		w:      logger.Writer(),
+		buf:    make([]byte, 0, OUTPUT_BUFFER_SIZE),
+	}
+}
+
+// setJSON switches to --format json: one object per line, without the log
+// prefix, on stdout so that the logs of eCapture stay out of the stream.
+func (this *moduleOutput) setJSON() {
+	this.lock.Lock()
+	this.json = true
+	this.w = os.Stdout
+	this.lock.Unlock()
+}
+
+// format appends event to dst, as JSON or as text.
+func (this *moduleOutput) format(dst []byte, event IEventStruct, hex bool) []byte {
+	if this.json {
+		return event.AppendJSON(dst)
+	}
+	return appendEvent(dst, event, hex)
+}
+
+// formatPayload appends what the decoders can format ahead of the turn of
+// event, the payload of an orderedAppender.
+func (this *moduleOutput) formatPayload(dst []byte, event orderedAppender, hex bool) []byte {
+	return event.appendPayload(dst, this.json, hex)
+}
+
+// appendHeader appends the prefix and the date/time log.Logger would write.
+func (this *moduleOutput) appendHeader(dst []byte) []byte {
+	if this.json {
+		return dst
+	}
+	flags := this.logger.Flags()
+	if flags&log.Lmsgprefix == 0 {
+		dst = append(dst, this.logger.Prefix()...)
+	}
+	if flags&(log.Ldate|log.Ltime|log.Lmicroseconds) != 0 {
+		now := time.Now()
+		if flags&log.LUTC != 0 {
+			now = now.UTC()
+		}
+		if sec := now.Unix(); flags&log.Lmicroseconds != 0 || sec != this.stampSec || flags != this.stampFlags {
+			layout := ""
+			if flags&log.Ldate != 0 {
+				layout = "2006/01/02 "
+			}
+			if flags&(log.Ltime|log.Lmicroseconds) != 0 {
+				layout += "15:04:05"
+				if flags&log.Lmicroseconds != 0 {
+					layout += ".000000"
+				}
+				layout += " "
+			}
+			this.stamp = now.AppendFormat(this.stamp[:0], layout)
+			this.stampSec, this.stampFlags = sec, flags
+		}
+		dst = append(dst, this.stamp...)
+	}
+	if flags&log.Lmsgprefix != 0 {
+		dst = append(dst, this.logger.Prefix()...)
+	}
+	return dst
+}
+
+// endLine terminates the line started at start, and flushes a full buffer.
+func (this *moduleOutput) endLine(start int) {
+	if len(this.buf) == start || this.buf[len(this.buf)-1] != '\n' {
+		this.buf = append(this.buf, '\n')
+	}
+	if len(this.buf) >= OUTPUT_BUFFER_SIZE {
+		this.flush()
+	}
+}
+
+// Write buffers p as one line.
+func (this *moduleOutput) Write(p []byte) {
+	if this.discard {
+		return
+	}
+	this.lock.Lock()
+	this.buf = this.appendHeader(this.buf)
+	start := len(this.buf)
+	this.buf = append(this.buf, p...)
+	this.endLine(start)
+	this.lock.Unlock()
+}
+
+// WriteString buffers s as one line.
+func (this *moduleOutput) WriteString(s string) {
+	if this.discard {
+		return
+	}
+	this.lock.Lock()
+	this.buf = this.appendHeader(this.buf)
+	start := len(this.buf)
+	this.buf = append(this.buf, s...)
+	this.endLine(start)
+	this.lock.Unlock()
+}
+
+// WriteEvent formats event straight into the buffer, as one line.
+func (this *moduleOutput) WriteEvent(event IEventStruct, hex bool) {
+	if this.discard {
+		return
+	}
+	this.lock.Lock()
+	this.buf = this.appendHeader(this.buf)
+	start := len(this.buf)
+	this.buf = this.format(this.buf, event, hex)
+	this.endLine(start)
+	this.lock.Unlock()
+}
+
+// WriteFormatted buffers event as one line, payload was formatted by
+// formatPayload and the head is formatted now.
+func (this *moduleOutput) WriteFormatted(event orderedAppender, payload []byte) {
+	if this.discard {
+		return
+	}
+	this.lock.Lock()
+	this.buf = this.appendHeader(this.buf)
+	start := len(this.buf)
+	this.buf = event.appendHead(this.buf, this.json)
+	this.buf = append(this.buf, payload...)
+	this.endLine(start)
+	this.lock.Unlock()
+}
+
+// Flush writes the buffered lines.
+func (this *moduleOutput) Flush() error {
+	this.lock.Lock()
+	defer this.lock.Unlock()
+	return this.flush()
+}
+
+func (this *moduleOutput) flush() error {
+	if len(this.buf) == 0 {
+		return nil
+	}
+	_, err := this.w.Write(this.buf)
+	this.buf = this.buf[:0]
+	return err
+}
@@ -0,0 +1,338 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"bufio"
+	"context"
+	"encoding/binary"
+	"net"
+	"os"
+	"strconv"
+	"sync"
+	"time"
+
+	"golang.org/x/sys/unix"
+)
+
+// pcapng, see https://www.ietf.org/archive/id/draft-tuexen-opsawg-pcapng-05.html
+const (
+	PCAPNG_BLOCK_SHB        = 0x0A0D0D0A
+	PCAPNG_BLOCK_IDB        = 0x00000001
+	PCAPNG_BLOCK_EPB        = 0x00000006
+	PCAPNG_BYTE_ORDER_MAGIC = 0x1A2B3C4D
+
+	PCAPNG_OPT_ENDOFOPT  = 0
+	PCAPNG_OPT_COMMENT   = 1
+	PCAPNG_OPT_USERAPPL  = 4 // shb_userappl
+	PCAPNG_OPT_TSRESOL   = 9 // if_tsresol
+	PCAPNG_TSRESOL_NANOS = 9
+
+	// packets start with the IPv4 or IPv6 header, no link layer.
+	LINKTYPE_RAW = 101
+
+	PCAPNG_BUFFER_SIZE    = 256 * 1024
+	PCAPNG_FLUSH_INTERVAL = time.Second
+
+	// connections with TCP state, the least recently used one is dropped.
+	PCAPNG_CONNS = 65536
+
+	// synthesized local ports are taken from the ephemeral range.
+	PCAPNG_PORT_BASE  = 32768
+	PCAPNG_PORT_RANGE = 28232
+
+	IPPROTO_TCP = 6
+
+	TCP_FLAG_FIN = 0x01
+	TCP_FLAG_SYN = 0x02
+	TCP_FLAG_PSH = 0x08
+	TCP_FLAG_ACK = 0x10
+)
+
+// pcapConn is the TCP state of a connection, seq and ack are the next
+// sequence numbers of the local and of the remote side.
+type pcapConn struct {
+	remote connAddr
+	port   uint16 // synthesized local port
+	seq    uint32
+	ack    uint32
+}
+
+// pcapWriter writes the plaintext of TLS connections as a pcapng file. Each
+// SSL_write/SSL_read becomes a TCP segment from/to the remote address of the
+// connection, with sequence numbers kept per direction, so that Wireshark
+// reassembles the streams and dissects HTTP, gRPC... on top of them.
+//
+// The local endpoint is synthesized: 10.x.y.z (or fd00::pid) from the pid,
+// and a port allocated per connection, so that every (pid, fd) is a stream
+// of its own. Writes are batched in a bufio.Writer, flushed every
+// PCAPNG_FLUSH_INTERVAL.
+type pcapWriter struct {
+	lock   sync.Mutex
+	f      *os.File
+	w      *bufio.Writer
+	conns  *lruCache // connKey -> *pcapConn
+	serial uint32
+
+	// wall clock - CLOCK_MONOTONIC, to convert bpf_ktime_get_ns.
+	bootOffset int64
+
+	pkt   []byte
+	block []byte
+}
+
+func newPcapWriter(path string) (*pcapWriter, error) {
+	f, err := os.OpenFile(path, os.O_WRONLY|os.O_CREATE|os.O_TRUNC, 0600)
+	if err != nil {
+		return nil, err
+	}
+	this := &pcapWriter{
+		f:     f,
+		w:     bufio.NewWriterSize(f, PCAPNG_BUFFER_SIZE),
+		conns: newLruCache(PCAPNG_CONNS),
+	}
+	var ts unix.Timespec
+	if err = unix.ClockGettime(unix.CLOCK_MONOTONIC, &ts); err != nil {
+		f.Close()
+		return nil, err
+	}
+	this.bootOffset = time.Now().UnixNano() - ts.Nano()
+
+	// Section Header Block
+	b := appendUint32(nil, PCAPNG_BYTE_ORDER_MAGIC)
+	b = append(b, 1, 0, 0, 0) // version 1.0
+	b = appendUint64(b, 0xFFFFFFFFFFFFFFFF)
+	b = appendPcapngOption(b, PCAPNG_OPT_USERAPPL, "eCapture")
+	b = appendPcapngOption(b, PCAPNG_OPT_ENDOFOPT, "")
+	this.writeBlock(PCAPNG_BLOCK_SHB, b)
+
+	// Interface Description Block
+	b = append(b[:0], byte(LINKTYPE_RAW), byte(LINKTYPE_RAW>>8), 0, 0)
+	b = appendUint32(b, 0) // snaplen, no limit
+	b = appendPcapngOption(b, PCAPNG_OPT_TSRESOL, string([]byte{PCAPNG_TSRESOL_NANOS}))
+	b = appendPcapngOption(b, PCAPNG_OPT_ENDOFOPT, "")
+	this.writeBlock(PCAPNG_BLOCK_IDB, b)
+	if err = this.w.Flush(); err != nil {
+		f.Close()
+		return nil, err
+	}
+	return this, nil
+}
+
+// writeBlock writes a block of type typ around body, which must be padded.
+func (this *pcapWriter) writeBlock(typ uint32, body []byte) {
+	total := uint32(12 + len(body))
+	var h [8]byte
+	binary.LittleEndian.PutUint32(h[0:4], typ)
+	binary.LittleEndian.PutUint32(h[4:8], total)
+	this.w.Write(h[:])
+	this.w.Write(body)
+	this.w.Write(h[4:8])
+}
+
+// WriteEvent writes the data of e as a TCP segment of its connection, to or
+// from remote.
+func (this *pcapWriter) WriteEvent(e *SSLDataEvent, remote connAddr) {
+	this.lock.Lock()
+	defer this.lock.Unlock()
+
+	// gnutls and nspr events carry no fd (0): all their connections in a
+	// process share one stream, to an unknown remote address.
+	key := connKey{pid: e.Pid, fd: e.ConnKey}
+	ts := int64(e.TimestampNs) + this.bootOffset
+	var c *pcapConn
+	if v, found := this.conns.Get(key); found {
+		c = v.(*pcapConn)
+		// the fd was reused for another connection.
+		if c.remote != remote && remote != (connAddr{}) {
+			this.close(key, c, ts)
+			c = nil
+		}
+	}
+	if c == nil {
+		c = this.open(key, remote, ts)
+	}
+
+	comment := "PID:" + strconv.FormatUint(uint64(e.Pid), 10) + ", Comm:" + processes.Comm(e.Pid) + ", Lib:" + e.library()
+	switch e.Type {
+	case KERNEL_EVENT_TLS_WRITE:
+		this.segment(key.pid, c, true, TCP_FLAG_PSH|TCP_FLAG_ACK, e.Data, ts, comment)
+		c.seq += uint32(len(e.Data))
+	case KERNEL_EVENT_TLS_READ:
+		this.segment(key.pid, c, false, TCP_FLAG_PSH|TCP_FLAG_ACK, e.Data, ts, comment)
+		c.ack += uint32(len(e.Data))
+	}
+}
+
+// Reset ends the stream of (pid, fd), a new connection starts on the fd.
+func (this *pcapWriter) Reset(pid, fd uint32, ts uint64) {
+	this.lock.Lock()
+	defer this.lock.Unlock()
+	key := connKey{pid: pid, fd: fd}
+	if v, found := this.conns.Get(key); found {
+		this.close(key, v.(*pcapConn), int64(ts)+this.bootOffset)
+	}
+}
+
+// open starts the stream of a connection with a handshake.
+func (this *pcapWriter) open(key connKey, remote connAddr, ts int64) *pcapConn {
+	this.serial++
+	c := &pcapConn{
+		remote: remote,
+		port:   uint16(PCAPNG_PORT_BASE + this.serial%PCAPNG_PORT_RANGE),
+		seq:    this.serial * 0x9E3779B1, // any ISN, but not the same for all
+		ack:    ^(this.serial * 0x9E3779B1),
+	}
+	this.conns.Add(key, c)
+	this.segment(key.pid, c, true, TCP_FLAG_SYN, nil, ts, "")
+	c.seq++
+	this.segment(key.pid, c, false, TCP_FLAG_SYN|TCP_FLAG_ACK, nil, ts, "")
+	c.ack++
+	this.segment(key.pid, c, true, TCP_FLAG_ACK, nil, ts, "")
+	return c
+}
+
+// close ends the stream of a connection with FINs from both sides.
+func (this *pcapWriter) close(key connKey, c *pcapConn, ts int64) {
+	this.segment(key.pid, c, true, TCP_FLAG_FIN|TCP_FLAG_ACK, nil, ts, "")
+	c.seq++
+	this.segment(key.pid, c, false, TCP_FLAG_FIN|TCP_FLAG_ACK, nil, ts, "")
+	c.ack++
+	this.segment(key.pid, c, true, TCP_FLAG_ACK, nil, ts, "")
+	this.conns.Remove(key)
+}
+
+// segment writes an Enhanced Packet Block with an IP+TCP segment, from the
+// local side if outbound.
+func (this *pcapWriter) segment(pid uint32, c *pcapConn, outbound bool, flags byte, payload []byte, ts int64, comment string) {
+	var local, remote [net.IPv6len]byte
+	ipv6 := c.remote.ipv6
+	remote = c.remote.ip
+	if ipv6 {
+		local[0], local[1] = 0xfd, 0x00
+		binary.BigEndian.PutUint32(local[12:16], pid)
+	} else {
+		local[0], local[1], local[2], local[3] = 10, byte(pid>>16), byte(pid>>8), byte(pid)
+	}
+	src, dst := local, remote
+	sport, dport := c.port, c.remote.port
+	seq, ack := c.seq, c.ack
+	if !outbound {
+		src, dst = remote, local
+		sport, dport = dport, sport
+		seq, ack = ack, seq
+	}
+
+	pkt := this.pkt[:0]
+	tcpLen := 20 + len(payload)
+	var ipLen int
+	if ipv6 {
+		ipLen = 40
+		pkt = append(pkt, 0x60, 0, 0, 0, byte(tcpLen>>8), byte(tcpLen), IPPROTO_TCP, 64)
+		pkt = append(pkt, src[:]...)
+		pkt = append(pkt, dst[:]...)
+	} else {
+		ipLen = 20
+		total := ipLen + tcpLen
+		pkt = append(pkt, 0x45, 0, byte(total>>8), byte(total), 0, 0, 0x40, 0, 64, IPPROTO_TCP, 0, 0)
+		pkt = append(pkt, src[:4]...)
+		pkt = append(pkt, dst[:4]...)
+		binary.BigEndian.PutUint16(pkt[10:12], ^foldChecksum(checksum(0, pkt[:20])))
+	}
+	if flags&TCP_FLAG_ACK == 0 {
+		ack = 0
+	}
+	pkt = append(pkt, byte(sport>>8), byte(sport), byte(dport>>8), byte(dport))
+	pkt = append(pkt, byte(seq>>24), byte(seq>>16), byte(seq>>8), byte(seq))
+	pkt = append(pkt, byte(ack>>24), byte(ack>>16), byte(ack>>8), byte(ack))
+	pkt = append(pkt, 5<<4, flags, 0xff, 0xff, 0, 0, 0, 0)
+	pkt = append(pkt, payload...)
+
+	// pseudo header, then the segment.
+	var sum uint32
+	if ipv6 {
+		sum = checksum(0, pkt[8:40])
+	} else {
+		sum = checksum(0, pkt[12:20])
+	}
+	sum += IPPROTO_TCP + uint32(tcpLen)
+	sum = checksum(sum, pkt[ipLen:])
+	binary.BigEndian.PutUint16(pkt[ipLen+16:ipLen+18], ^foldChecksum(sum))
+	this.pkt = pkt
+
+	b := appendUint32(this.block[:0], 0) // interface
+	b = appendUint32(b, uint32(uint64(ts)>>32))
+	b = appendUint32(b, uint32(ts))
+	b = appendUint32(b, uint32(len(pkt)))
+	b = appendUint32(b, uint32(len(pkt)))
+	b = append(b, pkt...)
+	b = append(b, make([]byte, pcapngPad(len(pkt)))...)
+	if comment != "" {
+		b = appendPcapngOption(b, PCAPNG_OPT_COMMENT, comment)
+		b = appendPcapngOption(b, PCAPNG_OPT_ENDOFOPT, "")
+	}
+	this.block = b
+	this.writeBlock(PCAPNG_BLOCK_EPB, b)
+}
+
+func (this *pcapWriter) Flush() error {
+	this.lock.Lock()
+	defer this.lock.Unlock()
+	return this.w.Flush()
+}
+
+func (this *pcapWriter) Close() error {
+	err := this.Flush()
+	if e := this.f.Close(); err == nil {
+		err = e
+	}
+	return err
+}
+
+// run flushes the writer every PCAPNG_FLUSH_INTERVAL until ctx is done.
+func (this *pcapWriter) run(ctx context.Context) {
+	ticker := time.NewTicker(PCAPNG_FLUSH_INTERVAL)
+	defer ticker.Stop()
+	for {
+		select {
+		case _ = <-ctx.Done():
+			return
+		case _ = <-ticker.C:
+			this.Flush()
+		}
+	}
+}
+
+func pcapngPad(n int) int {
+	return (4 - n%4) % 4
+}
+
+func appendPcapngOption(dst []byte, code uint16, value string) []byte {
+	dst = append(dst, byte(code), byte(code>>8), byte(len(value)), byte(len(value)>>8))
+	dst = append(dst, value...)
+	for i := pcapngPad(len(value)); i > 0; i-- {
+		dst = append(dst, 0)
+	}
+	return dst
+}
+
+// checksum adds b to the ones' complement sum, as big endian 16-bit words.
+func checksum(sum uint32, b []byte) uint32 {
+	for len(b) >= 2 {
+		sum += uint32(b[0])<<8 | uint32(b[1])
+		b = b[2:]
+	}
+	if len(b) == 1 {
+		sum += uint32(b[0]) << 8
+	}
+	return sum
+}
+
+func foldChecksum(sum uint32) uint16 {
+	for sum>>16 != 0 {
+		sum = sum&0xffff + sum>>16
+	}
+	return uint16(sum)
+}
@@ -0,0 +1,230 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"bytes"
+	"encoding/binary"
+	"net"
+	"os"
+	"path/filepath"
+	"testing"
+)
+
+// pcapSegment is a TCP segment read back from a pcapng file.
+type pcapSegment struct {
+	src, dst     net.IP
+	sport, dport uint16
+	seq, ack     uint32
+	flags        byte
+	payload      string
+	comment      string
+}
+
+// readPcapng checks the framing of the blocks of a pcapng file and returns
+// the segments of its Enhanced Packet Blocks.
+func readPcapng(t *testing.T, b []byte) []pcapSegment {
+	var segments []pcapSegment
+	for n := 0; len(b) > 0; n++ {
+		if len(b) < 12 {
+			t.Fatalf("block %d: %d trailing bytes", n, len(b))
+		}
+		typ := binary.LittleEndian.Uint32(b[0:4])
+		total := int(binary.LittleEndian.Uint32(b[4:8]))
+		if total%4 != 0 || total > len(b) {
+			t.Fatalf("block %d: length %d, %d bytes left", n, total, len(b))
+		}
+		if trailer := int(binary.LittleEndian.Uint32(b[total-4 : total])); trailer != total {
+			t.Fatalf("block %d: trailing length %d, want %d", n, trailer, total)
+		}
+		body := b[8 : total-4]
+		b = b[total:]
+
+		switch {
+		case n == 0:
+			if typ != PCAPNG_BLOCK_SHB || binary.LittleEndian.Uint32(body[0:4]) != PCAPNG_BYTE_ORDER_MAGIC {
+				t.Fatalf("first block %#x is not a section header", typ)
+			}
+			continue
+		case n == 1:
+			if typ != PCAPNG_BLOCK_IDB || binary.LittleEndian.Uint16(body[0:2]) != LINKTYPE_RAW {
+				t.Fatalf("second block %#x is not a raw interface", typ)
+			}
+			continue
+		case typ != PCAPNG_BLOCK_EPB:
+			t.Fatalf("block %d: type %#x", n, typ)
+		}
+
+		caplen := int(binary.LittleEndian.Uint32(body[12:16]))
+		if origlen := int(binary.LittleEndian.Uint32(body[16:20])); origlen != caplen {
+			t.Fatalf("block %d: captured %d of %d bytes", n, caplen, origlen)
+		}
+		padded := (caplen + 3) &^ 3
+		pkt := body[20 : 20+caplen]
+		if !bytes.Equal(body[20+caplen:20+padded], make([]byte, padded-caplen)) {
+			t.Fatalf("block %d: padding %x", n, body[20+caplen:20+padded])
+		}
+		s := readSegment(t, pkt)
+		if opts := body[20+padded:]; len(opts) > 0 {
+			if code := binary.LittleEndian.Uint16(opts[0:2]); code != PCAPNG_OPT_COMMENT {
+				t.Fatalf("block %d: option %d", n, code)
+			}
+			l := int(binary.LittleEndian.Uint16(opts[2:4]))
+			s.comment = string(opts[4 : 4+l])
+			if end := opts[4+(l+3)&^3:]; !bytes.Equal(end, make([]byte, 4)) {
+				t.Fatalf("block %d: options end with %x", n, end)
+			}
+		}
+		segments = append(segments, s)
+	}
+	return segments
+}
+
+// readSegment parses an IPv4 or IPv6 packet and checks its checksums,
+// summed here as RFC 1071 does over the header and the pseudo header.
+func readSegment(t *testing.T, pkt []byte) pcapSegment {
+	var s pcapSegment
+	var pseudo []byte
+	var tcp []byte
+	switch pkt[0] >> 4 {
+	case 4:
+		if total := int(binary.BigEndian.Uint16(pkt[2:4])); total != len(pkt) {
+			t.Fatalf("IPv4 total length %d, packet of %d bytes", total, len(pkt))
+		}
+		if pkt[9] != IPPROTO_TCP {
+			t.Fatalf("IPv4 protocol %d", pkt[9])
+		}
+		if sum := rfc1071(pkt[:20]); sum != 0 {
+			t.Fatalf("IPv4 header checksum off by %#x", sum)
+		}
+		s.src, s.dst = net.IP(pkt[12:16]), net.IP(pkt[16:20])
+		tcp = pkt[20:]
+		pseudo = append(append([]byte{}, pkt[12:20]...), 0, IPPROTO_TCP, byte(len(tcp)>>8), byte(len(tcp)))
+	case 6:
+		if payload := int(binary.BigEndian.Uint16(pkt[4:6])); payload != len(pkt)-40 {
+			t.Fatalf("IPv6 payload length %d, packet of %d bytes", payload, len(pkt))
+		}
+		if pkt[6] != IPPROTO_TCP {
+			t.Fatalf("IPv6 next header %d", pkt[6])
+		}
+		s.src, s.dst = net.IP(pkt[8:24]), net.IP(pkt[24:40])
+		tcp = pkt[40:]
+		pseudo = append(append([]byte{}, pkt[8:40]...), 0, 0, byte(len(tcp)>>8), byte(len(tcp)), 0, 0, 0, IPPROTO_TCP)
+	default:
+		t.Fatalf("IP version %d", pkt[0]>>4)
+	}
+	if sum := rfc1071(append(pseudo, tcp...)); sum != 0 {
+		t.Fatalf("TCP checksum off by %#x", sum)
+	}
+	if off := int(tcp[12]>>4) * 4; off != 20 {
+		t.Fatalf("TCP data offset %d", off)
+	}
+	s.sport = binary.BigEndian.Uint16(tcp[0:2])
+	s.dport = binary.BigEndian.Uint16(tcp[2:4])
+	s.seq = binary.BigEndian.Uint32(tcp[4:8])
+	s.ack = binary.BigEndian.Uint32(tcp[8:12])
+	s.flags = tcp[13]
+	s.payload = string(tcp[20:])
+	return s
+}
+
+// rfc1071 returns the complement of the ones' complement sum of b, 0 if b
+// holds its own valid checksum.
+func rfc1071(b []byte) uint16 {
+	if len(b)%2 == 1 {
+		b = append(b[:len(b):len(b)], 0)
+	}
+	var sum uint64
+	for i := 0; i < len(b); i += 2 {
+		sum += uint64(binary.BigEndian.Uint16(b[i:]))
+	}
+	for sum > 0xffff {
+		sum = sum>>16 + sum&0xffff
+	}
+	return ^uint16(sum)
+}
+
+// A connection is a handshake, its writes and reads with sequence numbers
+// following the payloads, then FINs from both sides.
+func TestPcapWriter(t *testing.T) {
+	v4 := newConnAddrV4([]byte{0x01, 0xbb, 93, 184, 216, 34})
+	v6 := connAddr{ip: [16]byte{0x26, 0x06, 0x28, 0x00, 15: 0x01}, ipv6: true, port: 8443}
+	for _, remote := range []connAddr{v4, v6} {
+		path := filepath.Join(t.TempDir(), "tls.pcapng")
+		w, err := newPcapWriter(path)
+		if err != nil {
+			t.Fatal(err)
+		}
+		const pid, fd = 0x012345, 7
+		for _, d := range []struct {
+			typ  KERNEL_EVENT_TYPE
+			data string
+		}{
+			{KERNEL_EVENT_TLS_WRITE, "GET / HTTP/1.1\r\n\r\n"}, // padded
+			{KERNEL_EVENT_TLS_READ, "HTTP/1.1 200 OK\r\n\r\n"},
+			{KERNEL_EVENT_TLS_WRITE, "x"},
+		} {
+			e := &SSLDataEvent{Library: TLS_LIBRARY_OPENSSL, Data: []byte(d.data)}
+			e.Type, e.Pid, e.ConnKey = d.typ, pid, fd
+			w.WriteEvent(e, remote)
+		}
+		w.Reset(pid, fd, 0)
+		if err = w.Close(); err != nil {
+			t.Fatal(err)
+		}
+		b, err := os.ReadFile(path)
+		if err != nil {
+			t.Fatal(err)
+		}
+		segments := readPcapng(t, b)
+
+		local := net.IPv4(10, 0x01, 0x23, 0x45).To4()
+		if remote.ipv6 {
+			local = net.IP{0xfd, 0x00, 12: 0, 13: 0x01, 14: 0x23, 15: 0x45}
+		}
+		rip := net.IP(remote.ip[:16])
+		if !remote.ipv6 {
+			rip = rip[:4]
+		}
+		port := segments[0].sport
+		isn, risn := segments[0].seq, segments[1].seq
+		out, in := true, false
+		want := []struct {
+			out      bool
+			flags    byte
+			seq, ack uint32
+			payload  string
+		}{
+			{out, TCP_FLAG_SYN, isn, 0, ""},
+			{in, TCP_FLAG_SYN | TCP_FLAG_ACK, risn, isn + 1, ""},
+			{out, TCP_FLAG_ACK, isn + 1, risn + 1, ""},
+			{out, TCP_FLAG_PSH | TCP_FLAG_ACK, isn + 1, risn + 1, "GET / HTTP/1.1\r\n\r\n"},
+			{in, TCP_FLAG_PSH | TCP_FLAG_ACK, risn + 1, isn + 19, "HTTP/1.1 200 OK\r\n\r\n"},
+			{out, TCP_FLAG_PSH | TCP_FLAG_ACK, isn + 19, risn + 20, "x"},
+			{out, TCP_FLAG_FIN | TCP_FLAG_ACK, isn + 20, risn + 20, ""},
+			{in, TCP_FLAG_FIN | TCP_FLAG_ACK, risn + 20, isn + 21, ""},
+			{out, TCP_FLAG_ACK, isn + 21, risn + 21, ""},
+		}
+		if len(segments) != len(want) {
+			t.Fatalf("%s: %d segments, want %d", remote, len(segments), len(want))
+		}
+		for i, w := range want {
+			s := segments[i]
+			src, dst, sport, dport := local, rip, port, remote.port
+			if !w.out {
+				src, dst, sport, dport = dst, src, dport, sport
+			}
+			if !s.src.Equal(src) || !s.dst.Equal(dst) || s.sport != sport || s.dport != dport {
+				t.Errorf("%s: segment %d %s:%d -> %s:%d, want %s:%d -> %s:%d", remote, i, s.src, s.sport, s.dst, s.dport, src, sport, dst, dport)
+			}
+			if s.flags != w.flags || s.seq != w.seq || s.ack != w.ack || s.payload != w.payload {
+				t.Errorf("%s: segment %d flags %#x seq %d ack %d %q, want flags %#x seq %d ack %d %q", remote, i, s.flags, s.seq, s.ack, s.payload, w.flags, w.seq, w.ack, w.payload)
+			}
+			if (s.payload != "") != (s.comment != "") {
+				t.Errorf("%s: segment %d comment %q", remote, i, s.comment)
+			}
+		}
+	}
+}
@@ -0,0 +1,68 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"os"
+	"runtime"
+)
+
+const (
+	// default memory budget of the perf buffers of a module, all maps and CPUs.
+	PERF_BUFFER_BUDGET = 64 * 1024 * 1024
+
+	// bounds of the default per-CPU perf buffer, in pages.
+	PERF_BUFFER_MIN_PAGES = 8
+	PERF_BUFFER_MAX_PAGES = 256
+)
+
+// perfBufferSize returns the per-CPU perf buffer size, in bytes, of a module
+// reading maps perf event maps. perf needs a power of two pages: a configured
+// size is rounded up, the default one is the largest that fits the budget.
+func perfBufferSize(conf IConfig, maps int) int {
+	pageSize := os.Getpagesize()
+	pages := 1
+	if size := conf.GetPerfBufferSize(); size > 0 {
+		for pages*pageSize < size {
+			pages <<= 1
+		}
+		return pages * pageSize
+	}
+
+	cpus := numPossibleCPUs()
+	if maps < 1 {
+		maps = 1
+	}
+	budget := PERF_BUFFER_BUDGET / (cpus * maps * pageSize)
+	for pages*2 <= budget && pages < PERF_BUFFER_MAX_PAGES {
+		pages <<= 1
+	}
+	if pages < PERF_BUFFER_MIN_PAGES {
+		pages = PERF_BUFFER_MIN_PAGES
+	}
+	return pages * pageSize
+}
+
+// perfWatermark returns the wakeup watermark of a perf buffer of size bytes,
+// 0 to be woken up on every sample. It is kept below half the buffer, so that
+// the reader wakes up before the kernel drops samples.
+func perfWatermark(conf IConfig, size int) int {
+	watermark := conf.GetPerfWatermark()
+	if watermark > size/2 {
+		watermark = size / 2
+	}
+	if watermark < 0 {
+		watermark = 0
+	}
+	return watermark
+}
+
+// numPossibleCPUs is the number of per-CPU buffers of a perf event map.
+func numPossibleCPUs() int {
+	if possible, err := possibleCPUs(); err == nil {
+		return len(possible)
+	}
+	return runtime.NumCPU()
+}
@@ -0,0 +1,297 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io/ioutil"
+	"runtime"
+	"strconv"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+	"unsafe"
+
+	"github.com/cilium/ebpf"
+	"golang.org/x/sys/unix"
+)
+
+// perf_event_header.type of the records written by bpf_perf_event_output.
+const (
+	PERF_RECORD_LOST   = 2
+	PERF_RECORD_SAMPLE = 9
+)
+
+// perfRing is the mmap'ed perf buffer of one CPU for one map.
+type perfRing struct {
+	em   *ebpf.Map
+	cpu  int
+	fd   int
+	mmap []byte
+	meta *unix.PerfEventMmapPage
+	data []byte // ring, a power of two pages after the meta page
+}
+
+func newPerfRing(em *ebpf.Map, cpu int, perCPUBuffer, watermark int) (*perfRing, error) {
+	attr := unix.PerfEventAttr{
+		Type:        unix.PERF_TYPE_SOFTWARE,
+		Config:      unix.PERF_COUNT_SW_BPF_OUTPUT,
+		Sample_type: unix.PERF_SAMPLE_RAW,
+		Wakeup:      1,
+	}
+	if watermark > 0 {
+		// wakeup_watermark: wake up after this many bytes, not samples.
+		attr.Bits |= unix.PerfBitWatermark
+		attr.Wakeup = uint32(watermark)
+	}
+	attr.Size = uint32(unsafe.Sizeof(attr))
+	fd, err := unix.PerfEventOpen(&attr, -1, cpu, -1, unix.PERF_FLAG_FD_CLOEXEC)
+	if err != nil {
+		return nil, fmt.Errorf("perf_event_open on cpu %d: %w", cpu, err)
+	}
+
+	pageSize := unix.Getpagesize()
+	pages := 1
+	for pages*pageSize < perCPUBuffer {
+		pages <<= 1
+	}
+	mmap, err := unix.Mmap(fd, 0, (1+pages)*pageSize, unix.PROT_READ|unix.PROT_WRITE, unix.MAP_SHARED)
+	if err != nil {
+		unix.Close(fd)
+		return nil, fmt.Errorf("mmap perf buffer of cpu %d: %v", cpu, err)
+	}
+	ring := &perfRing{
+		em:   em,
+		cpu:  cpu,
+		fd:   fd,
+		mmap: mmap,
+		meta: (*unix.PerfEventMmapPage)(unsafe.Pointer(&mmap[0])),
+		data: mmap[pageSize:],
+	}
+
+	if err = unix.IoctlSetInt(fd, unix.PERF_EVENT_IOC_ENABLE, 0); err != nil {
+		ring.Close()
+		return nil, fmt.Errorf("enable perf event of cpu %d: %v", cpu, err)
+	}
+	if err = em.Update(uint32(cpu), uint32(fd), ebpf.UpdateAny); err != nil {
+		ring.Close()
+		return nil, fmt.Errorf("update %s for cpu %d: %v", em.String(), cpu, err)
+	}
+	return ring, nil
+}
+
+// copyAt copies len(b) bytes of the ring from offset off, wrapping around.
+func (this *perfRing) copyAt(b []byte, off uint64) {
+	start := int(off & uint64(len(this.data)-1))
+	n := copy(b, this.data[start:])
+	copy(b[n:], this.data)
+}
+
+// drain reads every record available in the ring.
+func (this *perfRing) drain(lane *pipelineLane) {
+	head := atomic.LoadUint64(&this.meta.Data_head)
+	tail := atomic.LoadUint64(&this.meta.Data_tail)
+	var hdr [16]byte
+	for tail < head {
+		// struct perf_event_header { u32 type; u16 misc; u16 size; }
+		this.copyAt(hdr[:8], tail)
+		typ := binary.LittleEndian.Uint32(hdr[0:4])
+		size := uint64(binary.LittleEndian.Uint16(hdr[6:8]))
+		switch typ {
+		case PERF_RECORD_SAMPLE:
+			// u32 size; char data[size];
+			this.copyAt(hdr[:4], tail+8)
+			raw := make([]byte, binary.LittleEndian.Uint32(hdr[0:4]))
+			this.copyAt(raw, tail+12)
+			lane.push(this.em, raw)
+		case PERF_RECORD_LOST:
+			// u64 id; u64 lost;
+			this.copyAt(hdr[:16], tail+8)
+			lane.addLost(binary.LittleEndian.Uint64(hdr[8:16]))
+		}
+		tail += size
+	}
+	atomic.StoreUint64(&this.meta.Data_tail, tail)
+}
+
+func (this *perfRing) Close() error {
+	unix.Munmap(this.mmap)
+	return unix.Close(this.fd)
+}
+
+// perfShard drains the perf buffers of a subset of the CPUs, for every perf
+// event map of a module, on its own OS thread.
+type perfShard struct {
+	cpus  []int
+	rings map[int32]*perfRing // fd -> ring
+	epfd  int
+	wake  int // eventfd, closes the shard
+
+	// epoll_wait timeout in milliseconds, -1 without a wakeup watermark.
+	timeout int
+
+	lock     sync.Mutex
+	released bool
+}
+
+func (this *perfShard) run(lane *pipelineLane, pin bool) error {
+	runtime.LockOSThread()
+	if !pin {
+		defer runtime.UnlockOSThread()
+	} else {
+		// the thread stays locked: the runtime discards it when run returns,
+		// instead of scheduling other goroutines with its CPU mask.
+		var set unix.CPUSet
+		for _, cpu := range this.cpus {
+			set.Set(cpu)
+		}
+		if err := unix.SchedSetaffinity(0, &set); err != nil {
+			return fmt.Errorf("pin perf reader to cpus %v: %v", this.cpus, err)
+		}
+	}
+
+	events := make([]unix.EpollEvent, len(this.rings)+1)
+	for {
+		n, err := unix.EpollWait(this.epfd, events, this.timeout)
+		if err != nil {
+			if errors.Is(err, unix.EINTR) {
+				continue
+			}
+			return fmt.Errorf("epoll_wait: %v", err)
+		}
+		if n == 0 {
+			// samples below the watermark wait no longer than
+			// OUTPUT_FLUSH_INTERVAL.
+			this.drainAll(lane)
+			continue
+		}
+		for _, e := range events[:n] {
+			if int(e.Fd) == this.wake {
+				this.drainAll(lane)
+				return nil
+			}
+			this.rings[e.Fd].drain(lane)
+		}
+	}
+}
+
+func (this *perfShard) drainAll(lane *pipelineLane) {
+	for _, ring := range this.rings {
+		ring.drain(lane)
+	}
+}
+
+// Close makes run return, once it drained the rings.
+func (this *perfShard) Close() error {
+	this.lock.Lock()
+	defer this.lock.Unlock()
+	if this.released {
+		return nil
+	}
+	var one [8]byte
+	binary.LittleEndian.PutUint64(one[:], 1)
+	_, err := unix.Write(this.wake, one[:])
+	return err
+}
+
+// release frees the rings, once run returned.
+func (this *perfShard) release() {
+	this.lock.Lock()
+	defer this.lock.Unlock()
+	this.released = true
+	for _, ring := range this.rings {
+		ring.Close()
+	}
+	unix.Close(this.epfd)
+	unix.Close(this.wake)
+}
+
+// newPerfShards opens the perf buffers of maps on every possible CPU, and
+// splits the CPUs round-robin between n shards.
+func newPerfShards(maps []*ebpf.Map, n int, perCPUBuffer, watermark int) (shards []*perfShard, err error) {
+	cpus, err := possibleCPUs()
+	if err != nil {
+		return nil, err
+	}
+	if n > len(cpus) {
+		n = len(cpus)
+	}
+	defer func() {
+		if err != nil {
+			for _, s := range shards {
+				s.release()
+			}
+		}
+	}()
+
+	for i := 0; i < n; i++ {
+		s := &perfShard{rings: make(map[int32]*perfRing), timeout: -1}
+		if watermark > 0 {
+			s.timeout = int(OUTPUT_FLUSH_INTERVAL / time.Millisecond)
+		}
+		if s.epfd, err = unix.EpollCreate1(unix.EPOLL_CLOEXEC); err != nil {
+			return
+		}
+		if s.wake, err = unix.Eventfd(0, unix.EFD_CLOEXEC|unix.EFD_NONBLOCK); err != nil {
+			unix.Close(s.epfd)
+			return
+		}
+		shards = append(shards, s)
+		if err = unix.EpollCtl(s.epfd, unix.EPOLL_CTL_ADD, s.wake, &unix.EpollEvent{Events: unix.EPOLLIN, Fd: int32(s.wake)}); err != nil {
+			return
+		}
+	}
+
+	for i, cpu := range cpus {
+		s := shards[i%n]
+		s.cpus = append(s.cpus, cpu)
+		for _, em := range maps {
+			var ring *perfRing
+			if ring, err = newPerfRing(em, cpu, perCPUBuffer, watermark); err != nil {
+				// possible, but offline.
+				if errors.Is(err, unix.ENODEV) {
+					err = nil
+					continue
+				}
+				return
+			}
+			s.rings[int32(ring.fd)] = ring
+			if err = unix.EpollCtl(s.epfd, unix.EPOLL_CTL_ADD, ring.fd, &unix.EpollEvent{Events: unix.EPOLLIN, Fd: int32(ring.fd)}); err != nil {
+				return
+			}
+		}
+	}
+	return shards, nil
+}
+
+// possibleCPUs parses /sys/devices/system/cpu/possible, eg: 0-127
+func possibleCPUs() ([]int, error) {
+	b, err := ioutil.ReadFile("/sys/devices/system/cpu/possible")
+	if err != nil {
+		return nil, err
+	}
+	var cpus []int
+	for _, r := range strings.Split(strings.TrimSpace(string(b)), ",") {
+		from, to := r, r
+		if i := strings.IndexByte(r, '-'); i >= 0 {
+			from, to = r[:i], r[i+1:]
+		}
+		first, err := strconv.Atoi(from)
+		if err != nil {
+			return nil, fmt.Errorf("parse possible cpus %q: %v", b, err)
+		}
+		last, err := strconv.Atoi(to)
+		if err != nil {
+			return nil, fmt.Errorf("parse possible cpus %q: %v", b, err)
+		}
+		for cpu := first; cpu <= last; cpu++ {
+			cpus = append(cpus, cpu)
+		}
+	}
+	return cpus, nil
+}
@@ -0,0 +1,363 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"encoding/binary"
+	"runtime"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"github.com/cilium/ebpf"
+)
+
+const (
+	// records read from the kernel, waiting for a decoder, per lane.
+	PIPELINE_RECORD_QUEUE_SIZE = 8192
+
+	// decoded events waiting for the reorder of their lane, per lane.
+	PIPELINE_EVENT_QUEUE_SIZE = 4096
+
+	// events the sink holds back waiting for older events of another lane,
+	// beyond it the oldest queued event goes out anyway.
+	PIPELINE_MERGE_MAX_SIZE = 16384
+
+	PIPELINE_STATS_INTERVAL = 10 * time.Second
+
+	// how long Flush waits on exit for the records the readers drained.
+	PIPELINE_CLOSE_TIMEOUT = time.Second
+)
+
+// PipelineStats are the counters and queue depths of the pipeline of a module.
+type PipelineStats struct {
+	Lanes        int
+	Records      uint64 // records read from the kernel
+	Dropped      uint64 // records dropped by the reader, the record queue was full
+	Lost         uint64 // samples lost in the kernel, the perf buffer was full
+	DecodeErrors uint64
+
+	RecordQueue int // records waiting for a decoder
+	EventQueue  int // events waiting for the reorder of their lane
+	Reorder     int // events decoded ahead of their turn
+	Merge       int // events held by the sink for older events of another lane
+}
+
+type pipelineRecord struct {
+	seq uint64
+	em  *ebpf.Map
+	raw []byte
+}
+
+type pipelineEvent struct {
+	seq   uint64
+	lane  int
+	ts    uint64       // header.timestamp_ns
+	event IEventStruct // nil if the record could not be decoded
+	raw   []byte
+	text  *[]byte // payload of an orderedAppender, see formatPayload, from outputBuffers
+}
+
+// pipeline decouples the perf readers of a module from its output:
+//
+//	reader -> record queue -> decoders -> reorder \
+//	reader -> record queue -> decoders -> reorder  -> sink
+//	...                                           /
+//
+// Every reader (a perf shard, or the reader of a map) owns a lane, with its
+// own sequence numbers, queues and decoders, so that readers never contend
+// with each other and decoding scales with them. Readers only drain the
+// kernel buffers, and drop records when the record queue is full rather than
+// blocking, so that a slow terminal or disk costs counted drops here instead
+// of silent losses in the kernel. Decoders decode and format output events in
+// parallel, into pooled buffers; the parts that depend on earlier events, see
+// orderedAppender, are left to the sink. Each lane puts its events back in
+// the order they were read.
+//
+// The sink merges the lanes by timestamp: the head of a lane waits while
+// another lane has records in flight, they may be older. It then writes the
+// events to the buffered output of the module or hands them to its
+// Dispatcher, one at a time, so module state needs no extra locking. The
+// output is flushed when full, every OUTPUT_FLUSH_INTERVAL and on exit.
+//
+// On exit every reader drains its buffers and closes its lane, the lanes
+// empty, and the sink closes done once it output the last event.
+type pipeline struct {
+	module *Module
+	lanes  []*pipelineLane
+	sorted chan pipelineEvent // in order events of every lane
+	merge  int64
+
+	ordering sync.WaitGroup // order goroutines of the lanes
+	done     chan struct{}
+}
+
+// pipelineLane is the part of the pipeline owned by one reader.
+type pipelineLane struct {
+	p  *pipeline
+	id int
+
+	seq      uint64 // only the reader of the lane pushes
+	records  chan pipelineRecord
+	decoding sync.WaitGroup
+	events   chan pipelineEvent
+	reorder  int64
+
+	// records pushed and not yet output by the sink.
+	inflight int64
+
+	recordCount  uint64
+	dropped      uint64
+	lost         uint64
+	decodeErrors uint64
+}
+
+// newPipeline creates a pipeline with a lane for each of the lanes readers
+// of the module.
+func newPipeline(module *Module, lanes int) *pipeline {
+	this := &pipeline{
+		module: module,
+		sorted: make(chan pipelineEvent, PIPELINE_EVENT_QUEUE_SIZE),
+		done:   make(chan struct{}),
+	}
+	for i := 0; i < lanes; i++ {
+		this.lanes = append(this.lanes, &pipelineLane{
+			p:       this,
+			id:      i,
+			records: make(chan pipelineRecord, PIPELINE_RECORD_QUEUE_SIZE),
+			events:  make(chan pipelineEvent, PIPELINE_EVENT_QUEUE_SIZE),
+		})
+	}
+	return this
+}
+
+func (this *pipeline) start() {
+	// one decoder per CPU, split between the lanes.
+	decoders := 1
+	if len(this.lanes) > 0 && runtime.GOMAXPROCS(0) > len(this.lanes) {
+		decoders = runtime.GOMAXPROCS(0) / len(this.lanes)
+	}
+	for _, lane := range this.lanes {
+		lane.decoding.Add(decoders)
+		for i := 0; i < decoders; i++ {
+			go lane.decode()
+		}
+		go func(lane *pipelineLane) {
+			lane.decoding.Wait()
+			close(lane.events)
+		}(lane)
+		this.ordering.Add(1)
+		go lane.order()
+	}
+	go func() {
+		this.ordering.Wait()
+		close(this.sorted)
+	}()
+	go this.sink()
+	go this.reportStats()
+}
+
+// push queues a record read from em. It never blocks, and must only be called
+// by the reader of the lane.
+func (this *pipelineLane) push(em *ebpf.Map, raw []byte) {
+	atomic.AddUint64(&this.recordCount, 1)
+	atomic.AddInt64(&this.inflight, 1)
+	select {
+	case this.records <- pipelineRecord{seq: this.seq, em: em, raw: raw}:
+		this.seq++
+	default:
+		atomic.AddInt64(&this.inflight, -1)
+		atomic.AddUint64(&this.dropped, 1)
+	}
+}
+
+// close is called by the reader of the lane once it stopped, after it drained
+// its buffers.
+func (this *pipelineLane) close() {
+	close(this.records)
+}
+
+// addLost counts samples the kernel could not write to a full perf buffer.
+func (this *pipelineLane) addLost(n uint64) {
+	atomic.AddUint64(&this.lost, n)
+}
+
+func (this *pipelineLane) decode() {
+	defer this.decoding.Done()
+	module := this.p.module
+	for r := range this.records {
+		e := pipelineEvent{seq: r.seq, lane: this.id, raw: r.raw}
+		if len(r.raw) >= EVENT_HEADER_SIZE {
+			e.ts = binary.LittleEndian.Uint64(r.raw[8:16])
+		}
+		event, err := module.child.Decode(r.em, r.raw)
+		if err != nil {
+			atomic.AddUint64(&this.decodeErrors, 1)
+			module.logger.Printf("this.child.decode error:%v", err)
+		} else {
+			e.event = event
+			// any other event is formatted by the sink, its comm may come
+			// from an exec event not dispatched yet.
+			o, ok := event.(orderedAppender)
+			if ok && event.EventType() == EVENT_TYPE_OUTPUT && module.capture == nil {
+				e.text = getOutputBuffer()
+				*e.text = module.output.formatPayload(*e.text, o, module.conf.GetHex())
+			}
+		}
+		this.events <- e
+	}
+}
+
+// order puts the decoded events of the lane back in read order.
+func (this *pipelineLane) order() {
+	defer this.p.ordering.Done()
+	var next uint64
+	// bounded by the queues and the decoders, at most that many events are
+	// in flight.
+	pending := make(map[uint64]pipelineEvent)
+	for e := range this.events {
+		pending[e.seq] = e
+		for {
+			e, found := pending[next]
+			if !found {
+				break
+			}
+			delete(pending, next)
+			next++
+			this.p.sorted <- e
+		}
+		atomic.StoreInt64(&this.reorder, int64(len(pending)))
+	}
+}
+
+func (this *pipeline) sink() {
+	// in order events of each lane, waiting for the merge.
+	queues := make([][]pipelineEvent, len(this.lanes))
+	queued := 0
+	ticker := time.NewTicker(OUTPUT_FLUSH_INTERVAL)
+	defer ticker.Stop()
+	for {
+		select {
+		case now := <-ticker.C:
+			this.module.output.Flush()
+			if this.module.capture != nil {
+				this.module.capture.Tick(now)
+			}
+			continue
+		case e, ok := <-this.sorted:
+			if !ok {
+				// every lane closed, nothing is in flight anymore.
+				this.mergeLanes(queues, queued)
+				this.module.output.Flush()
+				close(this.done)
+				return
+			}
+			queues[e.lane] = append(queues[e.lane], e)
+			queued++
+		}
+		queued = this.mergeLanes(queues, queued)
+		atomic.StoreInt64(&this.merge, int64(queued))
+	}
+}
+
+// mergeLanes outputs the queued events in timestamp order, as long as no lane
+// with an empty queue still has records in flight. It returns the number of
+// events left queued.
+func (this *pipeline) mergeLanes(queues [][]pipelineEvent, queued int) int {
+	for queued > 0 {
+		oldest := -1
+		for i, q := range queues {
+			if len(q) == 0 {
+				if queued < PIPELINE_MERGE_MAX_SIZE && atomic.LoadInt64(&this.lanes[i].inflight) > 0 {
+					// wait for it.
+					return queued
+				}
+				continue
+			}
+			if oldest < 0 || q[0].ts < queues[oldest][0].ts {
+				oldest = i
+			}
+		}
+		e := queues[oldest][0]
+		queues[oldest][0] = pipelineEvent{}
+		queues[oldest] = queues[oldest][1:]
+		queued--
+		this.output(e)
+		atomic.AddInt64(&this.lanes[oldest].inflight, -1)
+	}
+	return queued
+}
+
+func (this *pipeline) output(e pipelineEvent) {
+	if e.event == nil {
+		return
+	}
+	if this.module.capture != nil {
+		if err := this.module.capture.Append(e.raw); err != nil {
+			this.module.logger.Printf("%s capture error:%v", this.module.child.Name(), err)
+		}
+	}
+	if e.event.EventType() == EVENT_TYPE_OUTPUT {
+		if e.text != nil {
+			this.module.output.WriteFormatted(e.event.(orderedAppender), *e.text)
+			putOutputBuffer(e.text)
+		} else {
+			this.module.output.WriteEvent(e.event, this.module.conf.GetHex())
+		}
+		this.module.events.Put(e.event)
+		return
+	}
+	this.module.Dispatcher(e.event)
+}
+
+// wait waits for the sink to output the last event, up to timeout.
+func (this *pipeline) wait(timeout time.Duration) bool {
+	select {
+	case <-this.done:
+		return true
+	case <-time.After(timeout):
+		return false
+	}
+}
+
+func (this *pipeline) Stats() PipelineStats {
+	s := PipelineStats{
+		Lanes: len(this.lanes),
+		Merge: int(atomic.LoadInt64(&this.merge)),
+	}
+	for _, lane := range this.lanes {
+		s.Records += atomic.LoadUint64(&lane.recordCount)
+		s.Dropped += atomic.LoadUint64(&lane.dropped)
+		s.Lost += atomic.LoadUint64(&lane.lost)
+		s.DecodeErrors += atomic.LoadUint64(&lane.decodeErrors)
+		s.RecordQueue += len(lane.records)
+		s.EventQueue += len(lane.events)
+		s.Reorder += int(atomic.LoadInt64(&lane.reorder))
+	}
+	return s
+}
+
+// reportStats logs the counters when records were dropped or lost since the
+// last report.
+func (this *pipeline) reportStats() {
+	ticker := time.NewTicker(PIPELINE_STATS_INTERVAL)
+	defer ticker.Stop()
+	var last PipelineStats
+	for {
+		select {
+		case _ = <-this.module.ctx.Done():
+			return
+		case _ = <-ticker.C:
+		}
+		s := this.Stats()
+		if s.Dropped == last.Dropped && s.Lost == last.Lost {
+			continue
+		}
+		this.module.logger.Printf("%s pipeline: lanes:%d, records:%d, dropped:%d, lost in kernel:%d, decode errors:%d, queues: record %d/%d, event %d/%d, reorder %d, merge %d",
+			this.module.child.Name(), s.Lanes, s.Records, s.Dropped, s.Lost, s.DecodeErrors,
+			s.RecordQueue, s.Lanes*PIPELINE_RECORD_QUEUE_SIZE, s.EventQueue, s.Lanes*PIPELINE_EVENT_QUEUE_SIZE, s.Reorder, s.Merge)
+		last = s
+	}
+}
@@ -0,0 +1,135 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"context"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"log"
+	"runtime"
+	"sync"
+	"testing"
+	"time"
+
+	"github.com/cilium/ebpf"
+)
+
+// testModule decodes every record with proto, and records the timestamps of
+// the module data events it is dispatched.
+type testModule struct {
+	Module
+	proto      IEventStruct
+	timestamps []uint64
+}
+
+func newTestModule(ctx context.Context, proto IEventStruct) *testModule {
+	this := &testModule{proto: proto}
+	this.Init(ctx, log.New(io.Discard, "", log.LstdFlags), NewOpensslConfig())
+	return this
+}
+
+func (this *testModule) Init(ctx context.Context, logger *log.Logger, conf IConfig) error {
+	this.Module.Init(ctx, logger)
+	this.Module.conf = conf
+	this.Module.SetChild(this)
+	return nil
+}
+
+func (this *testModule) Close() error {
+	return nil
+}
+
+func (this *testModule) DecodeFun(em *ebpf.Map) (IEventStruct, bool) {
+	return this.proto, true
+}
+
+func (this *testModule) Dispatcher(event IEventStruct) {
+	if e, ok := event.(*ConnDataEvent); ok {
+		this.timestamps = append(this.timestamps, e.TimestampNs)
+	}
+}
+
+// The sink merges the lanes by timestamp, whatever lane decodes first, and
+// outputs every event before it is done.
+func TestPipelineMergeLanes(t *testing.T) {
+	ctx, cancel := context.WithCancel(context.Background())
+	defer cancel()
+	m := newTestModule(ctx, &ConnDataEvent{})
+	p := newPipeline(&m.Module, 3)
+	m.pipeline = p
+
+	const n = 1000
+	for i := 0; i < n; i++ {
+		for l, lane := range p.lanes {
+			raw := testConnectPayload()
+			binary.LittleEndian.PutUint64(raw[8:16], uint64(i*len(p.lanes)+l))
+			lane.push(nil, raw)
+		}
+	}
+	p.start()
+	for _, lane := range p.lanes {
+		lane.close()
+	}
+	if !p.wait(10 * time.Second) {
+		t.Fatal("pipeline not done")
+	}
+	if len(m.timestamps) != n*len(p.lanes) {
+		t.Fatalf("%d events dispatched, want %d", len(m.timestamps), n*len(p.lanes))
+	}
+	for i, ts := range m.timestamps {
+		if ts != uint64(i) {
+			t.Fatalf("event %d has timestamp %d", i, ts)
+		}
+	}
+}
+
+// BenchmarkPipeline pushes TLS records from one reader per lane, through
+// decoding and formatting, to a discarded output.
+func BenchmarkPipeline(b *testing.B) {
+	payload := testTlsPayload()
+	for _, lanes := range []int{1, 2, 4} {
+		b.Run(fmt.Sprintf("lanes=%d", lanes), func(b *testing.B) {
+			ctx, cancel := context.WithCancel(context.Background())
+			defer cancel()
+			m := &MOpenSSLProbe{}
+			m.Module.Init(ctx, log.New(io.Discard, "", log.LstdFlags))
+			m.Module.conf = NewOpensslConfig()
+			m.Module.SetChild(m)
+			proto := &SSLDataEvent{event_type: EVENT_TYPE_OUTPUT}
+			proto.SetModule(m)
+			m.eventFuncMaps = map[*ebpf.Map]IEventStruct{nil: proto}
+			p := newPipeline(&m.Module, lanes)
+			m.pipeline = p
+			p.start()
+
+			b.ReportAllocs()
+			b.SetBytes(int64(len(payload)))
+			b.ResetTimer()
+			var wg sync.WaitGroup
+			for l, lane := range p.lanes {
+				wg.Add(1)
+				go func(lane *pipelineLane, n int) {
+					defer wg.Done()
+					for i := 0; i < n; i++ {
+						// a reader would drop it, wait for the decoders.
+						for len(lane.records) == cap(lane.records) {
+							runtime.Gosched()
+						}
+						lane.push(nil, payload)
+					}
+				}(lane, (b.N+lanes-1-l)/lanes)
+			}
+			wg.Wait()
+			for _, lane := range p.lanes {
+				lane.close()
+			}
+			if !p.wait(time.Minute) {
+				b.Fatal("pipeline not done")
+			}
+		})
+	}
+}
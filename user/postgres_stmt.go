@@ -0,0 +1,66 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"sync"
+)
+
+// upper bound of cached statements, and of cached portals.
+const POSTGRES_STMT_CACHE_SIZE = 10240
+
+// pgNameKey names a statement or a portal of a backend, the unnamed ones
+// are "".
+type pgNameKey struct {
+	pid  uint32
+	name string
+}
+
+// postgresStmtCache keeps the statements parsed by each backend, and the
+// statement bound to each portal, so that an execute only carries its
+// portal name.
+type postgresStmtCache struct {
+	sync.Mutex
+	stmts   *lruCache // pgNameKey -> SQL
+	portals *lruCache // pgNameKey -> statement name
+}
+
+func newPostgresStmtCache() *postgresStmtCache {
+	return &postgresStmtCache{
+		stmts:   newLruCache(POSTGRES_STMT_CACHE_SIZE),
+		portals: newLruCache(POSTGRES_STMT_CACHE_SIZE),
+	}
+}
+
+// Parse records a parse message, a statement of the same name is replaced.
+func (this *postgresStmtCache) Parse(pid uint32, stmt, sql string) {
+	this.Lock()
+	this.stmts.Add(pgNameKey{pid: pid, name: stmt}, sql)
+	this.Unlock()
+}
+
+// Bind records a bind message.
+func (this *postgresStmtCache) Bind(pid uint32, portal, stmt string) {
+	this.Lock()
+	this.portals.Add(pgNameKey{pid: pid, name: portal}, stmt)
+	this.Unlock()
+}
+
+// Execute returns the statement run by portal and its SQL, "" if they are
+// unknown.
+func (this *postgresStmtCache) Execute(pid uint32, portal string) (stmt string, sql string, found bool) {
+	this.Lock()
+	defer this.Unlock()
+	s, f := this.portals.Get(pgNameKey{pid: pid, name: portal})
+	if !f {
+		return "", "", false
+	}
+	stmt = s.(string)
+	q, f := this.stmts.Get(pgNameKey{pid: pid, name: stmt})
+	if !f {
+		return stmt, "", false
+	}
+	return stmt, q.(string), true
+}
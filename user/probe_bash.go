@@ -4,20 +4,43 @@ import (
 	"bytes"
 	"context"
 	"ecapture/assets"
+	"fmt"
 	"github.com/cilium/ebpf"
 	manager "github.com/ehids/ebpfmanager"
 	"github.com/pkg/errors"
 	"golang.org/x/sys/unix"
 	"log"
 	"math"
+	"os"
+	"sync"
+	"time"
 )
 
+// upper bound of lines waiting for their retval, the oldest is printed
+// without it when the bound is hit.
+const BASH_PENDING_LINES_SIZE = 65536
+
+// enum bash_stat in kern/bash_kern.c
+const (
+	BASH_STAT_LINES = iota
+	BASH_STAT_RETVALS
+	BASH_STAT_OUTPUT_LOST
+	BASH_STAT_PENDING_LOST
+	BASH_STAT_MAX
+)
+
+const BASH_STATS_INTERVAL = 10 * time.Second
+
 type MBashProbe struct {
 	Module
 	bpfManager        *manager.Manager
 	bpfManagerOptions manager.Options
 	eventFuncMaps     map[*ebpf.Map]IEventStruct
 	eventMaps         []*ebpf.Map
+
+	pendingLock  sync.Mutex
+	pendingLines *lruCache // pid -> *bashEvent, lines waiting for their retval
+	sessions     *bashSessions
 }
 
 //对象初始化
@@ -27,6 +50,25 @@ func (this *MBashProbe) Init(ctx context.Context, logger *log.Logger, conf IConf
 	this.Module.SetChild(this)
 	this.eventMaps = make([]*ebpf.Map, 0, 2)
 	this.eventFuncMaps = make(map[*ebpf.Map]IEventStruct)
+	this.pendingLines = newLruCache(BASH_PENDING_LINES_SIZE)
+	this.pendingLines.onEvict = func(_, line interface{}) {
+		this.output(line.(*bashEvent))
+	}
+	this.sessions = newBashSessions(func(session *bashSession, complete bool) {
+		if this.Module.output.json {
+			this.Module.output.Write(session.AppendJSON(nil, complete))
+			return
+		}
+		this.Module.output.WriteString(session.String(complete))
+	})
+	processes.OnExit(func(pid uint32) {
+		this.pendingLock.Lock()
+		// the shell exited before execute_command returned.
+		this.flushLine(pid)
+		// the session leader exited.
+		this.sessions.End(pid)
+		this.pendingLock.Unlock()
+	})
 	return nil
 }
 
@@ -58,6 +100,11 @@ func (this *MBashProbe) start() error {
 		return errors.Wrap(err, "couldn't start bootstrap manager")
 	}
 
+	// 填充 --tree 模式下的目标进程树
+	if err := seedTargetTree(this.bpfManager, this.conf); err != nil {
+		return errors.Wrap(err, "couldn't seed target process tree")
+	}
+
 	// 加载map信息，map对应events decode表。
 	err = this.initDecodeFun()
 	if err != nil {
@@ -67,6 +114,25 @@ func (this *MBashProbe) start() error {
 	return nil
 }
 
+// Flush prints the lines still waiting for their retval, eg: the running
+// command of every shell, and the sessions still open with --session, then
+// the buffered output. It is called on exit, and at the end of a capture
+// file.
+func (this *MBashProbe) Flush() error {
+	this.waitPipeline()
+	this.pendingLock.Lock()
+	for {
+		_, line, ok := this.pendingLines.RemoveOldest()
+		if !ok {
+			break
+		}
+		this.output(line.(*bashEvent))
+	}
+	this.sessions.EndAll()
+	this.pendingLock.Unlock()
+	return this.Module.Flush()
+}
+
 func (this *MBashProbe) Close() error {
 	if err := this.bpfManager.Stop(manager.CleanAll); err != nil {
 		return errors.Wrap(err, "couldn't stop manager")
@@ -82,6 +148,14 @@ func (this *MBashProbe) constantEditor() []manager.ConstantEditor {
 			Value: uint64(this.conf.GetPid()),
 			//FailOnMissing: true,
 		},
+		{
+			Name:  "target_tree",
+			Value: boolToUint32(this.conf.GetPidTree()),
+		},
+		{
+			Name:  "line_max_len",
+			Value: this.conf.(*BashConfig).LineMaxLen,
+		},
 		{
 			Name:  "target_errno",
 			Value: uint32(this.Module.conf.(*BashConfig).ErrNo),
@@ -91,7 +165,7 @@ func (this *MBashProbe) constantEditor() []manager.ConstantEditor {
 	if this.conf.GetPid() <= 0 {
 		this.logger.Printf("target all process. \n")
 	} else {
-		this.logger.Printf("target PID:%d \n", this.conf.GetPid())
+		this.logger.Printf("target PID:%d, tree:%v \n", this.conf.GetPid(), this.conf.GetPidTree())
 	}
 	return editor
 }
@@ -119,6 +193,12 @@ func (this *MBashProbe) setupManagers() {
 				//UprobeOffset: 0x8232, 	//若找不到 readline 函数，则使用offset便宜地址方式。
 				BinaryPath: binaryPath, // 可能是 /bin/bash 也可能是 readline.so的真实地址
 			},
+			{
+				Section:          "uprobe/bash_execute",
+				EbpfFuncName:     "uprobe_bash_execute",
+				AttachToFuncName: "execute_command",
+				BinaryPath:       binaryPath,
+			},
 			{
 				Section:          "uretprobe/bash_retval",
 				EbpfFuncName:     "uretprobe_bash_retval",
@@ -133,6 +213,7 @@ func (this *MBashProbe) setupManagers() {
 			},
 		},
 	}
+	addProcessProbes(this.bpfManager)
 
 	this.bpfManagerOptions = manager.Options{
 		DefaultKProbeMaxActive: 512,
@@ -175,6 +256,23 @@ func (this *MBashProbe) initDecodeFun() error {
 	bashevent.SetModule(this)
 	this.eventFuncMaps[bashEventsMap] = bashevent
 
+	statsMap, found, err := this.bpfManager.GetMap("bash_stats")
+	if err != nil {
+		return err
+	}
+	if !found {
+		return errors.New("cant found map:bash_stats")
+	}
+	go this.reportStats(statsMap)
+
+	// process exec/fork/exit events, kept in the shared process cache.
+	procEventsMap, procEvent, err := processEventsMap(this.bpfManager, this)
+	if err != nil {
+		return err
+	}
+	this.eventMaps = append(this.eventMaps, procEventsMap)
+	this.eventFuncMaps[procEventsMap] = procEvent
+
 	return nil
 }
 
@@ -182,6 +280,92 @@ func (this *MBashProbe) Events() []*ebpf.Map {
 	return this.eventMaps
 }
 
+// Dispatcher pairs each line with its retval. A line without retval, never
+// executed, is printed when the next line of the shell arrives, or when the
+// shell exits.
+func (this *MBashProbe) Dispatcher(event IEventStruct) {
+	e, ok := event.(*bashEvent)
+	if !ok {
+		return
+	}
+	this.pendingLock.Lock()
+	defer this.pendingLock.Unlock()
+
+	switch e.Type {
+	case KERNEL_EVENT_BASH:
+		this.flushLine(e.Pid)
+		e.Cwd, _ = os.Readlink(fmt.Sprintf("/proc/%d/cwd", e.Pid))
+		e.Comm = processes.Comm(e.Pid)
+		this.pendingLines.Add(e.Pid, e)
+	case KERNEL_EVENT_BASH_RETVAL:
+		line, found := this.pendingLines.Get(e.Pid)
+		if !found {
+			return
+		}
+		this.pendingLines.Remove(e.Pid)
+		line.(*bashEvent).Retval = e.Retval
+		line.(*bashEvent).Executed = true
+		this.output(line.(*bashEvent))
+	}
+}
+
+// flushLine prints the pending line of pid, if any. It must be called with
+// pendingLock held.
+func (this *MBashProbe) flushLine(pid uint32) {
+	line, found := this.pendingLines.Get(pid)
+	if !found {
+		return
+	}
+	this.pendingLines.Remove(pid)
+	this.output(line.(*bashEvent))
+}
+
+// output prints a line, or adds it to its session with --session, unless it
+// is filtered out by --errnumber. It must be called with pendingLock held.
+func (this *MBashProbe) output(line *bashEvent) {
+	errNo := this.conf.(*BashConfig).ErrNo
+	if errNo != BASH_ERRNO_DEFAULT && (!line.Executed || int(int32(line.Retval)) != errNo) {
+		return
+	}
+	if this.conf.(*BashConfig).Session {
+		this.sessions.Add(line)
+		return
+	}
+	this.Module.output.WriteEvent(line, false)
+}
+
+// reportStats logs the counters of bash_stats every BASH_STATS_INTERVAL if
+// lines or state were lost.
+func (this *MBashProbe) reportStats(statsMap *ebpf.Map) {
+	var reported [BASH_STAT_MAX]uint64
+	ticker := time.NewTicker(BASH_STATS_INTERVAL)
+	defer ticker.Stop()
+	for {
+		select {
+		case <-this.ctx.Done():
+			return
+		case <-ticker.C:
+		}
+
+		var stats [BASH_STAT_MAX]uint64
+		for i := range stats {
+			var perCPU []uint64
+			if err := statsMap.Lookup(uint32(i), &perCPU); err != nil {
+				this.logger.Printf("lookup bash_stats[%d] error:%v", i, err)
+				return
+			}
+			for _, v := range perCPU {
+				stats[i] += v
+			}
+		}
+		if stats[BASH_STAT_OUTPUT_LOST] == reported[BASH_STAT_OUTPUT_LOST] && stats[BASH_STAT_PENDING_LOST] == reported[BASH_STAT_PENDING_LOST] {
+			continue
+		}
+		reported = stats
+		this.logger.Printf("bash lines:%d, retvals:%d, lost events:%d, lost pending lines:%d", stats[BASH_STAT_LINES], stats[BASH_STAT_RETVALS], stats[BASH_STAT_OUTPUT_LOST], stats[BASH_STAT_PENDING_LOST])
+	}
+}
+
 func init() {
 	mod := &MBashProbe{}
 	mod.name = MODULE_NAME_BASH
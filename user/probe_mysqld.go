@@ -15,6 +15,7 @@ import (
 	"log"
 	"math"
 	"os"
+	"time"
 )
 
 type MMysqldProbe struct {
@@ -23,6 +24,7 @@ type MMysqldProbe struct {
 	bpfManagerOptions manager.Options
 	eventFuncMaps     map[*ebpf.Map]IEventStruct
 	eventMaps         []*ebpf.Map
+	stmts             *mysqldStmtCache
 }
 
 //对象初始化
@@ -32,6 +34,7 @@ func (this *MMysqldProbe) Init(ctx context.Context, logger *log.Logger, conf ICo
 	this.Module.SetChild(this)
 	this.eventMaps = make([]*ebpf.Map, 0, 2)
 	this.eventFuncMaps = make(map[*ebpf.Map]IEventStruct)
+	this.stmts = newMysqldStmtCache()
 	return nil
 }
 
@@ -66,12 +69,28 @@ func (this *MMysqldProbe) start() error {
 		return errors.Wrap(err, "couldn't start bootstrap manager")
 	}
 
+	// 填充 --tree 模式下的目标进程树
+	if err := seedTargetTree(this.bpfManager, this.conf); err != nil {
+		return errors.Wrap(err, "couldn't seed target process tree")
+	}
+
 	// 加载map信息，map对应events decode表。
 	err = this.initDecodeFun()
 	if err != nil {
 		return err
 	}
 
+	if this.conf.(*MysqldConfig).Latency {
+		histMap, found, err := this.bpfManager.GetMap("latency_hist")
+		if err != nil {
+			return err
+		}
+		if !found {
+			return errors.New("cant found map:latency_hist")
+		}
+		go this.mysqldLatency(histMap, time.Duration(this.conf.(*MysqldConfig).Interval)*time.Second)
+	}
+
 	return nil
 }
 
@@ -82,6 +101,47 @@ func (this *MMysqldProbe) Close() error {
 	return nil
 }
 
+func (this *MMysqldProbe) constantEditor() []manager.ConstantEditor {
+	var editor = []manager.ConstantEditor{
+		{
+			Name:  "target_pid",
+			Value: uint64(this.conf.GetPid()),
+			//FailOnMissing: true,
+		},
+		{
+			Name:  "target_tree",
+			Value: boolToUint32(this.conf.GetPidTree()),
+		},
+		{
+			Name:  "latency_only",
+			Value: boolToUint32(this.conf.(*MysqldConfig).Latency),
+		},
+		{
+			Name:  "query_max_len",
+			Value: this.conf.(*MysqldConfig).QueryMaxLen,
+		},
+		{
+			Name:  "ps_param_size",
+			Value: this.conf.(*MysqldConfig).psParamSize(),
+		},
+		{
+			Name:  "thd_thread_id_offset",
+			Value: this.conf.(*MysqldConfig).ThdIdOffset,
+		},
+		{
+			Name:  "thd_stmt_id_offset",
+			Value: this.conf.(*MysqldConfig).ThdStmtIdOffset,
+		},
+	}
+
+	if this.conf.GetPid() <= 0 {
+		this.logger.Printf("target all process. \n")
+	} else {
+		this.logger.Printf("target PID:%d, tree:%v \n", this.conf.GetPid(), this.conf.GetPidTree())
+	}
+	return editor
+}
+
 func (this *MMysqldProbe) setupManagers() error {
 	var binaryPath string
 	switch this.conf.(*MysqldConfig).elfType {
@@ -127,8 +187,8 @@ func (this *MMysqldProbe) setupManagers() error {
 	case MYSQLD_TYPE_80:
 		probes = []*manager.Probe{
 			{
-				Section:          "uprobe/dispatch_command_57", //TODO CHANGE to mysqld80 @CFC4N
-				EbpfFuncName:     "mysql57_query",
+				Section:          "uprobe/dispatch_command_80",
+				EbpfFuncName:     "mysql80_query",
 				AttachToFuncName: attachFunc,
 				UprobeOffset:     offset,
 				BinaryPath:       binaryPath,
@@ -168,8 +228,16 @@ func (this *MMysqldProbe) setupManagers() error {
 			},
 		},
 	}
+	addProcessProbes(this.bpfManager)
 
 	this.logger.Printf("Mysql Version:%s, binrayPath:%s, FunctionName:%s ,UprobeOffset:%d\n", versionInfo, binaryPath, attachFunc, offset)
+	conf := this.conf.(*MysqldConfig)
+	if conf.ThdIdOffset == 0 {
+		this.logger.Printf("WARNING: --thd-id-offset is not set, connection ids are 0. Get THD::m_thread_id from the mysqld debuginfo, see README.md")
+	}
+	if version == MYSQLD_TYPE_80 && conf.ThdStmtIdOffset == 0 {
+		this.logger.Printf("WARNING: --thd-stmt-id-offset is not set, executes of prepared statements are printed without their SQL. Get THD::statement_id_counter from the mysqld debuginfo, see README.md")
+	}
 
 	this.bpfManagerOptions = manager.Options{
 		DefaultKProbeMaxActive: 512,
@@ -185,6 +253,11 @@ func (this *MMysqldProbe) setupManagers() error {
 			Max: math.MaxUint64,
 		},
 	}
+
+	if this.conf.EnableGlobalVar() {
+		// 填充 RewriteContants 对应map
+		this.bpfManagerOptions.ConstantEditors = this.constantEditor()
+	}
 	return nil
 }
 
@@ -205,6 +278,14 @@ func (this *MMysqldProbe) initDecodeFun() error {
 	this.eventMaps = append(this.eventMaps, mysqldEventsMap)
 	this.eventFuncMaps[mysqldEventsMap] = &mysqldEvent{}
 
+	// process exec/fork/exit events, kept in the shared process cache.
+	procEventsMap, procEvent, err := processEventsMap(this.bpfManager, this)
+	if err != nil {
+		return err
+	}
+	this.eventMaps = append(this.eventMaps, procEventsMap)
+	this.eventFuncMaps[procEventsMap] = procEvent
+
 	return nil
 }
 
@@ -212,6 +293,27 @@ func (this *MMysqldProbe) Events() []*ebpf.Map {
 	return this.eventMaps
 }
 
+// Dispatcher resolves prepared statements with the statement cache, then
+// prints the event.
+func (this *MMysqldProbe) Dispatcher(event IEventStruct) {
+	e, ok := event.(*mysqldEvent)
+	if !ok {
+		return
+	}
+	switch e.command {
+	case COM_STMT_PREPARE:
+		// 0: the id could not be read, its executes stay unknown.
+		if e.stmtId != 0 {
+			this.stmts.Prepare(e.connId(), e.stmtId, unix.ByteSliceToString(e.query))
+		}
+	case COM_STMT_EXECUTE:
+		e.stmtSql = this.stmts.Get(e.connId(), e.stmtId)
+	case COM_STMT_CLOSE:
+		this.stmts.Close(e.connId(), e.stmtId)
+	}
+	this.output.WriteEvent(e, this.conf.GetHex())
+}
+
 func init() {
 	mod := &MMysqldProbe{}
 	mod.name = MODULE_NAME_MYSQLD
@@ -7,6 +7,7 @@ import (
 	"log"
 	"math"
 	"os"
+	"time"
 
 	"github.com/cilium/ebpf"
 	manager "github.com/ehids/ebpfmanager"
@@ -23,8 +24,11 @@ type MOpenSSLProbe struct {
 	eventFuncMaps     map[*ebpf.Map]IEventStruct
 	eventMaps         []*ebpf.Map
 
-	// pid[fd:Addr]
-	pidConns map[uint32]map[uint32]string
+	// (pid, fd) -> remote address
+	conns connTable
+
+	// plaintext as TCP streams, with --pcapfile
+	pcap *pcapWriter
 }
 
 //对象初始化
@@ -34,7 +38,19 @@ func (this *MOpenSSLProbe) Init(ctx context.Context, logger *log.Logger, conf IC
 	this.Module.SetChild(this)
 	this.eventMaps = make([]*ebpf.Map, 0, 2)
 	this.eventFuncMaps = make(map[*ebpf.Map]IEventStruct)
-	this.pidConns = make(map[uint32]map[uint32]string)
+	go this.conns.run(ctx)
+	if path := conf.(*TlsConfig).PcapFile; path != "" {
+		pcap, err := newPcapWriter(path)
+		if err != nil {
+			return errors.Wrapf(err, "create pcapng file %s", path)
+		}
+		this.pcap = pcap
+		go this.pcap.run(ctx)
+		this.logger.Printf("%s write plaintext to pcapng file %s", this.Name(), path)
+	}
+	processes.OnExit(func(pid uint32) {
+		this.DelConn(pid, 0)
+	})
 	return nil
 }
 
@@ -48,7 +64,7 @@ func (this *MOpenSSLProbe) Start() error {
 func (this *MOpenSSLProbe) start() error {
 
 	// fetch ebpf assets
-	byteBuf, err := assets.Asset("user/bytecode/openssl_kern.o")
+	byteBuf, err := assets.Asset("user/bytecode/tls_kern.o")
 	if err != nil {
 		return errors.Wrap(err, "couldn't find asset")
 	}
@@ -69,6 +85,18 @@ func (this *MOpenSSLProbe) start() error {
 		return errors.Wrap(err, "couldn't start bootstrap manager")
 	}
 
+	// 填充 --tree 模式下的目标进程树
+	if err := seedTargetTree(this.bpfManager, this.conf); err != nil {
+		return errors.Wrap(err, "couldn't seed target process tree")
+	}
+
+	// connections opened before the connect probe was attached, from /proc.
+	go func() {
+		start := time.Now()
+		n := this.seedConns()
+		this.logger.Printf("seeded %d connections from /proc in %s\n", n, time.Since(start))
+	}()
+
 	// 加载map信息，map对应events decode表。
 	err = this.initDecodeFun()
 	if err != nil {
@@ -93,73 +121,47 @@ func (this *MOpenSSLProbe) constantEditor() []manager.ConstantEditor {
 			Value: uint64(this.conf.GetPid()),
 			//FailOnMissing: true,
 		},
+		{
+			Name:  "target_tree",
+			Value: boolToUint32(this.conf.GetPidTree()),
+		},
 	}
 
 	if this.conf.GetPid() <= 0 {
 		this.logger.Printf("target all process. \n")
 	} else {
-		this.logger.Printf("target PID:%d \n", this.conf.GetPid())
+		this.logger.Printf("target PID:%d, tree:%v \n", this.conf.GetPid(), this.conf.GetPidTree())
 	}
 	return editor
 }
 
 func (this *MOpenSSLProbe) setupManagers() error {
-	var binaryPath, libPthread string
-	switch this.conf.(*OpensslConfig).elfType {
-	case ELF_TYPE_BIN:
-		binaryPath = this.conf.(*OpensslConfig).Curlpath
-	case ELF_TYPE_SO:
-		binaryPath = this.conf.(*OpensslConfig).Openssl
-	default:
-		//如果没找到
-		binaryPath = "/lib/x86_64-linux-gnu/libssl.so.1.1"
-	}
+	conf := this.conf.(*TlsConfig)
 
-	libPthread = this.conf.(*OpensslConfig).Pthread
-	if libPthread == "" {
-		libPthread = "/lib/x86_64-linux-gnu/libpthread.so.0"
+	// one object for every library, only the probes of the found ones are attached.
+	var probes []*manager.Probe
+	if conf.opensslErr != nil {
+		this.logger.Printf("openssl not probed: %v\n", conf.opensslErr)
+	} else {
+		p, err := this.opensslProbes(conf.Openssl)
+		if err != nil {
+			return err
+		}
+		probes = append(probes, p...)
 	}
-	_, err := os.Stat(binaryPath)
-	if err != nil {
-		return err
+	if conf.gnutlsErr != nil {
+		this.logger.Printf("gnutls not probed: %v\n", conf.gnutlsErr)
+	} else {
+		probes = append(probes, this.gnutlsProbes(conf.Gnutls)...)
+	}
+	if conf.nsprErr != nil {
+		this.logger.Printf("nspr not probed: %v\n", conf.nsprErr)
+	} else {
+		probes = append(probes, this.nsprProbes(conf.Nspr)...)
 	}
-
-	this.logger.Printf("HOOK type:%d, binrayPath:%s\n", this.conf.(*OpensslConfig).elfType, binaryPath)
-	this.logger.Printf("libPthread so Path:%s\n", libPthread)
 
 	this.bpfManager = &manager.Manager{
-		Probes: []*manager.Probe{
-			{
-				Section:          "uprobe/SSL_write",
-				EbpfFuncName:     "probe_entry_SSL_write",
-				AttachToFuncName: "SSL_write",
-				BinaryPath:       binaryPath,
-			},
-			{
-				Section:          "uretprobe/SSL_write",
-				EbpfFuncName:     "probe_ret_SSL_write",
-				AttachToFuncName: "SSL_write",
-				BinaryPath:       binaryPath,
-			},
-			{
-				Section:          "uprobe/SSL_read",
-				EbpfFuncName:     "probe_entry_SSL_read",
-				AttachToFuncName: "SSL_read",
-				BinaryPath:       binaryPath,
-			},
-			{
-				Section:          "uretprobe/SSL_read",
-				EbpfFuncName:     "probe_ret_SSL_read",
-				AttachToFuncName: "SSL_read",
-				BinaryPath:       binaryPath,
-			},
-			{
-				Section:          "uprobe/connect",
-				EbpfFuncName:     "probe_connect",
-				AttachToFuncName: "connect",
-				BinaryPath:       libPthread,
-			},
-		},
+		Probes: probes,
 
 		Maps: []*manager.Map{
 			{
@@ -170,6 +172,7 @@ func (this *MOpenSSLProbe) setupManagers() error {
 			},
 		},
 	}
+	addProcessProbes(this.bpfManager)
 
 	this.bpfManagerOptions = manager.Options{
 		DefaultKProbeMaxActive: 512,
@@ -193,6 +196,163 @@ func (this *MOpenSSLProbe) setupManagers() error {
 	return nil
 }
 
+func (this *MOpenSSLProbe) opensslProbes(conf *OpensslConfig) ([]*manager.Probe, error) {
+	var binaryPath, libPthread string
+	switch conf.elfType {
+	case ELF_TYPE_BIN:
+		binaryPath = conf.Curlpath
+	case ELF_TYPE_SO:
+		binaryPath = conf.Openssl
+	default:
+		//如果没找到
+		binaryPath = "/lib/x86_64-linux-gnu/libssl.so.1.1"
+	}
+
+	libPthread = conf.Pthread
+	if libPthread == "" {
+		libPthread = "/lib/x86_64-linux-gnu/libpthread.so.0"
+	}
+	_, err := os.Stat(binaryPath)
+	if err != nil {
+		return nil, err
+	}
+
+	this.logger.Printf("openssl HOOK type:%d, binrayPath:%s\n", conf.elfType, binaryPath)
+	this.logger.Printf("libPthread so Path:%s\n", libPthread)
+
+	return []*manager.Probe{
+		{
+			Section:          "uprobe/SSL_write",
+			EbpfFuncName:     "probe_entry_SSL_write",
+			AttachToFuncName: "SSL_write",
+			BinaryPath:       binaryPath,
+		},
+		{
+			Section:          "uretprobe/SSL_write",
+			EbpfFuncName:     "probe_ret_SSL_write",
+			AttachToFuncName: "SSL_write",
+			BinaryPath:       binaryPath,
+		},
+		{
+			Section:          "uprobe/SSL_read",
+			EbpfFuncName:     "probe_entry_SSL_read",
+			AttachToFuncName: "SSL_read",
+			BinaryPath:       binaryPath,
+		},
+		{
+			Section:          "uretprobe/SSL_read",
+			EbpfFuncName:     "probe_ret_SSL_read",
+			AttachToFuncName: "SSL_read",
+			BinaryPath:       binaryPath,
+		},
+		{
+			Section:          "uprobe/connect",
+			EbpfFuncName:     "probe_connect",
+			AttachToFuncName: "connect",
+			BinaryPath:       libPthread,
+		},
+	}, nil
+}
+
+func (this *MOpenSSLProbe) gnutlsProbes(conf *GnutlsConfig) []*manager.Probe {
+	binaryPath := conf.Gnutls
+	this.logger.Printf("gnutls HOOK type:%d, binrayPath:%s\n", conf.elfType, binaryPath)
+
+	return []*manager.Probe{
+		{
+			Section:          "uprobe/gnutls_record_send",
+			EbpfFuncName:     "probe_entry_gnutls_record_send",
+			AttachToFuncName: "gnutls_record_send",
+			BinaryPath:       binaryPath,
+		},
+		{
+			Section:          "uretprobe/gnutls_record_send",
+			EbpfFuncName:     "probe_ret_gnutls_record_send",
+			AttachToFuncName: "gnutls_record_send",
+			BinaryPath:       binaryPath,
+		},
+		{
+			Section:          "uprobe/gnutls_record_recv",
+			EbpfFuncName:     "probe_entry_gnutls_record_recv",
+			AttachToFuncName: "gnutls_record_recv",
+			BinaryPath:       binaryPath,
+		},
+		{
+			Section:          "uretprobe/gnutls_record_recv",
+			EbpfFuncName:     "probe_ret_gnutls_record_recv",
+			AttachToFuncName: "gnutls_record_recv",
+			BinaryPath:       binaryPath,
+		},
+	}
+}
+
+func (this *MOpenSSLProbe) nsprProbes(conf *NsprConfig) []*manager.Probe {
+	binaryPath := conf.Nsprpath
+	this.logger.Printf("nspr HOOK type:%d, binrayPath:%s\n", conf.elfType, binaryPath)
+
+	return []*manager.Probe{
+		{
+			Section:          "uprobe/PR_Write",
+			EbpfFuncName:     "probe_entry_PR_Write",
+			AttachToFuncName: "PR_Write",
+			BinaryPath:       binaryPath,
+		},
+		{
+			Section:          "uretprobe/PR_Write",
+			EbpfFuncName:     "probe_ret_PR_Write",
+			AttachToFuncName: "PR_Write",
+			BinaryPath:       binaryPath,
+		},
+
+		// for PR_Send start
+		//  |  ``PR_Send`` or ``PR_Write``
+		//   | ``PR_Read`` or ``PR_Recv``
+		{
+			UID:              "PR_Write-PR_Send",
+			Section:          "uprobe/PR_Write",
+			EbpfFuncName:     "probe_entry_PR_Write",
+			AttachToFuncName: "PR_Send",
+			BinaryPath:       binaryPath,
+		},
+		{
+			UID:              "PR_Write-PR_Send",
+			Section:          "uretprobe/PR_Write",
+			EbpfFuncName:     "probe_ret_PR_Write",
+			AttachToFuncName: "PR_Send",
+			BinaryPath:       binaryPath,
+		},
+		// for PR_Send end
+
+		{
+			Section:          "uprobe/PR_Read",
+			EbpfFuncName:     "probe_entry_PR_Read",
+			AttachToFuncName: "PR_Read",
+			BinaryPath:       binaryPath,
+		},
+		{
+			Section:          "uretprobe/PR_Read",
+			EbpfFuncName:     "probe_ret_PR_Read",
+			AttachToFuncName: "PR_Read",
+			BinaryPath:       binaryPath,
+		},
+
+		{
+			UID:              "PR_Read-PR_Recv",
+			Section:          "uprobe/PR_Read",
+			EbpfFuncName:     "probe_entry_PR_Read",
+			AttachToFuncName: "PR_Recv",
+			BinaryPath:       binaryPath,
+		},
+		{
+			UID:              "PR_Read-PR_Recv",
+			Section:          "uretprobe/PR_Read",
+			EbpfFuncName:     "probe_ret_PR_Read",
+			AttachToFuncName: "PR_Recv",
+			BinaryPath:       binaryPath,
+		},
+	}
+}
+
 func (this *MOpenSSLProbe) DecodeFun(em *ebpf.Map) (IEventStruct, bool) {
 	fun, found := this.eventFuncMaps[em]
 	return fun, found
@@ -210,6 +370,10 @@ func (this *MOpenSSLProbe) initDecodeFun() error {
 	this.eventMaps = append(this.eventMaps, SSLDumpEventsMap)
 	sslEvent := &SSLDataEvent{}
 	sslEvent.SetModule(this)
+	if this.pcap != nil {
+		// handed to Dispatcher, to be written to the pcapng file.
+		sslEvent.event_type = EVENT_TYPE_MODULE_DATA
+	}
 	this.eventFuncMaps[SSLDumpEventsMap] = sslEvent
 
 	ConnEventsMap, found, err := this.bpfManager.GetMap("connect_events")
@@ -223,6 +387,14 @@ func (this *MOpenSSLProbe) initDecodeFun() error {
 	connEvent := &ConnDataEvent{}
 	connEvent.SetModule(this)
 	this.eventFuncMaps[ConnEventsMap] = connEvent
+	// process exec/fork/exit events, kept in the shared process cache.
+	procEventsMap, procEvent, err := processEventsMap(this.bpfManager, this)
+	if err != nil {
+		return err
+	}
+	this.eventMaps = append(this.eventMaps, procEventsMap)
+	this.eventFuncMaps[procEventsMap] = procEvent
+
 	return nil
 }
 
@@ -230,63 +402,73 @@ func (this *MOpenSSLProbe) Events() []*ebpf.Map {
 	return this.eventMaps
 }
 
-func (this *MOpenSSLProbe) AddConn(pid, fd uint32, addr string) {
-	// save to map
-	var m map[uint32]string
-	var f bool
-	m, f = this.pidConns[pid]
-	if !f {
-		m = make(map[uint32]string)
-	}
-	m[fd] = addr
-	this.pidConns[pid] = m
-	return
+func (this *MOpenSSLProbe) AddConn(pid, fd uint32, addr connAddr) {
+	this.conns.Add(pid, fd, addr)
 }
 
-// process exit :fd is 0 , delete all pid map
+// process exit :fd is 0 , delete all pid map, called by the process cache.
 // fd exit :pid > 0, fd > 0, delete fd value
-// TODO add fd * pid exit event hook
 func (this *MOpenSSLProbe) DelConn(pid, fd uint32) {
-	// delete from map
 	if pid == 0 {
 		return
 	}
 
 	if fd == 0 {
-		delete(this.pidConns, pid)
-	}
-
-	var m map[uint32]string
-	var f bool
-	m, f = this.pidConns[pid]
-	if !f {
+		this.conns.Exit(pid)
 		return
 	}
-	delete(m, fd)
-	this.pidConns[pid] = m
-	return
+	this.conns.Del(pid, fd)
 }
 
 func (this *MOpenSSLProbe) GetConn(pid, fd uint32) string {
-	addr := ""
-	var m map[uint32]string
-	var f bool
-	m, f = this.pidConns[pid]
-	if !f {
+	addr, found := this.lookupConn(pid, fd)
+	if !found {
 		return CONN_NOT_FOUND
 	}
+	return addr.String()
+}
 
-	addr, f = m[fd]
-	if !f {
-		return CONN_NOT_FOUND
+// lookupConn returns the remote address of (pid, fd). A socket missing from
+// the table, evicted after CONN_TABLE_TTL without data or opened unseen, is
+// resolved again from /proc, unless a capture file is read.
+func (this *MOpenSSLProbe) lookupConn(pid, fd uint32) (connAddr, bool) {
+	if addr, found := this.conns.Get(pid, fd); found {
+		return addr, true
+	}
+	if this.offline || !this.conns.tryResolve(pid, fd, time.Now()) {
+		return connAddr{}, false
 	}
-	return addr
+	addr, found := resolveConn(pid, fd)
+	if found {
+		this.AddConn(pid, fd, addr)
+	}
+	return addr, found
 }
 
 func (this *MOpenSSLProbe) Dispatcher(event IEventStruct) {
-	// detect event type TODO
-	this.AddConn(event.(*ConnDataEvent).Pid, event.(*ConnDataEvent).Fd, event.(*ConnDataEvent).Addr)
-	//this.logger.Println(event)
+	switch e := event.(type) {
+	case *ConnDataEvent:
+		if this.pcap != nil {
+			// a new connection on the fd.
+			this.pcap.Reset(e.Pid, e.ConnKey, e.TimestampNs)
+		}
+		this.AddConn(e.Pid, e.ConnKey, e.Addr)
+	case *SSLDataEvent:
+		// --pcapfile only, otherwise they are EVENT_TYPE_OUTPUT.
+		addr, _ := e.conn()
+		this.pcap.WriteEvent(e, addr)
+	}
+}
+
+// Flush writes the buffered output and pcapng packets.
+func (this *MOpenSSLProbe) Flush() error {
+	this.waitPipeline()
+	if this.pcap != nil {
+		if err := this.pcap.Flush(); err != nil {
+			return err
+		}
+	}
+	return this.Module.Flush()
 }
 
 func init() {
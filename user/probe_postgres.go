@@ -11,6 +11,7 @@ import (
 	"log"
 	"math"
 	"os"
+	"time"
 
 	"github.com/cilium/ebpf"
 	manager "github.com/ehids/ebpfmanager"
@@ -24,6 +25,7 @@ type MPostgresProbe struct {
 	bpfManagerOptions manager.Options
 	eventFuncMaps     map[*ebpf.Map]IEventStruct
 	eventMaps         []*ebpf.Map
+	stmts             *postgresStmtCache
 }
 
 // init probe
@@ -33,6 +35,7 @@ func (this *MPostgresProbe) Init(ctx context.Context, logger *log.Logger, conf I
 	this.Module.SetChild(this)
 	this.eventMaps = make([]*ebpf.Map, 0, 2)
 	this.eventFuncMaps = make(map[*ebpf.Map]IEventStruct)
+	this.stmts = newPostgresStmtCache()
 	return nil
 }
 
@@ -67,6 +70,11 @@ func (this *MPostgresProbe) start() error {
 		return errors.Wrap(err, "couldn't start bootstrap manager")
 	}
 
+	// 填充 --tree 模式下的目标进程树
+	if err := seedTargetTree(this.bpfManager, this.conf); err != nil {
+		return errors.Wrap(err, "couldn't seed target process tree")
+	}
+
 	// 加载map信息，map对应events decode表。
 	err = this.initDecodeFun()
 	if err != nil {
@@ -83,6 +91,35 @@ func (this *MPostgresProbe) Close() error {
 	return nil
 }
 
+func (this *MPostgresProbe) constantEditor() []manager.ConstantEditor {
+	var editor = []manager.ConstantEditor{
+		{
+			Name:  "target_pid",
+			Value: uint64(this.conf.GetPid()),
+			//FailOnMissing: true,
+		},
+		{
+			Name:  "target_tree",
+			Value: boolToUint32(this.conf.GetPidTree()),
+		},
+		{
+			Name:  "query_max_len",
+			Value: this.conf.(*PostgresConfig).QueryMaxLen,
+		},
+		{
+			Name:  "slow_threshold_ns",
+			Value: this.conf.(*PostgresConfig).Threshold * uint64(time.Millisecond),
+		},
+	}
+
+	if this.conf.GetPid() <= 0 {
+		this.logger.Printf("target all process. \n")
+	} else {
+		this.logger.Printf("target PID:%d, tree:%v \n", this.conf.GetPid(), this.conf.GetPidTree())
+	}
+	return editor
+}
+
 func (this *MPostgresProbe) setupManagers() error {
 	binaryPath := this.conf.(*PostgresConfig).PostgresPath
 
@@ -94,11 +131,43 @@ func (this *MPostgresProbe) setupManagers() error {
 
 	probes := []*manager.Probe{
 		{
-			Section:          "uprobe/exec_simple_qurey",
+			Section:          "uprobe/exec_simple_query",
 			EbpfFuncName:     "postgres_query",
 			AttachToFuncName: attachFunc,
 			BinaryPath:       binaryPath,
 		},
+		{
+			Section:          "uretprobe/exec_simple_query",
+			EbpfFuncName:     "postgres_query_return",
+			AttachToFuncName: attachFunc,
+			BinaryPath:       binaryPath,
+		},
+
+		// extended query protocol
+		{
+			Section:          "uprobe/exec_parse_message",
+			EbpfFuncName:     "postgres_parse",
+			AttachToFuncName: "exec_parse_message",
+			BinaryPath:       binaryPath,
+		},
+		{
+			Section:          "uprobe/exec_bind_message",
+			EbpfFuncName:     "postgres_bind",
+			AttachToFuncName: "exec_bind_message",
+			BinaryPath:       binaryPath,
+		},
+		{
+			Section:          "uprobe/exec_execute_message",
+			EbpfFuncName:     "postgres_execute",
+			AttachToFuncName: "exec_execute_message",
+			BinaryPath:       binaryPath,
+		},
+		{
+			Section:          "uretprobe/exec_execute_message",
+			EbpfFuncName:     "postgres_execute_return",
+			AttachToFuncName: "exec_execute_message",
+			BinaryPath:       binaryPath,
+		},
 	}
 
 	this.bpfManager = &manager.Manager{
@@ -109,8 +178,9 @@ func (this *MPostgresProbe) setupManagers() error {
 			},
 		},
 	}
+	addProcessProbes(this.bpfManager)
 
-	this.logger.Printf("Postgres, binrayPath: %s, FunctionName: %s\n", binaryPath, attachFunc)
+	this.logger.Printf("Postgres, binrayPath: %s, FunctionName: %s, Threshold: %dms\n", binaryPath, attachFunc, this.conf.(*PostgresConfig).Threshold)
 
 	this.bpfManagerOptions = manager.Options{
 		DefaultKProbeMaxActive: 512,
@@ -126,6 +196,11 @@ func (this *MPostgresProbe) setupManagers() error {
 			Max: math.MaxUint64,
 		},
 	}
+
+	if this.conf.EnableGlobalVar() {
+		// 填充 RewriteContants 对应map
+		this.bpfManagerOptions.ConstantEditors = this.constantEditor()
+	}
 	return nil
 }
 
@@ -146,6 +221,14 @@ func (this *MPostgresProbe) initDecodeFun() error {
 	this.eventMaps = append(this.eventMaps, postgresEventsMap)
 	this.eventFuncMaps[postgresEventsMap] = &postgresEvent{}
 
+	// process exec/fork/exit events, kept in the shared process cache.
+	procEventsMap, procEvent, err := processEventsMap(this.bpfManager, this)
+	if err != nil {
+		return err
+	}
+	this.eventMaps = append(this.eventMaps, procEventsMap)
+	this.eventFuncMaps[procEventsMap] = procEvent
+
 	return nil
 }
 
@@ -153,6 +236,28 @@ func (this *MPostgresProbe) Events() []*ebpf.Map {
 	return this.eventMaps
 }
 
+// Dispatcher resolves the extended query protocol with the statement cache.
+// Parses and binds are only cached: the kernel sends them whatever their
+// duration, drivers parse an unnamed statement for almost every query, and
+// the execute that passed --threshold carries their SQL.
+func (this *MPostgresProbe) Dispatcher(event IEventStruct) {
+	e, ok := event.(*postgresEvent)
+	if !ok {
+		return
+	}
+	switch e.command {
+	case PG_PARSE:
+		this.stmts.Parse(e.Pid, e.stmtName, unix.ByteSliceToString(e.query))
+		return
+	case PG_BIND:
+		this.stmts.Bind(e.Pid, e.portalName, e.stmtName)
+		return
+	case PG_EXECUTE:
+		e.stmtName, e.stmtSql, _ = this.stmts.Execute(e.Pid, e.portalName)
+	}
+	this.output.WriteEvent(e, false)
+}
+
 func init() {
 	mod := &MPostgresProbe{}
 	mod.name = MODULE_NAME_POSTGRES
@@ -0,0 +1,472 @@
+/*
+Copyright © 2022 CFC4N <cfc4n.cs@gmail.com>
+
+*/
+package user
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"os"
+	"regexp"
+	"strconv"
+	"strings"
+	"sync"
+	"time"
+
+	"github.com/cilium/ebpf"
+	manager "github.com/ehids/ebpfmanager"
+	"golang.org/x/sys/unix"
+)
+
+const (
+	MAX_PATH_SIZE    = 256
+	MAX_CMDLINE_SIZE = 256
+
+	// comm and ppid
+	PROCESS_BODY_FIXED_SIZE = 16 + 4
+
+	// upper bound of cached processes, exited ones are dropped first.
+	PROCESS_CACHE_SIZE = 65536
+
+	// exited processes are kept for a while, events still queued in other
+	// perf buffers may need them.
+	PROCESS_EXIT_DELAY = 5 * time.Second
+
+	COMM_NOT_FOUND = "[COMM_NOT_FOUND]"
+)
+
+/*
+struct process_event_t {
+    struct event_header_t header;
+    char comm[TASK_COMM_LEN];
+    u32 ppid;
+    char exe[MAX_PATH_SIZE];
+    char cmdline[MAX_CMDLINE_SIZE];
+};
+*/
+type ProcessEvent struct {
+	module     IModule
+	event_type EVENT_TYPE
+	EventHeader
+	Comm    [16]byte
+	Ppid    uint32
+	Exe     string
+	Cmdline string
+
+	cmdline []byte // Cmdline before its conversion, reused
+}
+
+func (this *ProcessEvent) Decode(payload []byte) (err error) {
+	var body []byte
+	if body, err = this.EventHeader.Decode(payload); err != nil {
+		return
+	}
+	if len(body) < PROCESS_BODY_FIXED_SIZE {
+		return fmt.Errorf("process event body too short: %d bytes", len(body))
+	}
+	copy(this.Comm[:], body)
+	this.Ppid = binary.LittleEndian.Uint32(body[16:20])
+	body = body[PROCESS_BODY_FIXED_SIZE:]
+	if len(body) < MAX_PATH_SIZE+MAX_CMDLINE_SIZE {
+		// fork and exit events, the event may be reused from an exec.
+		this.Exe = ""
+		this.Cmdline = ""
+		return nil
+	}
+	setString(&this.Exe, body[:MAX_PATH_SIZE])
+	// joinCmdline, in a reused buffer.
+	this.cmdline = append(this.cmdline[:0], bytes.TrimRight(body[MAX_PATH_SIZE:MAX_PATH_SIZE+MAX_CMDLINE_SIZE], "\x00")...)
+	for i, c := range this.cmdline {
+		if c == 0 {
+			this.cmdline[i] = ' '
+		}
+	}
+	setString(&this.Cmdline, this.cmdline)
+	return nil
+}
+
+func (this *ProcessEvent) String() string {
+	var action string
+	switch this.Type {
+	case KERNEL_EVENT_PROCESS_EXEC:
+		action = "exec"
+	case KERNEL_EVENT_PROCESS_FORK:
+		action = "fork"
+	case KERNEL_EVENT_PROCESS_EXIT:
+		action = "exit"
+	default:
+		action = fmt.Sprintf("UNKNOW_%d", this.Type)
+	}
+	return fmt.Sprintf("PID:%d, PPID:%d, Comm:%s, Action:%s, Exe:%s, Cmdline:%s", this.Pid, this.Ppid, unix.ByteSliceToString(this.Comm[:]), action, this.Exe, this.Cmdline)
+}
+
+func (this *ProcessEvent) AppendJSON(dst []byte) []byte {
+	dst = appendJSONHeader(dst, &this.EventHeader, unix.ByteSliceToString(this.Comm[:]))
+	dst = appendJSONUint(dst, "ppid", uint64(this.Ppid))
+	if this.Type == KERNEL_EVENT_PROCESS_EXEC {
+		dst = appendJSONField(dst, "exe", this.Exe)
+		dst = appendJSONField(dst, "cmdline", this.Cmdline)
+	}
+	return append(dst, '}')
+}
+
+func (this *ProcessEvent) StringHex() string {
+	return this.String()
+}
+
+func (this *ProcessEvent) SetModule(module IModule) {
+	this.module = module
+}
+
+func (this *ProcessEvent) Module() IModule {
+	return this.module
+}
+
+func (this *ProcessEvent) Clone() IEventStruct {
+	event := new(ProcessEvent)
+	event.module = this.module
+	event.event_type = EVENT_TYPE_PROCESS
+	return event
+}
+
+func (this *ProcessEvent) EventType() EVENT_TYPE {
+	return this.event_type
+}
+
+// ProcessInfo is the metadata of a process, published once by the kernel
+// instead of being sent with every event.
+type ProcessInfo struct {
+	Pid         uint32
+	Ppid        uint32
+	Comm        string
+	Exe         string
+	Cmdline     string
+	CgroupId    uint64
+	ContainerId string
+}
+
+// ProcessCache keeps ProcessInfo of the processes seen by the modules. It is
+// filled by exec/fork events, and from /proc for processes started before
+// eCapture. It is shared by all modules.
+type ProcessCache struct {
+	sync.RWMutex
+	procs   map[uint32]*ProcessInfo
+	exited  map[uint32]time.Time
+	onExits []func(pid uint32)
+
+	// reading a capture file, /proc is not read, see SetOffline.
+	offline bool
+}
+
+var processes = NewProcessCache()
+
+func NewProcessCache() *ProcessCache {
+	return &ProcessCache{
+		procs:  make(map[uint32]*ProcessInfo),
+		exited: make(map[uint32]time.Time),
+	}
+}
+
+// SetOffline stops every /proc lookup: the processes of a capture file are
+// only known from its dictionaries, the pids of this host are others.
+func (this *ProcessCache) SetOffline() {
+	this.Lock()
+	this.offline = true
+	this.Unlock()
+}
+
+// OnExit registers fn, called after a process exited and its delay elapsed.
+func (this *ProcessCache) OnExit(fn func(pid uint32)) {
+	this.Lock()
+	this.onExits = append(this.onExits, fn)
+	this.Unlock()
+}
+
+// Dispatch applies a process event. Every module loads the process probes, so
+// the same event may arrive more than once; it must stay idempotent.
+func (this *ProcessCache) Dispatch(event *ProcessEvent) {
+	this.RLock()
+	offline := this.offline
+	this.RUnlock()
+	// /proc is read before the lock is taken, Get must not wait on file I/O.
+	var containerId string
+	if event.Type == KERNEL_EVENT_PROCESS_EXEC && !offline {
+		containerId = readContainerId(event.Pid)
+	}
+
+	this.Lock()
+	switch event.Type {
+	case KERNEL_EVENT_PROCESS_EXEC:
+		ppid := event.Ppid
+		old, f := this.procs[event.Pid]
+		if f && ppid == 0 {
+			ppid = old.Ppid
+		}
+		// exec keeps the container, offline it comes from the capture file.
+		if f && offline {
+			containerId = old.ContainerId
+		}
+		this.set(&ProcessInfo{
+			Pid:         event.Pid,
+			Ppid:        ppid,
+			Comm:        unix.ByteSliceToString(event.Comm[:]),
+			Exe:         event.Exe,
+			Cmdline:     event.Cmdline,
+			CgroupId:    event.CgroupId,
+			ContainerId: containerId,
+		})
+		delete(this.exited, event.Pid)
+	case KERNEL_EVENT_PROCESS_FORK:
+		// the child runs its parent's image until it calls exec.
+		if _, f := this.procs[event.Pid]; !f {
+			info := &ProcessInfo{
+				Pid:      event.Pid,
+				Ppid:     event.Ppid,
+				Comm:     unix.ByteSliceToString(event.Comm[:]),
+				CgroupId: event.CgroupId,
+			}
+			if parent, f := this.procs[event.Ppid]; f {
+				info.Exe = parent.Exe
+				info.Cmdline = parent.Cmdline
+				info.ContainerId = parent.ContainerId
+			}
+			this.set(info)
+		}
+	case KERNEL_EVENT_PROCESS_EXIT:
+		if _, f := this.exited[event.Pid]; !f {
+			this.exited[event.Pid] = time.Now().Add(PROCESS_EXIT_DELAY)
+		}
+	}
+	expired := this.expire(time.Now())
+	onExits := this.onExits
+	this.Unlock()
+
+	for _, pid := range expired {
+		for _, fn := range onExits {
+			fn(pid)
+		}
+	}
+}
+
+// Get returns the ProcessInfo of pid, reading it from /proc at the first time
+// if the process was started before eCapture. It never returns nil.
+func (this *ProcessCache) Get(pid uint32) *ProcessInfo {
+	this.RLock()
+	info, f := this.procs[pid]
+	offline := this.offline
+	this.RUnlock()
+	if f {
+		return info
+	}
+
+	// cache misses too, the process may already be gone.
+	if offline {
+		info = &ProcessInfo{Pid: pid, Comm: COMM_NOT_FOUND}
+	} else {
+		info = readProcessInfo(pid)
+	}
+	this.Lock()
+	if cached, f := this.procs[pid]; f {
+		info = cached
+	} else {
+		this.set(info)
+	}
+	this.Unlock()
+	return info
+}
+
+// Put caches info, eg: the processes of a capture file.
+func (this *ProcessCache) Put(info *ProcessInfo) {
+	this.Lock()
+	this.set(info)
+	this.Unlock()
+}
+
+// Comm returns the command name of pid.
+func (this *ProcessCache) Comm(pid uint32) string {
+	return this.Get(pid).Comm
+}
+
+// set must be called with the lock held.
+func (this *ProcessCache) set(info *ProcessInfo) {
+	if _, f := this.procs[info.Pid]; !f && len(this.procs) >= PROCESS_CACHE_SIZE {
+		// drop an arbitrary entry, exited processes first.
+		victim := uint32(0)
+		for pid := range this.exited {
+			victim = pid
+			break
+		}
+		if victim == 0 {
+			for pid := range this.procs {
+				victim = pid
+				break
+			}
+		}
+		delete(this.procs, victim)
+		delete(this.exited, victim)
+	}
+	this.procs[info.Pid] = info
+}
+
+// expire must be called with the lock held.
+func (this *ProcessCache) expire(now time.Time) []uint32 {
+	var expired []uint32
+	for pid, deadline := range this.exited {
+		if now.Before(deadline) {
+			continue
+		}
+		delete(this.exited, pid)
+		delete(this.procs, pid)
+		expired = append(expired, pid)
+	}
+	return expired
+}
+
+func readProcessInfo(pid uint32) *ProcessInfo {
+	comm, err := os.ReadFile(fmt.Sprintf("/proc/%d/comm", pid))
+	if err != nil {
+		return &ProcessInfo{Pid: pid, Comm: COMM_NOT_FOUND}
+	}
+	info := &ProcessInfo{
+		Pid:         pid,
+		Comm:        strings.TrimSpace(string(comm)),
+		ContainerId: readContainerId(pid),
+	}
+	info.Exe, _ = os.Readlink(fmt.Sprintf("/proc/%d/exe", pid))
+	if cmdline, err := os.ReadFile(fmt.Sprintf("/proc/%d/cmdline", pid)); err == nil {
+		info.Cmdline = joinCmdline(cmdline)
+	}
+	if status, err := os.ReadFile(fmt.Sprintf("/proc/%d/status", pid)); err == nil {
+		for _, line := range strings.Split(string(status), "\n") {
+			if strings.HasPrefix(line, "PPid:") {
+				fmt.Sscanf(strings.TrimPrefix(line, "PPid:"), "%d", &info.Ppid)
+				break
+			}
+		}
+	}
+	return info
+}
+
+var containerIdRegexp = regexp.MustCompile(`[0-9a-f]{64}`)
+
+// readContainerId finds a docker/containerd style id in /proc/<pid>/cgroup.
+func readContainerId(pid uint32) string {
+	cgroup, err := os.ReadFile(fmt.Sprintf("/proc/%d/cgroup", pid))
+	if err != nil {
+		return ""
+	}
+	return string(containerIdRegexp.Find(cgroup))
+}
+
+// joinCmdline turns NUL separated arguments into a single line.
+func joinCmdline(b []byte) string {
+	b = bytes.TrimRight(b, "\x00")
+	return string(bytes.ReplaceAll(b, []byte{0}, []byte{' '}))
+}
+
+// processTree returns root and the pids of its running descendants, via the
+// ppid field of /proc/<pid>/stat.
+func processTree(root uint32) []uint32 {
+	entries, err := os.ReadDir("/proc")
+	if err != nil {
+		return []uint32{root}
+	}
+	children := make(map[uint32][]uint32)
+	for _, entry := range entries {
+		pid, err := strconv.ParseUint(entry.Name(), 10, 32)
+		if err != nil {
+			continue
+		}
+		stat, err := os.ReadFile(fmt.Sprintf("/proc/%d/stat", pid))
+		if err != nil {
+			continue
+		}
+		// comm may contain spaces and parentheses, ppid is the 2nd field after it.
+		fields := strings.Fields(string(stat[bytes.LastIndexByte(stat, ')')+1:]))
+		if len(fields) < 2 {
+			continue
+		}
+		ppid, err := strconv.ParseUint(fields[1], 10, 32)
+		if err != nil {
+			continue
+		}
+		children[uint32(ppid)] = append(children[uint32(ppid)], uint32(pid))
+	}
+
+	tree := []uint32{root}
+	for i := 0; i < len(tree); i++ {
+		tree = append(tree, children[tree[i]]...)
+	}
+	return tree
+}
+
+// seedTargetTree fills the target_tgids map of a module with the target pid
+// and its running descendants. It must be called after the manager started,
+// children forked from then on are added by the fork tracepoint.
+func seedTargetTree(bpfManager *manager.Manager, conf IConfig) error {
+	if !conf.GetPidTree() || conf.GetPid() == 0 || !conf.EnableGlobalVar() {
+		return nil
+	}
+	targetTgidsMap, found, err := bpfManager.GetMap("target_tgids")
+	if err != nil {
+		return err
+	}
+	if !found {
+		return fmt.Errorf("cant found map:target_tgids")
+	}
+	one := uint8(1)
+	for _, pid := range processTree(uint32(conf.GetPid())) {
+		if err = targetTgidsMap.Update(pid, one, ebpf.UpdateAny); err != nil {
+			return fmt.Errorf("seed target_tgids with pid %d: %v", pid, err)
+		}
+	}
+	return nil
+}
+
+// boolToUint32 converts b for the constant editors, kernel side flags are u32.
+func boolToUint32(b bool) uint32 {
+	if b {
+		return 1
+	}
+	return 0
+}
+
+// processProbes are the tracepoints of kern/process.h, loaded by every module.
+func processProbes() []*manager.Probe {
+	return []*manager.Probe{
+		{
+			Section:      "tracepoint/sched/sched_process_exec",
+			EbpfFuncName: "tracepoint_sched_process_exec",
+		},
+		{
+			Section:      "raw_tracepoint/sched_process_fork",
+			EbpfFuncName: "raw_tracepoint_sched_process_fork",
+		},
+		{
+			Section:      "tracepoint/sched/sched_process_exit",
+			EbpfFuncName: "tracepoint_sched_process_exit",
+		},
+	}
+}
+
+// addProcessProbes adds the tracepoints and the map of kern/process.h to m.
+func addProcessProbes(m *manager.Manager) {
+	m.Probes = append(m.Probes, processProbes()...)
+	m.Maps = append(m.Maps, &manager.Map{Name: "proc_events"})
+}
+
+// processEventsMap returns the proc_events map of a module and its decoder.
+func processEventsMap(bpfManager *manager.Manager, mod IModule) (*ebpf.Map, IEventStruct, error) {
+	procEventsMap, found, err := bpfManager.GetMap("proc_events")
+	if err != nil {
+		return nil, nil, err
+	}
+	if !found {
+		return nil, nil, fmt.Errorf("cant found map:proc_events")
+	}
+	procEvent := &ProcessEvent{}
+	procEvent.SetModule(mod)
+	return procEventsMap, procEvent, nil
+}